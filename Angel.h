@@ -56,6 +56,21 @@ namespace Angel {
 GLuint InitShader( const char* vertexShaderFile,
 		   const char* fragmentShaderFile );
 
+//  The pieces of InitShader, for compiling several programs at once:
+//    read the files (on any thread), start every program, then finish
+//    each one, which waits for it and exits with the log if it failed
+char* ReadShaderSource( const char* shaderFile );
+GLuint StartShader( const char* vertexSource,
+		    const char* fragmentSource );
+void FinishShader( GLuint program, const char* vertexShaderFile,
+		   const char* fragmentShaderFile );
+
+//  Have the driver compile on its own threads if it can
+//    (GL_KHR_parallel_shader_compile), then ShaderDone() can be
+//    asked about a started program without waiting for it
+bool UseParallelShaderCompile();
+bool ShaderDone( GLuint program );
+
 //  Defined constant for when numbers are too small to be used in the
 //    denominator of a division operation.  This is only used if the
 //    DEBUG macro is defined.
@@ -0,0 +1,86 @@
+#ifndef __ARENA_H__
+#define __ARENA_H__
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <new>
+#include <vector>
+#include <utility>
+#include <type_traits>
+
+//size of a cache line, objects made in an arena start on one
+const size_t CACHE_LINE = 64;
+//arena memory is grabbed from the heap in blocks of this many bytes
+const size_t ARENA_BLOCK_SIZE = 64 * 1024;
+
+// Bump allocator for everything that lives exactly as long as a scene.
+// Objects are packed into big cache line aligned blocks in the order they are
+// made, so a tree built top down ends up mostly contiguous. Nothing is freed on
+// its own, release() hands every block back at once. Destructors never run, so
+// make() only accepts types that don't need one.
+class Arena {
+    //what malloc gave us, freed on release
+    std::vector<char*> blocks;
+    //free space left in the newest block
+    char* next;
+    char* end;
+    //bytes handed out so far
+    size_t used;
+
+    public:
+    Arena() : next(NULL), end(NULL), used(0) {}
+
+    ~Arena() {
+        release();
+    }
+
+    //raw memory, align has to be a power of two no bigger than CACHE_LINE
+    void* allocate( size_t size, size_t align = CACHE_LINE ) {
+        char* p = (char*) (((uintptr_t) next + align - 1) & ~(uintptr_t) (align - 1));
+        if(next == NULL || p + size > end) {
+            size_t blockSize = size > ARENA_BLOCK_SIZE ? size : ARENA_BLOCK_SIZE;
+            //over allocate so the start can be moved up to a cache line
+            char* block = (char*) malloc(blockSize + CACHE_LINE);
+            if(block == NULL) throw std::bad_alloc();
+            blocks.push_back(block);
+            p = (char*) (((uintptr_t) block + CACHE_LINE - 1) & ~(uintptr_t) (CACHE_LINE - 1));
+            end = p + blockSize;
+        }
+        next = p + size;
+        used += size;
+        return p;
+    }
+
+    //construct a T in the arena, each one starts on its own cache line
+    template <typename T, typename... Args>
+    T* make( Args&&... args ) {
+        static_assert(std::is_trivially_destructible<T>::value, "arena objects are never destroyed");
+        return new (allocate(sizeof(T), alignof(T) > CACHE_LINE ? alignof(T) : CACHE_LINE))
+            T(std::forward<Args>(args)...);
+    }
+
+    //copy a string into the arena
+    const char* copy( const char* s ) {
+        size_t n = strlen(s) + 1;
+        char* p = (char*) allocate(n, 1);
+        memcpy(p, s, n);
+        return p;
+    }
+
+    //free everything at once, pointers into the arena are dead after this
+    void release() {
+        for(size_t i = 0; i < blocks.size(); i++) {
+            free(blocks[i]);
+        }
+        blocks.clear();
+        next = end = NULL;
+        used = 0;
+    }
+
+    size_t bytes() const {
+        return used;
+    }
+};
+
+#endif
@@ -0,0 +1,58 @@
+#ifndef __BENCHMARK_H__
+#define __BENCHMARK_H__
+
+#include <stdio.h>
+#include <vector>
+#include <algorithm>
+#include <chrono>
+
+// A series of per-frame measurements and the summary stats the benchmark reports.
+class Series {
+    std::vector<double> values;
+
+    public:
+    void add( double v ) {
+        values.push_back(v);
+    }
+
+    int size() const {
+        return values.size();
+    }
+
+    double mean() const {
+        if(values.empty()) return 0.0;
+        double sum = 0;
+        for(size_t i = 0; i < values.size(); i++) sum += values[i];
+        return sum / values.size();
+    }
+
+    //nearest rank percentile, p in [0,100]
+    double percentile( double p ) const {
+        if(values.empty()) return 0.0;
+        std::vector<double> sorted(values);
+        std::sort(sorted.begin(), sorted.end());
+        int rank = (int) (p / 100.0 * sorted.size() + 0.5);
+        if(rank < 1) rank = 1;
+        if(rank > (int) sorted.size()) rank = sorted.size();
+        return sorted[rank - 1];
+    }
+
+    double max() const {
+        if(values.empty()) return 0.0;
+        return *std::max_element(values.begin(), values.end());
+    }
+
+    //"name": { "mean": .., "p50": .., "p95": .., "p99": .., "max": .. }
+    void writeJson( FILE* fp, const char* name ) const {
+        fprintf(fp, "\"%s\": { \"samples\": %d, \"mean\": %.4f, \"p50\": %.4f, \"p95\": %.4f, \"p99\": %.4f, \"max\": %.4f }",
+                name, size(), mean(), percentile(50), percentile(95), percentile(99), max());
+    }
+};
+
+//milliseconds since some fixed point, for timing frames
+inline double milliseconds() {
+    return std::chrono::duration<double, std::milli>(
+            std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+#endif
@@ -0,0 +1,252 @@
+#ifndef __BVH_H__
+#define __BVH_H__
+
+#include <vector>
+#include <queue>
+#include <algorithm>
+#include <float.h>
+#include "Angel.h"
+
+// Bounding volume hierarchy over spheres for picking and spatial queries.
+// build() sorts the spheres into a binary tree once, splitting at the median
+// of the longest axis. After that the tree shape stays fixed and refit() only
+// moves the boxes to wherever the spheres are now, which is a single pass
+// since every node comes before its children in the node array.
+// Spheres are identified by their index in the arrays handed to build().
+class Bvh {
+    struct Node {
+        vec3 lo;
+        vec3 hi;
+        //children, or -1 for a leaf
+        int left;
+        int right;
+        //the sphere in a leaf
+        int sphere;
+    };
+
+    std::vector<Node> nodes;
+    //radius of each sphere as of the last build or refit
+    std::vector<float> radii;
+    //sphere indices while building
+    std::vector<int> order;
+
+    //fit a leaf box around its sphere
+    void fitLeaf( Node& n, const vec4& c ) {
+        float r = radii[n.sphere];
+        n.lo = vec3(c.x - r, c.y - r, c.z - r);
+        n.hi = vec3(c.x + r, c.y + r, c.z + r);
+    }
+
+    void fitInner( Node& n ) {
+        const Node& a = nodes[n.left];
+        const Node& b = nodes[n.right];
+        n.lo = vec3(std::min(a.lo.x, b.lo.x), std::min(a.lo.y, b.lo.y), std::min(a.lo.z, b.lo.z));
+        n.hi = vec3(std::max(a.hi.x, b.hi.x), std::max(a.hi.y, b.hi.y), std::max(a.hi.z, b.hi.z));
+    }
+
+    int buildNode( const vec4* centers, int begin, int end ) {
+        int node = nodes.size();
+        nodes.push_back(Node());
+        if(end - begin == 1) {
+            nodes[node].left = nodes[node].right = -1;
+            nodes[node].sphere = order[begin];
+            fitLeaf(nodes[node], centers[order[begin]]);
+            return node;
+        }
+        //split the centers at the median along the axis they spread out on most
+        vec3 lo(FLT_MAX, FLT_MAX, FLT_MAX), hi(-FLT_MAX, -FLT_MAX, -FLT_MAX);
+        for(int i = begin; i < end; i++) {
+            for(int a = 0; a < 3; a++) {
+                lo[a] = fmin(lo[a], centers[order[i]][a]);
+                hi[a] = fmax(hi[a], centers[order[i]][a]);
+            }
+        }
+        int axis = 0;
+        if(hi.y - lo.y > hi[axis] - lo[axis]) axis = 1;
+        if(hi.z - lo.z > hi[axis] - lo[axis]) axis = 2;
+        int mid = (begin + end) / 2;
+        std::nth_element(order.begin() + begin, order.begin() + mid, order.begin() + end,
+                [centers, axis](int a, int b) { return centers[a][axis] < centers[b][axis]; });
+        int left = buildNode(centers, begin, mid);
+        int right = buildNode(centers, mid, end);
+        Node& n = nodes[node];
+        n.left = left;
+        n.right = right;
+        n.sphere = -1;
+        fitInner(n);
+        return node;
+    }
+
+    //where a ray enters a box, FLT_MAX if it misses or it's past maxT
+    static float rayBox( const Node& n, const vec3& origin, const vec3& inv, float maxT ) {
+        float t0 = 0, t1 = maxT;
+        for(int a = 0; a < 3; a++) {
+            float near = (n.lo[a] - origin[a]) * inv[a];
+            float far = (n.hi[a] - origin[a]) * inv[a];
+            if(near > far) std::swap(near, far);
+            t0 = fmax(t0, near);
+            t1 = fmin(t1, far);
+        }
+        return t0 <= t1 ? t0 : FLT_MAX;
+    }
+
+    //squared distance from a point to a box, 0 inside it
+    static float boxDistance2( const Node& n, const vec3& p ) {
+        float d2 = 0;
+        for(int a = 0; a < 3; a++) {
+            float v = p[a] < n.lo[a] ? n.lo[a] - p[a] : p[a] > n.hi[a] ? p[a] - n.hi[a] : 0.0f;
+            d2 += v * v;
+        }
+        return d2;
+    }
+
+    static float distance2( const vec4& c, const vec3& p ) {
+        vec3 d(c.x - p.x, c.y - p.y, c.z - p.z);
+        return dot(d, d);
+    }
+
+    public:
+    //sort n spheres into a fresh tree
+    void build( const vec4* centers, const float* radii, int n ) {
+        nodes.clear();
+        this->radii.assign(radii, radii + n);
+        order.resize(n);
+        for(int i = 0; i < n; i++) order[i] = i;
+        if(n > 0) {
+            nodes.reserve(2 * n - 1);
+            buildNode(centers, 0, n);
+        }
+    }
+
+    //forget everything, the next build starts over
+    void clear() {
+        nodes.clear();
+        radii.clear();
+    }
+
+    //move the boxes to where the spheres are now and how big they are now
+    //the tree shape stays the same
+    void refit( const vec4* centers, const float* radii ) {
+        for(int i = nodes.size() - 1; i >= 0; i--) {
+            Node& n = nodes[i];
+            if(n.left < 0) {
+                this->radii[n.sphere] = radii[n.sphere];
+                fitLeaf(n, centers[n.sphere]);
+            } else {
+                fitInner(n);
+            }
+        }
+    }
+
+    int size() const {
+        return radii.size();
+    }
+
+    //closest sphere a ray hits, -1 for none, t is the distance along dir to the hit
+    //dir doesn't have to be normalized, t is in multiples of it
+    int raycast( const vec3& origin, const vec3& dir, const vec4* centers, float& t ) const {
+        int hit = -1;
+        t = FLT_MAX;
+        if(nodes.empty()) return hit;
+        vec3 inv(1.0 / dir.x, 1.0 / dir.y, 1.0 / dir.z);
+        float dd = dot(dir, dir);
+        std::vector<int> stack;
+        stack.push_back(0);
+        while(!stack.empty()) {
+            const Node& n = nodes[stack.back()];
+            stack.pop_back();
+            if(rayBox(n, origin, inv, t) == FLT_MAX) continue;
+            if(n.left < 0) {
+                //exact ray against sphere
+                const vec4& c = centers[n.sphere];
+                vec3 oc(origin.x - c.x, origin.y - c.y, origin.z - c.z);
+                float b = dot(oc, dir);
+                float disc = b * b - dd * (dot(oc, oc) - radii[n.sphere] * radii[n.sphere]);
+                if(disc < 0) continue;
+                float s = sqrt(disc);
+                float hitT = (-b - s) / dd;
+                //from inside the sphere take the way out
+                if(hitT < 0) hitT = (-b + s) / dd;
+                if(hitT >= 0 && hitT < t) {
+                    t = hitT;
+                    hit = n.sphere;
+                }
+                continue;
+            }
+            //visit the nearer child first so the far one usually gets skipped
+            float tl = rayBox(nodes[n.left], origin, inv, t);
+            float tr = rayBox(nodes[n.right], origin, inv, t);
+            if(tl < tr) {
+                if(tr != FLT_MAX) stack.push_back(n.right);
+                stack.push_back(n.left);
+            } else {
+                if(tl != FLT_MAX) stack.push_back(n.left);
+                if(tr != FLT_MAX) stack.push_back(n.right);
+            }
+        }
+        return hit;
+    }
+
+    //every sphere touching the sphere at center with radius r
+    void within( const vec3& center, float r, const vec4* centers, std::vector<int>& out ) const {
+        out.clear();
+        if(nodes.empty()) return;
+        std::vector<int> stack;
+        stack.push_back(0);
+        while(!stack.empty()) {
+            const Node& n = nodes[stack.back()];
+            stack.pop_back();
+            if(boxDistance2(n, center) > r * r) continue;
+            if(n.left < 0) {
+                float reach = r + radii[n.sphere];
+                if(distance2(centers[n.sphere], center) <= reach * reach) {
+                    out.push_back(n.sphere);
+                }
+            } else {
+                stack.push_back(n.left);
+                stack.push_back(n.right);
+            }
+        }
+    }
+
+    //the k spheres with centers closest to a point, nearest first
+    //spheres with no radius don't count
+    //skip is left out of the results (say the body we are asking from), -1 for none
+    void nearest( const vec3& point, int k, const vec4* centers, std::vector<int>& out, int skip = -1 ) const {
+        out.clear();
+        if(nodes.empty() || k <= 0) return;
+        typedef std::pair<float, int> Entry;
+        //nodes to visit, closest box first
+        std::priority_queue<Entry, std::vector<Entry>, std::greater<Entry> > open;
+        //best k so far, farthest on top
+        std::priority_queue<Entry> best;
+        open.push(Entry(boxDistance2(nodes[0], point), 0));
+        while(!open.empty()) {
+            Entry e = open.top();
+            open.pop();
+            //nothing left can beat what we have
+            if((int) best.size() == k && e.first > best.top().first) break;
+            const Node& n = nodes[e.second];
+            if(n.left < 0) {
+                if(n.sphere == skip || radii[n.sphere] <= 0) continue;
+                float d2 = distance2(centers[n.sphere], point);
+                if((int) best.size() < k) {
+                    best.push(Entry(d2, n.sphere));
+                } else if(d2 < best.top().first) {
+                    best.pop();
+                    best.push(Entry(d2, n.sphere));
+                }
+            } else {
+                open.push(Entry(boxDistance2(nodes[n.left], point), n.left));
+                open.push(Entry(boxDistance2(nodes[n.right], point), n.right));
+            }
+        }
+        out.resize(best.size());
+        for(int i = best.size() - 1; i >= 0; i--) {
+            out[i] = best.top().second;
+            best.pop();
+        }
+    }
+};
+
+#endif
@@ -33,7 +33,7 @@ ErrorString( GLenum error )
 
 //----------------------------------------------------------------------------
 
-static void
+static inline void
 _CheckError( const char* file, int line )
 {
     GLenum  error = glGetError();
@@ -0,0 +1,166 @@
+#ifndef __COLLISIONS_H__
+#define __COLLISIONS_H__
+
+#include <vector>
+#include <utility>
+#include <algorithm>
+#include "Angel.h"
+
+//two spheres starting or stopping to touch
+struct ContactEvent {
+    //sphere indices, a < b
+    int a;
+    int b;
+    //true when they just started touching, false when they just came apart
+    bool begin;
+    //how far they overlap, 0 for end events
+    float depth;
+};
+
+// Sphere against sphere collisions with a uniform grid broad phase.
+// Cells are as wide as the biggest sphere, so anything a sphere can touch has
+// its center in the same cell or one of the 26 around it. Every sphere is
+// dropped into the cell holding its center, cells are hashed into a table and
+// the spheres counting sorted by bucket, so building the grid is linear. Each
+// cell is then checked against itself and the 13 neighbours that come after
+// it, which sees every pair of neighbouring cells once. Pairs that pass a
+// quick axis check get the exact distance test (the narrow phase).
+// Pairs touching now are compared with the ones touching last time to make
+// begin and end events.
+class CollisionGrid {
+    struct Entry {
+        int cx, cy, cz;
+        int sphere;
+    };
+    //the spheres sorted by bucket, and where each bucket starts
+    std::vector<Entry> entries;
+    std::vector<int> start;
+    //entries in the order they were made, before sorting
+    std::vector<Entry> unsorted;
+    std::vector<int> bucketOf;
+    //pairs touching now and last update, sorted
+    std::vector< std::pair<int,int> > pairs;
+    std::vector< std::pair<int,int> > previous;
+    //exact tests run in the last update
+    int narrowTests;
+
+    static unsigned int hashCell( int x, int y, int z ) {
+        return ((unsigned int) x * 73856093u) ^ ((unsigned int) y * 19349663u) ^ ((unsigned int) z * 83492791u);
+    }
+
+    void test( int a, int b, const vec4* centers, const float* radii ) {
+        const vec4& ca = centers[a];
+        const vec4& cb = centers[b];
+        float reach = radii[a] + radii[b];
+        if(fabs(ca.x - cb.x) > reach || fabs(ca.y - cb.y) > reach || fabs(ca.z - cb.z) > reach) return;
+        narrowTests++;
+        vec3 d(ca.x - cb.x, ca.y - cb.y, ca.z - cb.z);
+        if(dot(d, d) <= reach * reach) {
+            pairs.push_back(a < b ? std::make_pair(a, b) : std::make_pair(b, a));
+        }
+    }
+
+    public:
+    CollisionGrid() : narrowTests(0) {}
+
+    //find every touching pair, spheres with radius <= 0 take no part
+    //appends the begin/end events since the last update to events
+    void update( const vec4* centers, const float* radii, int n, std::vector<ContactEvent>& events ) {
+        pairs.clear();
+        narrowTests = 0;
+        float maxRadius = 0;
+        for(int i = 0; i < n; i++) {
+            if(radii[i] > maxRadius) maxRadius = radii[i];
+        }
+        unsorted.clear();
+        if(maxRadius > 0) {
+            float inv = 1.0 / (2.0 * maxRadius);
+            for(int i = 0; i < n; i++) {
+                if(radii[i] <= 0) continue;
+                Entry e = { (int) floor(centers[i].x * inv), (int) floor(centers[i].y * inv),
+                    (int) floor(centers[i].z * inv), i };
+                unsorted.push_back(e);
+            }
+        }
+        int m = unsorted.size();
+        //twice as many buckets as spheres keeps them short
+        int buckets = 1;
+        while(buckets < 2 * m) buckets *= 2;
+        unsigned int mask = buckets - 1;
+        //counting sort by bucket
+        start.assign(buckets + 1, 0);
+        bucketOf.resize(m);
+        for(int i = 0; i < m; i++) {
+            bucketOf[i] = hashCell(unsorted[i].cx, unsorted[i].cy, unsorted[i].cz) & mask;
+            start[bucketOf[i] + 1]++;
+        }
+        for(int b = 0; b < buckets; b++) {
+            start[b + 1] += start[b];
+        }
+        entries.resize(m);
+        for(int i = 0; i < m; i++) {
+            entries[--start[bucketOf[i] + 1]] = unsorted[i];
+        }
+        //the decrements above left start[b + 1] pointing at the start of bucket b
+        for(int b = 0; b < buckets; b++) {
+            start[b] = start[b + 1];
+        }
+        start[buckets] = m;
+        for(int k = 0; k < m; k++) {
+            const Entry& e = entries[k];
+            for(int dz = 0; dz <= 1; dz++) {
+                for(int dy = dz ? -1 : 0; dy <= 1; dy++) {
+                    for(int dx = (dz || dy) ? -1 : 0; dx <= 1; dx++) {
+                        int nx = e.cx + dx, ny = e.cy + dy, nz = e.cz + dz;
+                        unsigned int b = hashCell(nx, ny, nz) & mask;
+                        //within our own cell only look at the spheres after us
+                        int first = (dx || dy || dz) ? start[b] : k + 1;
+                        for(int j = first; j < start[b + 1]; j++) {
+                            const Entry& f = entries[j];
+                            //buckets can hold more than one cell
+                            if(f.cx != nx || f.cy != ny || f.cz != nz) continue;
+                            test(e.sphere, f.sphere, centers, radii);
+                        }
+                    }
+                }
+            }
+        }
+        std::sort(pairs.begin(), pairs.end());
+        //walk both sorted lists to find what's new and what's gone
+        size_t p = 0, q = 0;
+        while(p < pairs.size() || q < previous.size()) {
+            if(q == previous.size() || (p < pairs.size() && pairs[p] < previous[q])) {
+                const vec4& ca = centers[pairs[p].first];
+                const vec4& cb = centers[pairs[p].second];
+                ContactEvent e = { pairs[p].first, pairs[p].second, true,
+                    radii[pairs[p].first] + radii[pairs[p].second] - length(vec3(ca.x - cb.x, ca.y - cb.y, ca.z - cb.z)) };
+                events.push_back(e);
+                p++;
+            } else if(p == pairs.size() || previous[q] < pairs[p]) {
+                ContactEvent e = { previous[q].first, previous[q].second, false, 0.0 };
+                events.push_back(e);
+                q++;
+            } else {
+                p++;
+                q++;
+            }
+        }
+        previous.swap(pairs);
+    }
+
+    //pairs touching as of the last update
+    const std::vector< std::pair<int,int> >& touching() const {
+        return previous;
+    }
+
+    int tests() const {
+        return narrowTests;
+    }
+
+    //forget everything, the next update starts over
+    void clear() {
+        previous.clear();
+    }
+};
+
+#endif
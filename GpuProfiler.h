@@ -0,0 +1,207 @@
+#ifndef __GPUPROFILER_H__
+#define __GPUPROFILER_H__
+
+#include <stdio.h>
+#include <string.h>
+#include <sstream>
+#include <iomanip>
+#include "Angel.h"
+
+//frames of queries in flight, results are read this many frames late so we never stall
+const int GPU_PROFILER_FRAMES = 4;
+//most zones (named passes) and most begin/end pairs per frame
+const int GPU_PROFILER_ZONES = 32;
+const int GPU_PROFILER_MARKERS = 64;
+//samples kept per zone for the rolling average
+const int GPU_PROFILER_HISTORY = 64;
+
+// Scoped GPU timing with GL_TIMESTAMP queries.
+// Each begin/end pair drops two timestamps into the current frame's slot of a
+// ring of query sets. A slot is only read back once it comes around again, by
+// then the GPU is long done with it and we never wait on a result.
+// Timestamps (instead of GL_TIME_ELAPSED) let zones nest and repeat in a frame,
+// repeats of the same zone in a frame are summed.
+class GpuProfiler {
+    struct Zone {
+        const char* name;
+        //last GPU_PROFILER_HISTORY samples in ms, and how many are valid
+        double samples[GPU_PROFILER_HISTORY];
+        int count;
+        int next;
+        //samples collected ever
+        int total;
+    };
+    struct Marker {
+        int zone;
+        GLuint queries[2];
+    };
+    struct Frame {
+        Marker markers[GPU_PROFILER_MARKERS];
+        int used;
+    };
+
+    Zone zones[GPU_PROFILER_ZONES];
+    int numZones;
+    Frame frames[GPU_PROFILER_FRAMES];
+    int frame;
+    bool enabled;
+
+    int findZone( const char* name ) {
+        for(int i = 0; i < numZones; i++) {
+            if(zones[i].name == name || strcmp(zones[i].name, name) == 0) return i;
+        }
+        if(numZones == GPU_PROFILER_ZONES) return -1;
+        Zone& z = zones[numZones];
+        z.name = name;
+        z.count = 0;
+        z.next = 0;
+        z.total = 0;
+        return numZones++;
+    }
+
+    //pull the results out of a slot if the GPU has finished with all of it
+    void collect( Frame& f ) {
+        if(f.used == 0) return;
+        GLint available = 0;
+        glGetQueryObjectiv(f.markers[f.used - 1].queries[1], GL_QUERY_RESULT_AVAILABLE, &available);
+        if(available) {
+            double totals[GPU_PROFILER_ZONES] = { 0 };
+            bool seen[GPU_PROFILER_ZONES] = { false };
+            for(int i = 0; i < f.used; i++) {
+                GLuint64 begin, end;
+                glGetQueryObjectui64v(f.markers[i].queries[0], GL_QUERY_RESULT, &begin);
+                glGetQueryObjectui64v(f.markers[i].queries[1], GL_QUERY_RESULT, &end);
+                totals[f.markers[i].zone] += (end - begin) / 1000000.0;
+                seen[f.markers[i].zone] = true;
+            }
+            for(int z = 0; z < numZones; z++) {
+                if(!seen[z]) continue;
+                zones[z].samples[zones[z].next] = totals[z];
+                zones[z].next = (zones[z].next + 1) % GPU_PROFILER_HISTORY;
+                if(zones[z].count < GPU_PROFILER_HISTORY) zones[z].count++;
+                zones[z].total++;
+            }
+        }
+        //not ready yet means the GPU is more than GPU_PROFILER_FRAMES behind, drop it
+        f.used = 0;
+    }
+
+    public:
+    GpuProfiler() : numZones(0), frame(0), enabled(false) {
+        for(int i = 0; i < GPU_PROFILER_FRAMES; i++) frames[i].used = 0;
+    }
+
+    //create the queries, needs a GL context
+    void init() {
+        for(int i = 0; i < GPU_PROFILER_FRAMES; i++) {
+            for(int m = 0; m < GPU_PROFILER_MARKERS; m++) {
+                glGenQueries(2, frames[i].markers[m].queries);
+            }
+        }
+        enabled = true;
+    }
+
+    //move on to the next slot of the ring, reading back what it held last time
+    void beginFrame() {
+        if(!enabled) return;
+        frame = (frame + 1) % GPU_PROFILER_FRAMES;
+        collect(frames[frame]);
+    }
+
+    //start timing a zone, hand the result to end()
+    int begin( const char* name ) {
+        if(!enabled) return -1;
+        Frame& f = frames[frame];
+        int zone = findZone(name);
+        if(zone < 0 || f.used == GPU_PROFILER_MARKERS) return -1;
+        Marker& m = f.markers[f.used];
+        m.zone = zone;
+        glQueryCounter(m.queries[0], GL_TIMESTAMP);
+        return f.used++;
+    }
+
+    void end( int marker ) {
+        if(marker < 0) return;
+        glQueryCounter(frames[frame].markers[marker].queries[1], GL_TIMESTAMP);
+    }
+
+    //rolling average of a zone in ms
+    double average( int zone ) const {
+        const Zone& z = zones[zone];
+        if(z.count == 0) return 0.0;
+        double sum = 0;
+        for(int i = 0; i < z.count; i++) sum += z.samples[i];
+        return sum / z.count;
+    }
+
+    //rolling average of a zone by name, 0 if it was never timed
+    double average( const char* name ) const {
+        for(int i = 0; i < numZones; i++) {
+            if(strcmp(zones[i].name, name) == 0) return average(i);
+        }
+        return 0.0;
+    }
+
+    //newest sample of a zone in ms, returns how many samples it has had so far
+    //so callers can tell when a new one came in
+    int latest( const char* name, double& ms ) const {
+        for(int i = 0; i < numZones; i++) {
+            if(strcmp(zones[i].name, name) == 0 && zones[i].total > 0) {
+                ms = zones[i].samples[(zones[i].next + GPU_PROFILER_HISTORY - 1) % GPU_PROFILER_HISTORY];
+                return zones[i].total;
+            }
+        }
+        return 0;
+    }
+
+    //one line per zone, for the HUD
+    std::string report() const {
+        std::ostringstream text;
+        text << std::fixed << std::setprecision(3);
+        for(int i = 0; i < numZones; i++) {
+            text << "\n    " << zones[i].name << ": " << average(i) << " ms";
+        }
+        return text.str();
+    }
+
+    //write the averages and every sample we still have to a file
+    bool dump( const char* filename ) const {
+        FILE* fp = fopen(filename, "w");
+        if(fp == NULL) return false;
+        fprintf(fp, "# zone average_ms min_ms max_ms samples...\n");
+        for(int i = 0; i < numZones; i++) {
+            const Zone& z = zones[i];
+            double lo = 0, hi = 0;
+            for(int s = 0; s < z.count; s++) {
+                if(s == 0 || z.samples[s] < lo) lo = z.samples[s];
+                if(s == 0 || z.samples[s] > hi) hi = z.samples[s];
+            }
+            fprintf(fp, "%s %.4f %.4f %.4f", z.name, average(i), lo, hi);
+            //oldest first
+            int first = z.count < GPU_PROFILER_HISTORY ? 0 : z.next;
+            for(int s = 0; s < z.count; s++) {
+                fprintf(fp, " %.4f", z.samples[(first + s) % GPU_PROFILER_HISTORY]);
+            }
+            fprintf(fp, "\n");
+        }
+        fclose(fp);
+        return true;
+    }
+};
+
+// Times everything until the end of the enclosing scope.
+class GpuZone {
+    GpuProfiler& profiler;
+    int marker;
+
+    public:
+    GpuZone( GpuProfiler& profiler, const char* name ) : profiler(profiler) {
+        marker = profiler.begin(name);
+    }
+
+    ~GpuZone() {
+        profiler.end(marker);
+    }
+};
+
+#endif
@@ -4,8 +4,8 @@
 namespace Angel {
 
 // Create a NULL-terminated string by reading the provided file
-static char*
-readShaderSource(const char* shaderFile)
+char*
+ReadShaderSource(const char* shaderFile)
 {
     FILE* fp = fopen(shaderFile, "r");
 
@@ -24,56 +24,82 @@ readShaderSource(const char* shaderFile)
     return buf;
 }
 
+// Set once the driver compiles and links on its own threads
+static bool parallelCompile = false;
 
-// Create a GLSL program object from vertex and fragment shader files
+// Let the driver compile and link on as many threads as it likes,
+// false if it can't (no GL_KHR_parallel_shader_compile)
+bool
+UseParallelShaderCompile()
+{
+    if ( !glewIsSupported("GL_KHR_parallel_shader_compile") ) { return false; }
+    glMaxShaderCompilerThreadsKHR( 0xFFFFFFFF );
+    parallelCompile = true;
+    return true;
+}
+
+// Start compiling and linking a GLSL program from source already read in,
+// nothing here waits on the driver
 GLuint
-InitShader(const char* vShaderFile, const char* fShaderFile)
+StartShader(const char* vertexSource, const char* fragmentSource)
 {
-    struct Shader {
-	const char*  filename;
-	GLenum       type;
-	GLchar*      source;
-    }  shaders[2] = {
-	{ vShaderFile, GL_VERTEX_SHADER, NULL },
-	{ fShaderFile, GL_FRAGMENT_SHADER, NULL }
-    };
+    const char* sources[2] = { vertexSource, fragmentSource };
+    GLenum types[2] = { GL_VERTEX_SHADER, GL_FRAGMENT_SHADER };
 
     GLuint program = glCreateProgram();
-    
-    for ( int i = 0; i < 2; ++i ) {
-	Shader& s = shaders[i];
-	s.source = readShaderSource( s.filename );
-	if ( shaders[i].source == NULL ) {
-	    std::cerr << "Failed to read " << s.filename << std::endl;
-	    exit( EXIT_FAILURE );
-	}
 
-	GLuint shader = glCreateShader( s.type );
-	glShaderSource( shader, 1, (const GLchar**) &s.source, NULL );
+    for ( int i = 0; i < 2; ++i ) {
+	GLuint shader = glCreateShader( types[i] );
+	glShaderSource( shader, 1, (const GLchar**) &sources[i], NULL );
 	glCompileShader( shader );
+	glAttachShader( program, shader );
+    }
+
+    glLinkProgram(program);
+
+    return program;
+}
 
+// Whether the driver is done with a program from StartShader, asking
+// never waits for it
+bool
+ShaderDone(GLuint program)
+{
+    if ( !parallelCompile ) { return true; }
+    GLint  done;
+    glGetProgramiv( program, GL_COMPLETION_STATUS_KHR, &done );
+    return done != 0;
+}
+
+// Wait for a program from StartShader and check it compiled and linked,
+// the file names are for the error messages
+void
+FinishShader(GLuint program, const char* vShaderFile, const char* fShaderFile)
+{
+    GLuint shaders[2];
+    GLsizei count = 0;
+    glGetAttachedShaders( program, 2, &count, shaders );
+
+    for ( int i = 0; i < count; ++i ) {
 	GLint  compiled;
-	glGetShaderiv( shader, GL_COMPILE_STATUS, &compiled );
+	glGetShaderiv( shaders[i], GL_COMPILE_STATUS, &compiled );
 	if ( !compiled ) {
-	    std::cerr << s.filename << " failed to compile:" << std::endl;
+	    GLint  type;
+	    glGetShaderiv( shaders[i], GL_SHADER_TYPE, &type );
+	    std::cerr << (type == GL_VERTEX_SHADER ? vShaderFile : fShaderFile)
+		      << " failed to compile:" << std::endl;
 	    GLint  logSize;
-	    glGetShaderiv( shader, GL_INFO_LOG_LENGTH, &logSize );
+	    glGetShaderiv( shaders[i], GL_INFO_LOG_LENGTH, &logSize );
 	    char* logMsg = new char[logSize];
-	    glGetShaderInfoLog( shader, logSize, NULL, logMsg );
+	    glGetShaderInfoLog( shaders[i], logSize, NULL, logMsg );
 	    std::cerr << logMsg << std::endl;
 	    delete [] logMsg;
 
 	    exit( EXIT_FAILURE );
 	}
-
-	delete [] s.source;
-
-	glAttachShader( program, shader );
     }
 
     /* link  and error check */
-    glLinkProgram(program);
-
     GLint  linked;
     glGetProgramiv( program, GL_LINK_STATUS, &linked );
     if ( !linked ) {
@@ -87,6 +113,28 @@ InitShader(const char* vShaderFile, const char* fShaderFile)
 
 	exit( EXIT_FAILURE );
     }
+}
+
+
+// Create a GLSL program object from vertex and fragment shader files
+GLuint
+InitShader(const char* vShaderFile, const char* fShaderFile)
+{
+    const char* files[2] = { vShaderFile, fShaderFile };
+    char* sources[2];
+
+    for ( int i = 0; i < 2; ++i ) {
+	sources[i] = ReadShaderSource( files[i] );
+	if ( sources[i] == NULL ) {
+	    std::cerr << "Failed to read " << files[i] << std::endl;
+	    exit( EXIT_FAILURE );
+	}
+    }
+
+    GLuint program = StartShader( sources[0], sources[1] );
+    delete [] sources[0];
+    delete [] sources[1];
+    FinishShader( program, vShaderFile, fShaderFile );
 
     /* use program object */
     glUseProgram(program);
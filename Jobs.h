@@ -0,0 +1,364 @@
+#ifndef __JOBS_H__
+#define __JOBS_H__
+
+#include <atomic>
+#include <deque>
+#include <vector>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include "Profiler.h"
+
+// A graph of jobs and the work stealing threads that run it.
+//
+// A job is a function, a pointer and an index (which system, which chunk).
+// after(a, b) makes a wait for b. A graph is built once and run as often as
+// needed; run() resets it, queues up every job nothing waits on, and returns
+// once all of it is done. Finishing a job queues up whatever was only waiting
+// on it.
+//
+// Every worker thread has its own deque. It pushes and pops the back of its
+// own, so it carries on with the job it just made ready while that's still in
+// cache, and when it runs dry it steals from the front of everybody else's.
+// Threads that aren't workers (the render and simulation threads) get a deque
+// each too the first time they queue something, and help out while they wait
+// for their graph, but only with that graph's jobs (and whatever is on their
+// own deque): rendering never ends up running a placement job, or the other
+// way round. When there's nothing of theirs to take they sleep until there is
+// or the graph is done.
+//
+// Pinned jobs (anything touching GL) never go near the deques. They are only
+// ever run by the thread that called run() on their graph, the one the
+// context is current on.
+//
+//   JobGraph g;
+//   int cull = g.add("cull", cullSystem, NULL, sun);
+//   int draw = g.add("draw", drawAll, NULL, 0, true);
+//   g.after(draw, cull);
+//   jobs.run(g);
+//
+// submit() and wait() split run() in two, to let a graph carry on in the
+// background across a frame. A graph can't be submitted again before it's done,
+// and is waited for on the thread that submitted it.
+
+typedef void (*JobFunction)( void* data, int index );
+
+//threads other than the workers that get a deque of their own, any more share the last one
+const int JOB_MAX_CALLERS = 8;
+
+class JobGraph;
+
+struct Job {
+    const char* name;
+    JobFunction function;
+    void* data;
+    int index;
+    bool pinned;
+    //jobs this one waits for, and how many of them are still going this run
+    int dependencies;
+    std::atomic<int> waiting;
+    //jobs waiting on this one
+    std::vector<int> next;
+    JobGraph* graph;
+};
+
+class JobGraph {
+    friend class JobSystem;
+
+    //a deque so adding never moves the jobs already there
+    std::deque<Job> jobs;
+    //jobs not done yet this run
+    std::atomic<int> remaining;
+    //pinned jobs that are ready, for the thread running the graph
+    std::mutex pinnedLock;
+    std::vector<Job*> pinned;
+    //threads asleep in wait() on this graph
+    std::atomic<int> sleepers;
+
+    public:
+    JobGraph() : remaining(0), sleepers(0) {}
+
+    //add a job, returns its id for after()
+    //name has to outlive the graph, it's what the cpu profiler shows
+    int add( const char* name, JobFunction function, void* data, int index = 0, bool pinned = false ) {
+        jobs.emplace_back();
+        Job& j = jobs.back();
+        j.name = name;
+        j.function = function;
+        j.data = data;
+        j.index = index;
+        j.pinned = pinned;
+        j.dependencies = 0;
+        j.waiting = 0;
+        j.graph = this;
+        return jobs.size() - 1;
+    }
+
+    //job doesn't start until dependency is done
+    void after( int job, int dependency ) {
+        jobs[dependency].next.push_back(job);
+        jobs[job].dependencies++;
+    }
+
+    int size() const {
+        return jobs.size();
+    }
+
+    //still running since the last submit()
+    bool busy() const {
+        return remaining.load(std::memory_order_acquire) > 0;
+    }
+
+    void clear() {
+        jobs.clear();
+    }
+};
+
+class JobSystem {
+    struct Queue {
+        std::mutex lock;
+        std::deque<Job*> jobs;
+    };
+
+    //which deque a thread has, for the start() it was handed out under
+    struct Slot {
+        const JobSystem* system;
+        unsigned generation;
+        int index;
+    };
+
+    std::vector<std::thread> threads;
+    //how many deques belong to workers, set before any of them start
+    int workers;
+    //one per worker, then JOB_MAX_CALLERS for everybody else
+    std::deque<Queue> queues;
+    std::atomic<bool> stopping;
+    //bumped by every start(), deques handed out before it are stale
+    unsigned generation;
+    //deques handed out to threads that aren't workers
+    std::atomic<int> callers;
+    //idle workers sleep on wake until something is queued
+    //threads in wait() sleep on progress until their graph has something for them or is done
+    std::mutex sleepLock;
+    std::condition_variable wake;
+    std::condition_variable progress;
+    std::atomic<int> sleeping;
+
+    static Slot& slot() {
+        thread_local Slot s = { NULL, 0, -1 };
+        return s;
+    }
+
+    static unsigned nextGeneration() {
+        static std::atomic<unsigned> count(0);
+        return ++count;
+    }
+
+    //this thread's deque, handing it one the first time
+    int mine() {
+        Slot& s = slot();
+        if(s.system != this || s.generation != generation) {
+            s.system = this;
+            s.generation = generation;
+            s.index = workers + std::min((int) callers++, JOB_MAX_CALLERS - 1);
+        }
+        return s.index;
+    }
+
+    bool worker( int index ) const {
+        return index < workers;
+    }
+
+    //queue up a job whose dependencies are all done
+    void ready( Job* j ) {
+        JobGraph* g = j->graph;
+        if(j->pinned) {
+            {
+                std::lock_guard<std::mutex> guard(g->pinnedLock);
+                g->pinned.push_back(j);
+            }
+            std::lock_guard<std::mutex> guard(sleepLock);
+            progress.notify_all();
+            return;
+        }
+        Queue& q = queues[mine()];
+        {
+            std::lock_guard<std::mutex> guard(q.lock);
+            q.jobs.push_back(j);
+        }
+        if(sleeping.load(std::memory_order_acquire) > 0 || g->sleepers.load(std::memory_order_acquire) > 0) {
+            std::lock_guard<std::mutex> guard(sleepLock);
+            wake.notify_one();
+            if(g->sleepers.load(std::memory_order_relaxed) > 0) progress.notify_all();
+        }
+    }
+
+    //the newest job on our own deque, or the oldest one on anybody else's
+    //a thread waiting for only's jobs leaves the other callers' deques alone, and everything on the workers' that isn't only's
+    Job* take( JobGraph* only = NULL ) {
+        int me = mine();
+        {
+            Queue& q = queues[me];
+            std::lock_guard<std::mutex> guard(q.lock);
+            if(!q.jobs.empty()) {
+                Job* j = q.jobs.back();
+                q.jobs.pop_back();
+                return j;
+            }
+        }
+        for(size_t i = 1; i < queues.size(); i++) {
+            int other = (me + i) % queues.size();
+            if(only != NULL && !worker(other)) continue;
+            Queue& q = queues[other];
+            std::lock_guard<std::mutex> guard(q.lock);
+            for(std::deque<Job*>::iterator k = q.jobs.begin(); k != q.jobs.end(); ++k) {
+                if(only == NULL || (*k)->graph == only) {
+                    Job* j = *k;
+                    q.jobs.erase(k);
+                    return j;
+                }
+            }
+        }
+        return NULL;
+    }
+
+    //a pinned job of the graph or anything else take() gives a thread waiting for it
+    Job* next( JobGraph& g ) {
+        {
+            std::lock_guard<std::mutex> guard(g.pinnedLock);
+            if(!g.pinned.empty()) {
+                Job* j = g.pinned.back();
+                g.pinned.pop_back();
+                return j;
+            }
+        }
+        return take(&g);
+    }
+
+    void execute( Job* j ) {
+        {
+#ifndef NO_PROFILER
+            Profiler::Zone zone(j->name);
+#endif
+            j->function(j->data, j->index);
+        }
+        JobGraph* g = j->graph;
+        for(size_t i = 0; i < j->next.size(); i++) {
+            Job* n = &g->jobs[j->next[i]];
+            if(n->waiting.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+                ready(n);
+            }
+        }
+        //the graph's done, whoever is waiting for it can go
+        if(g->remaining.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+            std::lock_guard<std::mutex> guard(sleepLock);
+            progress.notify_all();
+        }
+    }
+
+    void work( int index ) {
+        Slot& s = slot();
+        s.system = this;
+        s.generation = generation;
+        s.index = index;
+        while(!stopping.load(std::memory_order_acquire)) {
+            Job* j = take();
+            if(j == NULL) {
+                std::unique_lock<std::mutex> guard(sleepLock);
+                sleeping++;
+                //look again now we count as sleeping: a job queued after that look is pushed after it
+                //under the same queue lock, so ready() sees us and wakes us, and it can't do that
+                //before we wait since notifying takes sleepLock
+                j = take();
+                if(j == NULL && !stopping.load(std::memory_order_acquire)) {
+                    wake.wait(guard);
+                }
+                sleeping--;
+            }
+            if(j != NULL) {
+                execute(j);
+            }
+        }
+    }
+
+    public:
+    JobSystem() : workers(0), stopping(false), generation(nextGeneration()), callers(0), sleeping(0) {
+        queues.resize(JOB_MAX_CALLERS);
+    }
+
+    ~JobSystem() {
+        stop();
+    }
+
+    //start count worker threads, 0 runs everything on whoever calls run()
+    void start( int count ) {
+        stop();
+        stopping = false;
+        generation = nextGeneration();
+        callers = 0;
+        queues.clear();
+        workers = count;
+        queues.resize(count + JOB_MAX_CALLERS);
+        for(int i = 0; i < count; i++) {
+            threads.push_back(std::thread(&JobSystem::work, this, i));
+        }
+    }
+
+    //finish the jobs in progress and stop the workers, anything still queued stays there
+    void stop() {
+        stopping = true;
+        {
+            std::lock_guard<std::mutex> guard(sleepLock);
+            wake.notify_all();
+        }
+        for(size_t i = 0; i < threads.size(); i++) {
+            threads[i].join();
+        }
+        threads.clear();
+    }
+
+    int size() const {
+        return threads.size();
+    }
+
+    //start the graph without waiting for it
+    void submit( JobGraph& g ) {
+        g.remaining.store(g.jobs.size(), std::memory_order_relaxed);
+        for(size_t i = 0; i < g.jobs.size(); i++) {
+            g.jobs[i].waiting.store(g.jobs[i].dependencies, std::memory_order_relaxed);
+        }
+        //no fence needed, the counts reach other threads with the jobs, through the queue locks
+        for(size_t i = 0; i < g.jobs.size(); i++) {
+            if(g.jobs[i].dependencies == 0) ready(&g.jobs[i]);
+        }
+    }
+
+    //help out with the graph until it's done, its pinned jobs run here
+    void wait( JobGraph& g ) {
+        PROFILE_ZONE("JobSystem::wait");
+        while(g.busy()) {
+            Job* j = next(g);
+            if(j == NULL) {
+                std::unique_lock<std::mutex> guard(sleepLock);
+                g.sleepers++;
+                //look again now we count as sleeping, like the workers do: anything of the graph queued
+                //or pinned after this, and the graph finishing, notify under sleepLock
+                j = next(g);
+                if(j == NULL && g.busy()) {
+                    progress.wait(guard);
+                }
+                g.sleepers--;
+            }
+            if(j != NULL) {
+                execute(j);
+            }
+        }
+    }
+
+    void run( JobGraph& g ) {
+        submit(g);
+        wait(g);
+    }
+};
+
+#endif
@@ -0,0 +1,298 @@
+#ifndef __LIGHTCLUSTERS_H__
+#define __LIGHTCLUSTERS_H__
+
+#include <vector>
+#include <algorithm>
+#include "Angel.h"
+
+//dimensions of the view space cluster grid (x/y tiles on screen, z slices in depth)
+const int CLUSTER_X = 16;
+const int CLUSTER_Y = 9;
+const int CLUSTER_Z = 24;
+const int NUM_CLUSTERS = CLUSTER_X * CLUSTER_Y * CLUSTER_Z;
+//most lights binned in a frame, the nearest ones in view are kept
+const int MAX_LIGHTS = 1024;
+//width of the light index texture, it grows in rows of this many indices
+//the shaders are given it as a #define when they are read
+const int LIGHT_INDEX_WIDTH = 1024;
+//most light indices we keep across all clusters
+const int MAX_LIGHT_INDICES = LIGHT_INDEX_WIDTH * 256;
+
+struct Light {
+    //world position, w holds the range of the light
+    vec4 position;
+    //color, w holds the intensity
+    vec4 color;
+};
+
+// Bins point lights into a view space cluster grid on the CPU each frame and
+// ships the result to the GPU as three float textures:
+//   lights   (MAX_LIGHTS x 2)        row 0 = position/range, row 1 = color/intensity
+//   clusters (CLUSTER_X*CLUSTER_Y x CLUSTER_Z)  r = offset into indices, g = count
+//   indices  (LIGHT_INDEX_WIDTH x n) one light index per texel
+// The shaders find their cluster from screen position and view depth and only
+// loop over the lights listed there. Any number of lights can be registered,
+// build() drops the ones that don't reach into the view and, if more than
+// MAX_LIGHTS are left, keeps the ones nearest the camera.
+class LightClusters {
+    //lights registered this frame, after build() only the ones kept in the order they came
+    std::vector<Light> lights;
+    //view space position of each registered light while building
+    std::vector<vec4> viewPositions;
+    //distance from the camera to each kept light's reach, and which light it is
+    std::vector< std::pair<float, int> > nearest;
+    //offset/count per cluster
+    std::vector<GLfloat> grid;
+    //flattened light index lists
+    std::vector<GLfloat> indices;
+    //per cluster light lists while binning
+    std::vector< std::vector<int> > bins;
+    //view space bounding box of each cluster
+    std::vector<vec3> boxMin;
+    std::vector<vec3> boxMax;
+    //projection the boxes were built for
+    mat4 projection;
+    //half extents of the view at w = 1
+    float tanX, tanY;
+    //clip space w at the near and far planes, slices are spaced in w
+    float wNear, wFar;
+    GLuint textures[3];
+    //rows the index texture has room for
+    int indexRows;
+
+    //clip space w (not quite depth, see build) of the start of a slice
+    float sliceW( int k ) const {
+        return wNear * pow(wFar / wNear, k / (float) CLUSTER_Z);
+    }
+
+    //slice containing a clip space w
+    int wSlice( float w ) const {
+        if(w <= wNear) return 0;
+        int k = (int) (log(w / wNear) / log(wFar / wNear) * CLUSTER_Z);
+        return k < CLUSTER_Z ? k : CLUSTER_Z - 1;
+    }
+
+    //clip space w of a point at a depth (positive) in view space
+    float depthToW( float depth ) const {
+        return -projection[3][2] * depth + projection[3][3];
+    }
+
+    float wToDepth( float w ) const {
+        return (w - projection[3][3]) / -projection[3][2];
+    }
+
+    //rebuild the view space cluster boxes, only needed when the projection changes
+    void buildBoxes() {
+        const mat4& p = projection;
+        tanX = 1.0 / p[0][0];
+        tanY = 1.0 / p[1][1];
+        //solve for where clip z meets -w and w, that's where it really gets clipped
+        float zNear = -(p[3][3] + p[2][3]) / (p[2][2] + p[3][2]);
+        float zFar = (p[3][3] - p[2][3]) / (p[2][2] - p[3][2]);
+        wNear = depthToW(-zNear);
+        wFar = depthToW(-zFar);
+        for(int k = 0; k < CLUSTER_Z; k++) {
+            float wn = sliceW(k);
+            float wf = sliceW(k + 1);
+            for(int j = 0; j < CLUSTER_Y; j++) {
+                float y0 = (2.0 * j / CLUSTER_Y - 1.0) * tanY;
+                float y1 = (2.0 * (j + 1) / CLUSTER_Y - 1.0) * tanY;
+                for(int i = 0; i < CLUSTER_X; i++) {
+                    float x0 = (2.0 * i / CLUSTER_X - 1.0) * tanX;
+                    float x1 = (2.0 * (i + 1) / CLUSTER_X - 1.0) * tanX;
+                    int c = (k * CLUSTER_Y + j) * CLUSTER_X + i;
+                    //the cluster is a frustum piece, bound it by its 8 corners
+                    boxMin[c] = vec3(fmin(x0 * wn, x0 * wf), fmin(y0 * wn, y0 * wf), -wToDepth(wf));
+                    boxMax[c] = vec3(fmax(x1 * wn, x1 * wf), fmax(y1 * wn, y1 * wf), -wToDepth(wn));
+                }
+            }
+        }
+    }
+
+    static bool byLight( const std::pair<float, int>& a, const std::pair<float, int>& b ) {
+        return a.second < b.second;
+    }
+
+    //convert a view space x (or y) range of a sphere into a tile range
+    //tan is the half extent of the view at w = 1
+    static void tileRange( float c, float r, float wMin, float wMax, float tan,
+            int tiles, int& t0, int& t1 ) {
+        //dividing by w is monotonic, so the extremes are at the w extremes
+        float lo = (c - r) / ((c - r) < 0 ? wMin : wMax);
+        float hi = (c + r) / ((c + r) > 0 ? wMin : wMax);
+        t0 = (int) floor((lo / tan + 1.0) * 0.5 * tiles);
+        t1 = (int) floor((hi / tan + 1.0) * 0.5 * tiles);
+        if(t0 < 0) t0 = 0;
+        if(t1 > tiles - 1) t1 = tiles - 1;
+    }
+
+    public:
+    LightClusters() : projection(0.0), tanX(0), tanY(0), wNear(0), wFar(0), indexRows(0) {
+        textures[0] = textures[1] = textures[2] = 0;
+    }
+
+    //create the textures, needs a GL context
+    void init() {
+        grid.resize(NUM_CLUSTERS * 2);
+        bins.resize(NUM_CLUSTERS);
+        boxMin.resize(NUM_CLUSTERS);
+        boxMax.resize(NUM_CLUSTERS);
+        glGenTextures(3, textures);
+        for(int i = 0; i < 3; i++) {
+            glBindTexture(GL_TEXTURE_2D, textures[i]);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+        }
+        glBindTexture(GL_TEXTURE_2D, textures[0]);
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA32F, MAX_LIGHTS, 2, 0, GL_RGBA, GL_FLOAT, NULL);
+        glBindTexture(GL_TEXTURE_2D, textures[1]);
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_RG32F, CLUSTER_X * CLUSTER_Y, CLUSTER_Z, 0, GL_RG, GL_FLOAT, NULL);
+    }
+
+    //forget all the lights from last frame
+    void clear() {
+        lights.clear();
+    }
+
+    //register a light at a world position reaching out to range
+    void add( const vec4& position, float range, const vec4& color = vec4(1.0,1.0,1.0,1.0) ) {
+        Light l;
+        l.position = vec4(position.x, position.y, position.z, range);
+        l.color = color;
+        lights.push_back(l);
+    }
+
+    int size() const {
+        return lights.size();
+    }
+
+    //bin every light into the clusters it touches for this camera and projection
+    //the projection is taken as is (symmetric perspective), near/far and the
+    //clip space w the shaders slice by are read back out of the matrix
+    void build( const mat4& view, const mat4& projection ) {
+        bool changed = false;
+        for(int i = 0; i < 4; i++) {
+            for(int j = 0; j < 4; j++) {
+                changed = changed || projection[i][j] != this->projection[i][j];
+            }
+        }
+        for(int c = 0; c < NUM_CLUSTERS; c++) {
+            bins[c].clear();
+        }
+        //nothing to bin against until there is a perspective projection
+        if(projection[3][2] == 0.0) {
+            lights.clear();
+        } else if(changed) {
+            this->projection = projection;
+            buildBoxes();
+        }
+        //only lights reaching into the view, and no more than MAX_LIGHTS of the nearest of those
+        nearest.clear();
+        viewPositions.resize(lights.size());
+        for(int l = 0; l < (int) lights.size(); l++) {
+            float r = lights[l].position.w;
+            vec4 p = view * vec4(lights[l].position.x, lights[l].position.y, lights[l].position.z, 1.0);
+            viewPositions[l] = p;
+            float wMin = std::max(depthToW(-p.z - r), wNear);
+            float wMax = depthToW(-p.z + r);
+            if(wMax < wNear || wMin > wFar) continue;
+            int i0, i1, j0, j1;
+            tileRange(p.x, r, wMin, wMax, tanX, CLUSTER_X, i0, i1);
+            tileRange(p.y, r, wMin, wMax, tanY, CLUSTER_Y, j0, j1);
+            if(i0 > i1 || j0 > j1) continue;
+            nearest.push_back(std::make_pair(length(vec3(p.x, p.y, p.z)) - r, l));
+        }
+        if(nearest.size() > (size_t) MAX_LIGHTS) {
+            std::nth_element(nearest.begin(), nearest.begin() + MAX_LIGHTS, nearest.end());
+            nearest.resize(MAX_LIGHTS);
+        }
+        //the kept lights keep their order, so the same scene bins the same way
+        std::vector<Light> kept(nearest.size());
+        std::vector<vec4> keptPositions(nearest.size());
+        std::sort(nearest.begin(), nearest.end(), byLight);
+        for(size_t n = 0; n < nearest.size(); n++) {
+            kept[n] = lights[nearest[n].second];
+            keptPositions[n] = viewPositions[nearest[n].second];
+        }
+        lights.swap(kept);
+        viewPositions.swap(keptPositions);
+        for(int l = 0; l < (int) lights.size(); l++) {
+            float r = lights[l].position.w;
+            const vec4& p = viewPositions[l];
+            //view space looks down -z, work in clip space w
+            float wMin = std::max(depthToW(-p.z - r), wNear);
+            float wMax = depthToW(-p.z + r);
+            int k0 = wSlice(wMin);
+            int k1 = wSlice(wMax);
+            int i0, i1, j0, j1;
+            tileRange(p.x, r, wMin, wMax, tanX, CLUSTER_X, i0, i1);
+            tileRange(p.y, r, wMin, wMax, tanY, CLUSTER_Y, j0, j1);
+            for(int k = k0; k <= k1; k++) {
+                for(int j = j0; j <= j1; j++) {
+                    for(int i = i0; i <= i1; i++) {
+                        int c = (k * CLUSTER_Y + j) * CLUSTER_X + i;
+                        //exact sphere against cluster box test
+                        float d2 = 0;
+                        for(int a = 0; a < 3; a++) {
+                            float v = p[a];
+                            if(v < boxMin[c][a]) d2 += (boxMin[c][a] - v) * (boxMin[c][a] - v);
+                            else if(v > boxMax[c][a]) d2 += (v - boxMax[c][a]) * (v - boxMax[c][a]);
+                        }
+                        if(d2 <= r * r) {
+                            bins[c].push_back(l);
+                        }
+                    }
+                }
+            }
+        }
+        //flatten the bins into offset/count pairs and one index list
+        indices.clear();
+        for(int c = 0; c < NUM_CLUSTERS; c++) {
+            int offset = indices.size();
+            for(int n = 0; n < (int) bins[c].size() && (int) indices.size() < MAX_LIGHT_INDICES; n++) {
+                indices.push_back(bins[c][n]);
+            }
+            grid[c * 2] = offset;
+            grid[c * 2 + 1] = indices.size() - offset;
+        }
+    }
+
+    //push this frame's lights and clusters to the GPU
+    void upload() {
+        //lights are stored as two rows, positions then colors
+        std::vector<vec4> rows(MAX_LIGHTS * 2);
+        for(int l = 0; l < (int) lights.size(); l++) {
+            rows[l] = lights[l].position;
+            rows[MAX_LIGHTS + l] = lights[l].color;
+        }
+        glBindTexture(GL_TEXTURE_2D, textures[0]);
+        glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, MAX_LIGHTS, 2, GL_RGBA, GL_FLOAT, &rows[0]);
+        glBindTexture(GL_TEXTURE_2D, textures[1]);
+        glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, CLUSTER_X * CLUSTER_Y, CLUSTER_Z, GL_RG, GL_FLOAT, &grid[0]);
+        //pad the index list out to whole rows, the texture only gets reallocated when it needs more of them
+        int rowCount = indices.size() / LIGHT_INDEX_WIDTH + 1;
+        indices.resize(rowCount * LIGHT_INDEX_WIDTH, 0);
+        glBindTexture(GL_TEXTURE_2D, textures[2]);
+        if(rowCount > indexRows) {
+            indexRows = rowCount;
+            glTexImage2D(GL_TEXTURE_2D, 0, GL_R32F, LIGHT_INDEX_WIDTH, rowCount, 0, GL_RED, GL_FLOAT, &indices[0]);
+        } else {
+            glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, LIGHT_INDEX_WIDTH, rowCount, GL_RED, GL_FLOAT, &indices[0]);
+        }
+    }
+
+    //bind the three textures starting at a texture unit
+    void bind( GLuint program, int unit ) {
+        const char* names[3] = { "lightTex", "clusterTex", "indexTex" };
+        for(int i = 0; i < 3; i++) {
+            glActiveTexture(GL_TEXTURE0 + unit + i);
+            glBindTexture(GL_TEXTURE_2D, textures[i]);
+            glUniform1i(glGetUniformLocation(program, names[i]), unit + i);
+        }
+        glActiveTexture(GL_TEXTURE0);
+        glUniform3i(glGetUniformLocation(program, "clusterSize"), CLUSTER_X, CLUSTER_Y, CLUSTER_Z);
+        glUniform2f(glGetUniformLocation(program, "clusterDepth"), wNear, log(wFar / wNear));
+    }
+};
+
+#endif
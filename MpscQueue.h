@@ -0,0 +1,74 @@
+#ifndef __MPSC_QUEUE_H__
+#define __MPSC_QUEUE_H__
+
+#include <atomic>
+
+// A fixed size queue any number of threads can push onto and one thread pops
+// from, without locks. Every cell carries a sequence number saying whose turn
+// it is: a producer claims a cell by bumping tail with a compare and swap,
+// copies its value in and then bumps the cell's sequence to hand it to the
+// consumer, which bumps it again by N once it has taken the value to give it
+// back to the producers a lap later. A producer never waits on another one
+// that's halfway through its push, only the consumer can see that, and it
+// just stops there until next time.
+//
+// N has to be a power of two. push() fails when the queue is full, nothing
+// is ever allocated.
+template<class T, unsigned int N>
+class MpscQueue {
+    static_assert(N >= 2 && (N & (N - 1)) == 0, "MpscQueue size has to be a power of two");
+
+    struct Cell {
+        //pos while free for the push at pos, pos + 1 once it holds that push's value
+        std::atomic<unsigned int> sequence;
+        T value;
+    };
+
+    Cell cells[N];
+    //the next push claims this, shared by the producers
+    std::atomic<unsigned int> tail;
+    //the next pop reads this, only the consumer touches it
+    unsigned int head;
+
+    public:
+    MpscQueue() : tail(0), head(0) {
+        for(unsigned int i = 0; i < N; i++) {
+            cells[i].sequence.store(i, std::memory_order_relaxed);
+        }
+    }
+
+    //add v to the back, false if the queue is full
+    bool push( const T& v ) {
+        unsigned int pos = tail.load(std::memory_order_relaxed);
+        Cell* c;
+        for(;;) {
+            c = &cells[pos & (N - 1)];
+            int diff = (int) (c->sequence.load(std::memory_order_acquire) - pos);
+            if(diff == 0) {
+                //free, try to claim it, pos is reloaded if someone beat us to it
+                if(tail.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) break;
+            } else if(diff < 0) {
+                //still holds a value from a lap ago
+                return false;
+            } else {
+                pos = tail.load(std::memory_order_relaxed);
+            }
+        }
+        c->value = v;
+        c->sequence.store(pos + 1, std::memory_order_release);
+        return true;
+    }
+
+    //take the value at the front, false if there is none (yet)
+    //consumer thread only
+    bool pop( T& v ) {
+        Cell& c = cells[head & (N - 1)];
+        if(c.sequence.load(std::memory_order_acquire) != head + 1) return false;
+        v = c.value;
+        c.sequence.store(head + N, std::memory_order_release);
+        head++;
+        return true;
+    }
+};
+
+#endif
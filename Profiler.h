@@ -0,0 +1,182 @@
+#ifndef __PROFILER_H__
+#define __PROFILER_H__
+
+#include <stdio.h>
+#include <vector>
+#include <mutex>
+#include <atomic>
+#include <chrono>
+#ifdef PROFILER_RDTSC
+#include <x86intrin.h>
+#endif
+
+// Scoped CPU zones, exported as Chrome trace events (chrome://tracing, Perfetto).
+//
+//   PROFILE_ZONE("name");   times the rest of the enclosing scope
+//
+// Every thread appends to its own buffer under that buffer's own lock, which
+// only start() and write() ever take besides it, so zones don't contend with
+// each other. While no capture is running a zone costs one load and a branch. Build with
+// -DNO_PROFILER to compile them out, or -DPROFILER_RDTSC to read the TSC
+// instead of steady_clock.
+
+namespace Profiler {
+
+struct Event {
+    //name has to outlive the capture, string literals are fine
+    const char* name;
+    long long begin;
+    long long end;
+};
+
+struct ThreadBuffer {
+    int tid;
+    //held by the owning thread to append, and by start() and write() to clear or read events
+    std::mutex lock;
+    std::vector<Event> events;
+};
+
+//everything shared between threads, only touched when a buffer is created or exported
+struct State {
+    //zones only record while this is set, read by every thread
+    std::atomic<bool> enabled;
+    //frames left in the current capture, -1 = until stop()
+    int framesLeft;
+    const char* filename;
+    std::mutex lock;
+    std::vector<ThreadBuffer*> buffers;
+    //clock ticks per microsecond (1000 for steady_clock)
+    double ticksPerUs;
+    long long origin;
+};
+
+inline long long now() {
+#ifdef PROFILER_RDTSC
+    return __rdtsc();
+#else
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now().time_since_epoch()).count();
+#endif
+}
+
+inline State& state() {
+    static State s = { false, -1, "cpu_trace.json", {}, {}, 1000.0, 0 };
+    return s;
+}
+
+//this thread's buffer, registered the first time the thread records something
+inline ThreadBuffer& buffer() {
+    thread_local ThreadBuffer* b = NULL;
+    if(b == NULL) {
+        State& s = state();
+        std::lock_guard<std::mutex> guard(s.lock);
+        b = new ThreadBuffer();
+        b->tid = s.buffers.size() + 1;
+        s.buffers.push_back(b);
+    }
+    return *b;
+}
+
+inline bool enabled() {
+    return state().enabled.load(std::memory_order_relaxed);
+}
+
+#ifdef PROFILER_RDTSC
+//measure the TSC against steady_clock for a few ms so the export can be in us
+inline double calibrate() {
+    std::chrono::steady_clock::time_point t0 = std::chrono::steady_clock::now();
+    long long c0 = __rdtsc();
+    while(std::chrono::steady_clock::now() - t0 < std::chrono::milliseconds(5)) {}
+    long long c1 = __rdtsc();
+    double us = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - t0).count();
+    return (c1 - c0) / us;
+}
+#endif
+
+//start recording, frames < 0 records until stop()
+inline void start( int frames = -1, const char* filename = "cpu_trace.json" ) {
+    State& s = state();
+    std::lock_guard<std::mutex> guard(s.lock);
+    for(size_t i = 0; i < s.buffers.size(); i++) {
+        std::lock_guard<std::mutex> bufferGuard(s.buffers[i]->lock);
+        s.buffers[i]->events.clear();
+    }
+#ifdef PROFILER_RDTSC
+    s.ticksPerUs = calibrate();
+#endif
+    s.origin = now();
+    s.framesLeft = frames;
+    s.filename = filename;
+    s.enabled = true;
+}
+
+//write everything recorded so far as trace event json
+inline bool write( const char* filename ) {
+    State& s = state();
+    std::lock_guard<std::mutex> guard(s.lock);
+    FILE* fp = fopen(filename, "w");
+    if(fp == NULL) return false;
+    fprintf(fp, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+    bool first = true;
+    for(size_t i = 0; i < s.buffers.size(); i++) {
+        ThreadBuffer* b = s.buffers[i];
+        std::lock_guard<std::mutex> bufferGuard(b->lock);
+        for(size_t e = 0; e < b->events.size(); e++) {
+            const Event& ev = b->events[e];
+            fprintf(fp, "%s{\"name\":\"%s\",\"ph\":\"X\",\"pid\":1,\"tid\":%d,\"ts\":%.3f,\"dur\":%.3f}",
+                    first ? "" : ",\n", ev.name, b->tid,
+                    (ev.begin - s.origin) / s.ticksPerUs, (ev.end - ev.begin) / s.ticksPerUs);
+            first = false;
+        }
+    }
+    fprintf(fp, "\n]}\n");
+    fclose(fp);
+    return true;
+}
+
+//stop recording and write out the capture
+inline bool stop() {
+    State& s = state();
+    if(!s.enabled.exchange(false)) return false;
+    return write(s.filename);
+}
+
+//call once per frame, ends a capture after its frame count runs out
+//returns true on the frame the capture got written
+inline bool frame() {
+    State& s = state();
+    if(!s.enabled || s.framesLeft < 0) return false;
+    if(--s.framesLeft > 0) return false;
+    return stop();
+}
+
+class Zone {
+    const char* name;
+    long long begin;
+
+    public:
+    Zone( const char* name ) : name(name), begin(0) {
+        if(enabled()) begin = now();
+    }
+
+    ~Zone() {
+        if(begin != 0 && enabled()) {
+            Event e = { name, begin, now() };
+            ThreadBuffer& b = buffer();
+            std::lock_guard<std::mutex> guard(b.lock);
+            b.events.push_back(e);
+        }
+    }
+};
+
+}  // namespace Profiler
+
+#ifdef NO_PROFILER
+#define PROFILE_ZONE(name)
+#else
+#define PROFILE_CONCAT2(a, b) a##b
+#define PROFILE_CONCAT(a, b) PROFILE_CONCAT2(a, b)
+#define PROFILE_ZONE(name) Profiler::Zone PROFILE_CONCAT(profileZone, __LINE__)(name)
+#endif
+
+#endif
@@ -144,4 +144,12 @@ class Quaternion {
         *angle = acos(w) * 2.0f;
     }
 };
+
+//generate a rotation mat4 matrix around a given vec3 axis and degree in radians
+inline mat4 rotateAroundAxis(vec3 axis, const float theta) {
+    Quaternion q;
+    GLfloat angle = DegreesToRadians * theta;
+    q.FromAxis(axis, angle);
+    return q.getMatrix();
+}
 #endif
@@ -0,0 +1,552 @@
+#ifndef __SCENE_H__
+#define __SCENE_H__
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <assert.h>
+#include <vector>
+#include <string>
+#include <unordered_map>
+#ifndef _WIN32
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+#include "Angel.h"
+
+// Scene descriptions, kept apart from the Satellites built from them.
+//
+// A scene is three flat tables: bodies, materials and a pool of names. Bodies
+// point at their parent by index and a parent always comes before its
+// children, so the tree can be built in one pass from the front.
+//
+// Text form (.scene), one material or body per line, # starts a comment:
+//
+//   material icy color=0.8,0.8,1,1 shading=flat ambient=0.5 diffuse=0.5 specular=0.8 shininess=6
+//   body Sun material=sun size=6 detail=7 center=10,10,10 tilt=180,0
+//       body "Titan junior" material=icy size=0.5 detail=3 orbit=3.5 speed=0.8 tilt=0,-80
+//
+// A body orbits the closest body above it that is indented less. Names with
+// spaces are quoted, materials have to be defined before they are used and
+// anything left out is 0 (detail is 3, color is white, shading is flat).
+//
+// Binary form (.scb) is a SceneHeader followed by the three tables exactly as
+// they sit in memory. Loading maps the file and points the tables into it, so
+// nothing is parsed or allocated per body. It is written in the byte order of
+// the machine and a machine with the other order rejects it.
+
+//the start of every binary scene
+const char SCENE_MAGIC[4] = { 'S', 'C', 'N', 'B' };
+const uint32_t SCENE_VERSION = 1;
+//tables in a binary scene start on this boundary
+const uint32_t SCENE_ALIGN = 64;
+//names of the shading types, in renderType order
+const char* const SCENE_SHADING[3] = { "flat", "gouraud", "phong" };
+
+struct SceneHeader {
+    char magic[4];
+    uint32_t version;
+    uint32_t bodyCount;
+    uint32_t materialCount;
+    uint32_t stringBytes;
+    //byte offsets of the tables from the start of the file
+    uint32_t bodyOffset;
+    uint32_t materialOffset;
+    uint32_t stringOffset;
+};
+
+struct SceneBody {
+    //tilt of the orbit in degrees, see Satellite
+    float rotHoriz;
+    float rotVert;
+    //degrees per tick and distance from the parent
+    float rotSpeed;
+    float radius;
+    //offset of the orbit from the parent
+    float center[3];
+    //radius of the body itself
+    float size;
+    //index of the parent body, -1 for none
+    int32_t parent;
+    int32_t material;
+    //sphere resolution, 0 to 7
+    int32_t complexity;
+    //offset of the name in the string pool
+    uint32_t name;
+};
+
+struct SceneMaterial {
+    float color[4];
+    //flat, gouraud or phong
+    int32_t renderType;
+    float ambient;
+    float diffuse;
+    float specular;
+    float shininess;
+    //offset of the name in the string pool
+    uint32_t name;
+};
+
+class Scene {
+    //what add() and loadText() fill in
+    std::vector<SceneBody> bodyList;
+    std::vector<SceneMaterial> materialList;
+    std::vector<char> stringPool;
+    //pool offset of each name, so repeats are stored once
+    std::unordered_map<std::string, uint32_t> nameOffsets;
+    //where the tables live, either the vectors above or a mapped file
+    const SceneBody* bodyTable;
+    const SceneMaterial* materialTable;
+    const char* strings;
+    int numBodies;
+    int numMaterials;
+    uint32_t stringBytes;
+    //the mapped file, NULL when the tables are in the vectors
+    void* mapping;
+    size_t mappingSize;
+
+    Scene( const Scene& );
+    Scene& operator=( const Scene& );
+
+    //point the tables back at the vectors after they grew
+    void useLists() {
+        bodyTable = bodyList.empty() ? NULL : &bodyList[0];
+        materialTable = materialList.empty() ? NULL : &materialList[0];
+        strings = stringPool.empty() ? NULL : &stringPool[0];
+        numBodies = bodyList.size();
+        numMaterials = materialList.size();
+        stringBytes = stringPool.size();
+    }
+
+    uint32_t addName( const char* name ) {
+        std::unordered_map<std::string, uint32_t>::iterator i = nameOffsets.find(name);
+        if(i != nameOffsets.end()) return i->second;
+        uint32_t offset = stringPool.size();
+        stringPool.insert(stringPool.end(), name, name + strlen(name) + 1);
+        nameOffsets[name] = offset;
+        return offset;
+    }
+
+    //shortest text that reads back as exactly f
+    static std::string formatFloat( float f ) {
+        char buffer[32];
+        for(int digits = 6; digits <= 9; digits++) {
+            snprintf(buffer, sizeof(buffer), "%.*g", digits, f);
+            if(strtof(buffer, NULL) == f) break;
+        }
+        return buffer;
+    }
+
+    //quote names that wouldn't survive being split on spaces
+    static std::string formatName( const char* name ) {
+        if(*name != '\0' && strpbrk(name, " \t\"#=") == NULL) return name;
+        return std::string("\"") + name + "\"";
+    }
+
+    //split a line into words, quoted words keep their spaces
+    static bool splitLine( const char* line, std::vector<std::string>& words ) {
+        words.clear();
+        const char* p = line;
+        while(true) {
+            while(*p == ' ' || *p == '\t' || *p == '\r' || *p == '\n') p++;
+            if(*p == '\0' || *p == '#') return true;
+            std::string word;
+            while(*p != '\0' && *p != ' ' && *p != '\t' && *p != '\r' && *p != '\n') {
+                if(*p == '"') {
+                    const char* close = strchr(p + 1, '"');
+                    if(close == NULL) return false;
+                    word.append(p + 1, close);
+                    p = close + 1;
+                } else {
+                    word += *p++;
+                }
+            }
+            words.push_back(word);
+        }
+    }
+
+    //read up to n comma separated floats, false if it isn't exactly n of them
+    static bool parseFloats( const std::string& text, float* out, int n ) {
+        const char* p = text.c_str();
+        for(int i = 0; i < n; i++) {
+            char* end;
+            out[i] = strtof(p, &end);
+            if(end == p) return false;
+            p = end;
+            if(i + 1 < n) {
+                if(*p != ',') return false;
+                p++;
+            }
+        }
+        return *p == '\0';
+    }
+
+    public:
+    Scene() : mapping(NULL), mappingSize(0) {
+        useLists();
+    }
+
+    ~Scene() {
+        clear();
+    }
+
+    //empty the scene and let go of any mapped file
+    void clear() {
+#ifndef _WIN32
+        if(mapping != NULL) {
+            munmap(mapping, mappingSize);
+        }
+#endif
+        mapping = NULL;
+        mappingSize = 0;
+        bodyList.clear();
+        materialList.clear();
+        stringPool.clear();
+        nameOffsets.clear();
+        useLists();
+    }
+
+    //add a material, bodies share it by index
+    int addMaterial( const char* name, const vec4& color, int renderType,
+            float ambient, float diffuse, float specular, float shininess ) {
+        assert(mapping == NULL);
+        SceneMaterial m;
+        memset(&m, 0, sizeof(m));
+        for(int i = 0; i < 4; i++) m.color[i] = color[i];
+        m.renderType = renderType;
+        m.ambient = ambient;
+        m.diffuse = diffuse;
+        m.specular = specular;
+        m.shininess = shininess;
+        m.name = addName(name);
+        materialList.push_back(m);
+        useLists();
+        return materialList.size() - 1;
+    }
+
+    //add a body, parent has to be added already (or -1)
+    int addBody( int parent, const char* name, float rotHoriz, float rotVert, float rotSpeed, float radius,
+            const vec4& center, int complexity, float size, int material ) {
+        assert(mapping == NULL && parent < (int) bodyList.size());
+        SceneBody b;
+        b.rotHoriz = rotHoriz;
+        b.rotVert = rotVert;
+        b.rotSpeed = rotSpeed;
+        b.radius = radius;
+        b.center[0] = center.x;
+        b.center[1] = center.y;
+        b.center[2] = center.z;
+        b.size = size;
+        b.parent = parent;
+        b.material = material;
+        b.complexity = complexity;
+        b.name = addName(name);
+        bodyList.push_back(b);
+        useLists();
+        return bodyList.size() - 1;
+    }
+
+    //a body with its own material, in the same order Satellite takes them
+    int add( int parent, float rotHoriz, float rotVert, float rotSpeed, float radius,
+            const vec4& center, int complexity, float size, const vec4& color, int renderType,
+            float ambient, float diffuse, float specular, float shininess, const char* name,
+            const char* material = "" ) {
+        int m = addMaterial(material, color, renderType, ambient, diffuse, specular, shininess);
+        return addBody(parent, name, rotHoriz, rotVert, rotSpeed, radius, center, complexity, size, m);
+    }
+
+    int bodyCount() const {
+        return numBodies;
+    }
+
+    int materialCount() const {
+        return numMaterials;
+    }
+
+    const SceneBody& body( int i ) const {
+        return bodyTable[i];
+    }
+
+    const SceneMaterial& material( int i ) const {
+        return materialTable[i];
+    }
+
+    const char* name( uint32_t offset ) const {
+        return strings + offset;
+    }
+
+    //every index in range and every parent ahead of its children
+    //run before building from a file, a mapped file is only checked here
+    bool check( std::string& error ) const {
+        if(stringBytes > 0 && strings[stringBytes - 1] != '\0') {
+            error = "string pool isn't terminated";
+            return false;
+        }
+        for(int i = 0; i < numMaterials; i++) {
+            const SceneMaterial& m = materialTable[i];
+            if(m.name >= stringBytes || m.renderType < 0 || m.renderType > 2) {
+                error = "bad material " + std::to_string(i);
+                return false;
+            }
+        }
+        for(int i = 0; i < numBodies; i++) {
+            const SceneBody& b = bodyTable[i];
+            if(b.parent < -1 || b.parent >= i || b.material < 0 || b.material >= numMaterials
+                    || b.complexity < 0 || b.complexity > 7 || b.name >= stringBytes) {
+                error = "bad body " + std::to_string(i);
+                return false;
+            }
+        }
+        return true;
+    }
+
+    //read the text form, errors are reported as file:line: message
+    bool loadText( const char* filename, std::string& error ) {
+        clear();
+        FILE* fp = fopen(filename, "r");
+        if(fp == NULL) {
+            error = std::string("can't open ") + filename;
+            return false;
+        }
+        //the bodies still open for children, with their indentation
+        std::vector< std::pair<int, int> > open;
+        std::unordered_map<std::string, int> materialNames;
+        std::vector<std::string> words;
+        std::string line;
+        char chunk[1024];
+        int lineNumber = 0;
+        bool ok = true;
+        while(ok && fgets(chunk, sizeof(chunk), fp)) {
+            line += chunk;
+            if(line[line.size() - 1] != '\n' && !feof(fp)) continue;
+            lineNumber++;
+            std::string bad;
+            if(!splitLine(line.c_str(), words)) {
+                bad = "unterminated quote";
+            } else if(words.empty()) {
+                //blank or just a comment
+            } else if(words.size() < 2 || (words[0] != "material" && words[0] != "body")) {
+                bad = "expected material or body followed by a name";
+            } else if(words[0] == "material") {
+                vec4 color(1.0, 1.0, 1.0, 1.0);
+                int renderType = 0;
+                float values[4] = { 0.0, 0.0, 0.0, 0.0 };
+                const char* keys[4] = { "ambient", "diffuse", "specular", "shininess" };
+                for(size_t w = 2; w < words.size() && bad.empty(); w++) {
+                    size_t eq = words[w].find('=');
+                    std::string key = words[w].substr(0, eq);
+                    std::string value = eq == std::string::npos ? "" : words[w].substr(eq + 1);
+                    bool known = false;
+                    if(key == "color") {
+                        float c[4];
+                        known = parseFloats(value, c, 4);
+                        color = vec4(c[0], c[1], c[2], c[3]);
+                    } else if(key == "shading") {
+                        for(int s = 0; s < 3; s++) {
+                            if(value == SCENE_SHADING[s]) {
+                                renderType = s;
+                                known = true;
+                            }
+                        }
+                    } else {
+                        for(int k = 0; k < 4; k++) {
+                            if(key == keys[k]) known = parseFloats(value, &values[k], 1);
+                        }
+                    }
+                    if(!known) bad = "bad setting " + words[w];
+                }
+                if(bad.empty()) {
+                    materialNames[words[1]] = addMaterial(words[1].c_str(), color, renderType,
+                            values[0], values[1], values[2], values[3]);
+                }
+            } else {
+                int indent = line.find_first_not_of(" \t");
+                while(!open.empty() && open.back().first >= indent) open.pop_back();
+                int parent = open.empty() ? -1 : open.back().second;
+                float tilt[2] = { 0.0, 0.0 };
+                float center[3] = { 0.0, 0.0, 0.0 };
+                float orbit = 0, speed = 0, size = 0, detail = 3;
+                int material = -1;
+                for(size_t w = 2; w < words.size() && bad.empty(); w++) {
+                    size_t eq = words[w].find('=');
+                    std::string key = words[w].substr(0, eq);
+                    std::string value = eq == std::string::npos ? "" : words[w].substr(eq + 1);
+                    bool known = false;
+                    if(key == "tilt") known = parseFloats(value, tilt, 2);
+                    else if(key == "center") known = parseFloats(value, center, 3);
+                    else if(key == "orbit") known = parseFloats(value, &orbit, 1);
+                    else if(key == "speed") known = parseFloats(value, &speed, 1);
+                    else if(key == "size") known = parseFloats(value, &size, 1);
+                    else if(key == "detail") known = parseFloats(value, &detail, 1) && detail >= 0 && detail <= 7;
+                    else if(key == "material") {
+                        std::unordered_map<std::string, int>::iterator m = materialNames.find(value);
+                        if(m == materialNames.end()) {
+                            bad = "unknown material " + value;
+                        } else {
+                            material = m->second;
+                            known = true;
+                        }
+                    }
+                    if(!known && bad.empty()) bad = "bad setting " + words[w];
+                }
+                if(bad.empty() && material < 0) {
+                    bad = "body " + words[1] + " has no material";
+                }
+                if(bad.empty()) {
+                    int b = addBody(parent, words[1].c_str(), tilt[0], tilt[1], speed, orbit,
+                            vec4(center[0], center[1], center[2], 1.0), (int) detail, size, material);
+                    open.push_back(std::make_pair(indent, b));
+                }
+            }
+            if(!bad.empty()) {
+                error = std::string(filename) + ":" + std::to_string(lineNumber) + ": " + bad;
+                ok = false;
+            }
+            line.clear();
+        }
+        fclose(fp);
+        return ok;
+    }
+
+    //map the binary form, the tables are used straight from the file
+    bool loadBinary( const char* filename, std::string& error ) {
+        clear();
+#ifdef _WIN32
+        error = "binary scenes need mmap";
+        return false;
+#else
+        int fd = ::open(filename, O_RDONLY);
+        if(fd < 0) {
+            error = std::string("can't open ") + filename;
+            return false;
+        }
+        struct stat st;
+        void* p = MAP_FAILED;
+        if(fstat(fd, &st) == 0 && (size_t) st.st_size >= sizeof(SceneHeader)) {
+            p = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        }
+        ::close(fd);
+        if(p == MAP_FAILED) {
+            error = std::string("can't map ") + filename;
+            return false;
+        }
+        mapping = p;
+        mappingSize = st.st_size;
+        const SceneHeader* h = (const SceneHeader*) p;
+        //64 bit sums so huge counts can't wrap around
+        uint64_t size = mappingSize;
+        if(memcmp(h->magic, SCENE_MAGIC, 4) != 0 || h->version != SCENE_VERSION
+                || h->bodyOffset % alignof(SceneBody) != 0 || h->materialOffset % alignof(SceneMaterial) != 0
+                || h->bodyOffset + (uint64_t) h->bodyCount * sizeof(SceneBody) > size
+                || h->materialOffset + (uint64_t) h->materialCount * sizeof(SceneMaterial) > size
+                || h->stringOffset + (uint64_t) h->stringBytes > size
+                || h->bodyCount > INT32_MAX || h->materialCount > INT32_MAX) {
+            clear();
+            error = std::string(filename) + " isn't a version " + std::to_string(SCENE_VERSION) + " binary scene";
+            return false;
+        }
+        const char* base = (const char*) p;
+        bodyTable = (const SceneBody*) (base + h->bodyOffset);
+        materialTable = (const SceneMaterial*) (base + h->materialOffset);
+        strings = base + h->stringOffset;
+        numBodies = h->bodyCount;
+        numMaterials = h->materialCount;
+        stringBytes = h->stringBytes;
+        return true;
+#endif
+    }
+
+    //either form, told apart by the magic at the start
+    bool load( const char* filename, std::string& error ) {
+        FILE* fp = fopen(filename, "rb");
+        if(fp == NULL) {
+            error = std::string("can't open ") + filename;
+            return false;
+        }
+        char magic[4] = { 0, 0, 0, 0 };
+        size_t got = fread(magic, 1, 4, fp);
+        fclose(fp);
+        if(got == 4 && memcmp(magic, SCENE_MAGIC, 4) == 0) {
+            return loadBinary(filename, error);
+        }
+        return loadText(filename, error);
+    }
+
+    bool saveText( const char* filename ) const {
+        FILE* fp = fopen(filename, "w");
+        if(fp == NULL) return false;
+        fprintf(fp, "# %d bodies, %d materials\n", numBodies, numMaterials);
+        //materials without a name get one from their index
+        std::vector<std::string> materialNames(numMaterials);
+        for(int i = 0; i < numMaterials; i++) {
+            const SceneMaterial& m = materialTable[i];
+            materialNames[i] = *name(m.name) != '\0' ? formatName(name(m.name)) : "m" + std::to_string(i);
+            fprintf(fp, "material %s color=%s,%s,%s,%s shading=%s ambient=%s diffuse=%s specular=%s shininess=%s\n",
+                    materialNames[i].c_str(), formatFloat(m.color[0]).c_str(), formatFloat(m.color[1]).c_str(),
+                    formatFloat(m.color[2]).c_str(), formatFloat(m.color[3]).c_str(), SCENE_SHADING[m.renderType],
+                    formatFloat(m.ambient).c_str(), formatFloat(m.diffuse).c_str(),
+                    formatFloat(m.specular).c_str(), formatFloat(m.shininess).c_str());
+        }
+        //four spaces of indentation per level of nesting
+        std::vector<int> depth(numBodies);
+        for(int i = 0; i < numBodies; i++) {
+            const SceneBody& b = bodyTable[i];
+            depth[i] = b.parent < 0 ? 0 : depth[b.parent] + 1;
+            fprintf(fp, "%*sbody %s material=%s size=%s detail=%d", depth[i] * 4, "",
+                    formatName(name(b.name)).c_str(), materialNames[b.material].c_str(),
+                    formatFloat(b.size).c_str(), b.complexity);
+            if(b.radius != 0) fprintf(fp, " orbit=%s", formatFloat(b.radius).c_str());
+            if(b.rotSpeed != 0) fprintf(fp, " speed=%s", formatFloat(b.rotSpeed).c_str());
+            if(b.rotHoriz != 0 || b.rotVert != 0) {
+                fprintf(fp, " tilt=%s,%s", formatFloat(b.rotHoriz).c_str(), formatFloat(b.rotVert).c_str());
+            }
+            if(b.center[0] != 0 || b.center[1] != 0 || b.center[2] != 0) {
+                fprintf(fp, " center=%s,%s,%s", formatFloat(b.center[0]).c_str(),
+                        formatFloat(b.center[1]).c_str(), formatFloat(b.center[2]).c_str());
+            }
+            fprintf(fp, "\n");
+        }
+        return fclose(fp) == 0;
+    }
+
+    bool saveBinary( const char* filename ) const {
+        FILE* fp = fopen(filename, "wb");
+        if(fp == NULL) return false;
+        SceneHeader h;
+        memset(&h, 0, sizeof(h));
+        memcpy(h.magic, SCENE_MAGIC, 4);
+        h.version = SCENE_VERSION;
+        h.bodyCount = numBodies;
+        h.materialCount = numMaterials;
+        h.stringBytes = stringBytes;
+        h.bodyOffset = SCENE_ALIGN;
+        h.materialOffset = h.bodyOffset + (numBodies * sizeof(SceneBody) + SCENE_ALIGN - 1) / SCENE_ALIGN * SCENE_ALIGN;
+        h.stringOffset = h.materialOffset + (numMaterials * sizeof(SceneMaterial) + SCENE_ALIGN - 1) / SCENE_ALIGN * SCENE_ALIGN;
+        char padding[SCENE_ALIGN];
+        memset(padding, 0, sizeof(padding));
+        bool ok = fwrite(&h, sizeof(h), 1, fp) == 1
+            && fwrite(padding, 1, h.bodyOffset - sizeof(h), fp) == h.bodyOffset - sizeof(h)
+            && fwrite(bodyTable, sizeof(SceneBody), numBodies, fp) == (size_t) numBodies
+            && fwrite(padding, 1, h.materialOffset - h.bodyOffset - numBodies * sizeof(SceneBody), fp)
+                == h.materialOffset - h.bodyOffset - numBodies * sizeof(SceneBody)
+            && fwrite(materialTable, sizeof(SceneMaterial), numMaterials, fp) == (size_t) numMaterials
+            && fwrite(padding, 1, h.stringOffset - h.materialOffset - numMaterials * sizeof(SceneMaterial), fp)
+                == h.stringOffset - h.materialOffset - numMaterials * sizeof(SceneMaterial)
+            && fwrite(strings, 1, stringBytes, fp) == stringBytes;
+        return fclose(fp) == 0 && ok;
+    }
+
+    //binary if the name ends in .scb, text otherwise
+    bool save( const char* filename ) const {
+        size_t n = strlen(filename);
+        if(n >= 4 && strcmp(filename + n - 4, ".scb") == 0) {
+            return saveBinary(filename);
+        }
+        return saveText(filename);
+    }
+};
+
+#endif
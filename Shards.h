@@ -0,0 +1,464 @@
+#ifndef __SHARDS_H__
+#define __SHARDS_H__
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <atomic>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <chrono>
+#include <thread>
+#ifndef _WIN32
+#include <fcntl.h>
+#include <unistd.h>
+#include <signal.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#endif
+
+//most worker processes a pool can have
+const int SHARD_MAX_WORKERS = 64;
+//a worker that takes longer than this over one step is taken to be hung and killed
+const double SHARD_TIMEOUT_MS = 2000.0;
+//a new worker builds the whole scene before it's ready, which can take this long in a big galaxy
+const double SHARD_STARTUP_TIMEOUT_MS = 60000.0;
+//steps between looking at whether the systems should be handed out differently
+const int SHARD_REBALANCE_STEPS = 120;
+//how much a new assignment has to take off the busiest worker to be worth switching to
+const float SHARD_REBALANCE_GAIN = 0.1;
+//how quickly a system's measured cost follows its newest measurement
+const float SHARD_COST_SMOOTHING = 0.1;
+
+// Places solar systems in worker processes. Each worker is a fresh copy of
+// the program, started with the command start() is given plus
+// --shard-worker index input output (the two regions' descriptors), which
+// builds the same scene from the same seed and settings and then calls
+// serve(). So each has its own copy of the scene, only the orbit angles have
+// to be handed over every step, and nothing in a worker depends on what
+// threads or GL this process had going when it forked.
+//
+// There are two shared memory regions. The input region is written by this
+// process and only read by the workers: the step to work on, which worker
+// owns which system, and every body's angle. The output region is written by
+// the workers and mapped read only here: every body's world position, the
+// measured cost of each system and the last step each worker finished.
+//
+// A step is lockstep: the angles go in, the step number is bumped, and
+// step() waits until every worker has reported it done. Workers keep nothing
+// between steps, so when one dies (or hangs and gets killed) its systems are
+// handed to the others and the step is simply asked for again. A worker only
+// counts as hung once it has said it's ready, the first step after start()
+// waits up to SHARD_STARTUP_TIMEOUT_MS for it to build its scene. Every
+// SHARD_REBALANCE_STEPS steps the systems are handed out again by measured
+// cost, biggest first to the least loaded worker, if that takes enough off the
+// busiest one.
+//
+// The workers call place(system, angles, positions) for each system they own.
+// It must only write the positions of that system's bodies.
+class ShardPool {
+    public:
+    typedef void (*PlaceFunction)( int system, const float* angles, float (*positions)[4] );
+
+    private:
+    struct Input {
+        std::atomic<uint64_t> requested;
+        std::atomic<uint32_t> stop;
+        //the scene the workers have to have built
+        uint32_t systems;
+        uint32_t bodies;
+    };
+    struct Output {
+        //the last step each worker finished
+        std::atomic<uint64_t> done[SHARD_MAX_WORKERS];
+        //set by each worker once it has built the scene and mapped the regions
+        std::atomic<uint32_t> ready[SHARD_MAX_WORKERS];
+    };
+
+    int workers;
+    int systems;
+    PlaceFunction place;
+    pid_t pids[SHARD_MAX_WORKERS];
+    bool alive[SHARD_MAX_WORKERS];
+    //which workers have said they're ready, and since when
+    bool serving[SHARD_MAX_WORKERS];
+    std::chrono::steady_clock::time_point servingSince[SHARD_MAX_WORKERS];
+    std::chrono::steady_clock::time_point launched;
+    int living;
+    uint64_t stepCount;
+    //the two regions, and what's in them
+    void* input;
+    size_t inputSize;
+    void* output;
+    size_t outputSize;
+    int32_t* owner;
+    float* angles;
+    float* cost;
+    float (*positions)[4];
+
+    Input* in() const {
+        return (Input*) input;
+    }
+
+    Output* out() const {
+        return (Output*) output;
+    }
+
+    static size_t align( size_t n ) {
+        return (n + 63) / 64 * 64;
+    }
+
+    static size_t inputBytes( int systems, int bodies ) {
+        return align(sizeof(Input)) + align(systems * sizeof(int32_t)) + align(bodies * sizeof(float));
+    }
+
+    static size_t outputBytes( int systems, int bodies ) {
+        return align(sizeof(Output)) + align(systems * sizeof(float)) + bodies * 4 * sizeof(float);
+    }
+
+    //where everything goes in the regions, the same in every process
+    void layout() {
+        owner = (int32_t*) ((char*) input + align(sizeof(Input)));
+        angles = (float*) ((char*) owner + align(systems * sizeof(int32_t)));
+        cost = (float*) ((char*) output + align(sizeof(Output)));
+        positions = (float (*)[4]) ((char*) cost + align(systems * sizeof(float)));
+    }
+
+    static void* map( int fd, size_t size, int protection ) {
+        void* p = mmap(NULL, size, protection, MAP_SHARED, fd, 0);
+        return p == MAP_FAILED ? NULL : p;
+    }
+
+    //a fresh unnamed region, only reachable through the descriptor
+    static int makeRegion( const char* name, size_t size ) {
+        shm_unlink(name);
+        int fd = shm_open(name, O_CREAT | O_EXCL | O_RDWR, 0600);
+        if(fd < 0) return -1;
+        shm_unlink(name);
+        if(ftruncate(fd, size) != 0) {
+            close(fd);
+            return -1;
+        }
+        return fd;
+    }
+
+    //what a worker process does until it's told to stop or we go away
+    void work( int index ) {
+        pid_t parent = getppid();
+        uint64_t seen = 0;
+        int idle = 0;
+        while(!in()->stop.load(std::memory_order_acquire)) {
+            uint64_t step = in()->requested.load(std::memory_order_acquire);
+            if(step == seen) {
+                if(getppid() != parent) break;
+                backOff(idle++);
+                continue;
+            }
+            idle = 0;
+            seen = step;
+            for(int s = 0; s < systems; s++) {
+                if(owner[s] != index) continue;
+                std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+                place(s, angles, positions);
+                float ms = std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - start).count();
+                cost[s] = cost[s] == 0 ? ms : cost[s] + (ms - cost[s]) * SHARD_COST_SMOOTHING;
+            }
+            out()->done[index].store(step, std::memory_order_release);
+        }
+    }
+
+    //wait a little, yielding at first and then sleeping so idle workers stay cheap
+    static void backOff( int idle ) {
+        if(idle < 64) {
+            std::this_thread::yield();
+        } else {
+            std::this_thread::sleep_for(std::chrono::microseconds(100));
+        }
+    }
+
+    //hand the systems out biggest first, each to the living worker with the least so far
+    //weights are the measured costs, or body counts before anything is measured
+    void assign( const std::vector<float>& weight, std::vector<int32_t>& result, float& busiest ) const {
+        std::vector< std::pair<float, int> > order(systems);
+        for(int s = 0; s < systems; s++) {
+            order[s] = std::make_pair(-weight[s], s);
+        }
+        std::sort(order.begin(), order.end());
+        std::vector<float> load(workers, 0.0);
+        result.assign(systems, -1);
+        for(int i = 0; i < systems; i++) {
+            int best = -1;
+            for(int w = 0; w < workers; w++) {
+                if(alive[w] && (best == -1 || load[w] < load[best])) best = w;
+            }
+            result[order[i].second] = best;
+            load[best] -= order[i].first;
+        }
+        busiest = 0;
+        for(int w = 0; w < workers; w++) {
+            busiest = std::max(busiest, load[w]);
+        }
+    }
+
+    //move to the cost based assignment if it takes enough off the busiest worker
+    void rebalance() {
+        std::vector<float> weight(cost, cost + systems);
+        std::vector<float> load(workers, 0.0);
+        for(int s = 0; s < systems; s++) {
+            load[owner[s]] += weight[s];
+        }
+        float current = *std::max_element(load.begin(), load.end());
+        std::vector<int32_t> proposed;
+        float busiest;
+        assign(weight, proposed, busiest);
+        if(busiest < current * (1.0 - SHARD_REBALANCE_GAIN)) {
+            memcpy(owner, &proposed[0], systems * sizeof(int32_t));
+        }
+    }
+
+    //a worker is gone, everything it had goes to the rest
+    void lose( int w, const char* why ) {
+        alive[w] = false;
+        living--;
+        int had = 0;
+        for(int s = 0; s < systems; s++) {
+            if(owner[s] == w) had++;
+        }
+        fprintf(stderr, "shard worker %d (pid %d) %s, handing its %d systems to the %d left\n",
+                w, (int) pids[w], why, had, living);
+        if(living == 0) return;
+        std::vector<float> weight(cost, cost + systems);
+        std::vector<int32_t> result;
+        float busiest;
+        assign(weight, result, busiest);
+        memcpy(owner, &result[0], systems * sizeof(int32_t));
+    }
+
+    public:
+    ShardPool() : workers(0), systems(0), place(NULL), living(0), stepCount(0),
+        input(NULL), inputSize(0), output(NULL), outputSize(0) {}
+
+    ~ShardPool() {
+        stop();
+    }
+
+    //start count workers for systems solar systems made of bodies bodies
+    //weight is how big each system is, for handing them out before anything is measured
+    //command is what runs a worker, the program first, --shard-worker and its arguments get added
+    bool start( int count, int systems, int bodies, const std::vector<float>& weight,
+            const std::vector<std::string>& command ) {
+        stop();
+#ifdef _WIN32
+        return false;
+#else
+        if(count <= 0 || systems == 0 || command.empty()) return false;
+        this->workers = std::min(count, SHARD_MAX_WORKERS);
+        this->systems = systems;
+        inputSize = inputBytes(systems, bodies);
+        outputSize = outputBytes(systems, bodies);
+        char name[64];
+        snprintf(name, sizeof(name), "/solarsystem-shards-%d-in", (int) getpid());
+        int inputFd = makeRegion(name, inputSize);
+        snprintf(name, sizeof(name), "/solarsystem-shards-%d-out", (int) getpid());
+        int outputFd = makeRegion(name, outputSize);
+        if(inputFd >= 0) input = map(inputFd, inputSize, PROT_READ | PROT_WRITE);
+        //the results are only ever read here
+        if(outputFd >= 0) output = map(outputFd, outputSize, PROT_READ);
+        if(input == NULL || output == NULL) {
+            if(inputFd >= 0) close(inputFd);
+            if(outputFd >= 0) close(outputFd);
+            stop();
+            return false;
+        }
+        layout();
+        in()->systems = systems;
+        in()->bodies = bodies;
+        for(int w = 0; w < workers; w++) {
+            alive[w] = true;
+            serving[w] = false;
+        }
+        living = workers;
+        std::vector<int32_t> first;
+        float busiest;
+        assign(weight, first, busiest);
+        memcpy(owner, &first[0], systems * sizeof(int32_t));
+        stepCount = 0;
+        //everything the child needs is made before forking, between fork and exec it may only make system calls
+        std::vector<std::string> words(command);
+        words.push_back("--shard-worker");
+        words.push_back("");
+        words.push_back(std::to_string(inputFd));
+        words.push_back(std::to_string(outputFd));
+        std::vector<char*> args(words.size() + 1, NULL);
+        for(int w = 0; w < workers; w++) {
+            words[command.size() + 1] = std::to_string(w);
+            for(size_t i = 0; i < words.size(); i++) {
+                args[i] = &words[i][0];
+            }
+            pids[w] = fork();
+            if(pids[w] == 0) {
+                //the regions are made close on exec, these two go along
+                fcntl(inputFd, F_SETFD, 0);
+                fcntl(outputFd, F_SETFD, 0);
+                execv("/proc/self/exe", &args[0]);
+                execvp(args[0], &args[0]);
+                _exit(127);
+            }
+            if(pids[w] < 0) {
+                alive[w] = false;
+                living--;
+            }
+        }
+        launched = std::chrono::steady_clock::now();
+        close(inputFd);
+        close(outputFd);
+        if(living == 0) {
+            stop();
+            return false;
+        }
+        return true;
+#endif
+    }
+
+    //run as worker index of the pool that handed over the two regions, until it's stopped
+    //systems and bodies are the scene this process built, it has to be the one the pool expects
+    //returns the exit status
+    int serve( int index, int inputFd, int outputFd, int systems, int bodies, PlaceFunction place ) {
+#ifdef _WIN32
+        return 1;
+#else
+        struct stat st;
+        if(index < 0 || index >= SHARD_MAX_WORKERS || fstat(inputFd, &st) != 0 || (size_t) st.st_size < sizeof(Input)) {
+            fprintf(stderr, "shard worker %d: bad regions\n", index);
+            return 1;
+        }
+        //this process only reads the input and writes the output
+        inputSize = st.st_size;
+        input = map(inputFd, inputSize, PROT_READ);
+        close(inputFd);
+        if(input == NULL) return 1;
+        if(in()->systems != (uint32_t) systems || in()->bodies != (uint32_t) bodies
+                || inputSize != inputBytes(systems, bodies)) {
+            fprintf(stderr, "shard worker %d: built %d systems of %d bodies, expected %u of %u\n",
+                    index, systems, bodies, in()->systems, in()->bodies);
+            munmap(input, inputSize);
+            input = NULL;
+            return 1;
+        }
+        outputSize = outputBytes(systems, bodies);
+        output = map(outputFd, outputSize, PROT_READ | PROT_WRITE);
+        close(outputFd);
+        if(output == NULL) {
+            munmap(input, inputSize);
+            input = NULL;
+            return 1;
+        }
+        this->systems = systems;
+        this->place = place;
+        layout();
+        out()->ready[index].store(1, std::memory_order_release);
+        work(index);
+        munmap(input, inputSize);
+        munmap(output, outputSize);
+        input = output = NULL;
+        return 0;
+#endif
+    }
+
+    bool running() const {
+        return living > 0;
+    }
+
+    int size() const {
+        return living;
+    }
+
+    //where the angles for the next step go
+    float* anglesIn() {
+        return angles;
+    }
+
+    //where every body was put by the last step
+    const float (*positionsOut() const)[4] {
+        return positions;
+    }
+
+    //have the workers place every system for the angles handed in, false once none are left
+    bool step() {
+#ifdef _WIN32
+        return false;
+#else
+        if(living == 0) return false;
+        if(++stepCount % SHARD_REBALANCE_STEPS == 0) {
+            rebalance();
+        }
+        uint64_t wanted = in()->requested.load(std::memory_order_relaxed) + 1;
+        in()->requested.store(wanted, std::memory_order_release);
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        for(int idle = 0; ; idle++) {
+            bool finished = true;
+            for(int w = 0; w < workers; w++) {
+                if(!alive[w] || out()->done[w].load(std::memory_order_acquire) == wanted) continue;
+                finished = false;
+                int status;
+                std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+                if(!serving[w] && out()->ready[w].load(std::memory_order_acquire)) {
+                    serving[w] = true;
+                    servingSince[w] = now;
+                }
+                //a worker still building its scene is timed from when it was started, not from this step
+                double waited = serving[w]
+                    ? std::chrono::duration<double, std::milli>(now - std::max(start, servingSince[w])).count()
+                    : std::chrono::duration<double, std::milli>(now - launched).count();
+                if(waitpid(pids[w], &status, WNOHANG) == pids[w]) {
+                    lose(w, "died");
+                } else if(waited > (serving[w] ? SHARD_TIMEOUT_MS : SHARD_STARTUP_TIMEOUT_MS)) {
+                    kill(pids[w], SIGKILL);
+                    waitpid(pids[w], &status, 0);
+                    lose(w, serving[w] ? "hung" : "never got ready");
+                } else {
+                    continue;
+                }
+                if(living == 0) return false;
+                //whatever the lost worker had is somebody else's now, ask for the whole step again
+                wanted++;
+                in()->requested.store(wanted, std::memory_order_release);
+                start = std::chrono::steady_clock::now();
+            }
+            if(finished) return true;
+            backOff(idle);
+        }
+#endif
+    }
+
+    //tell the workers to stop, wait for them and let go of the regions
+    void stop() {
+#ifndef _WIN32
+        if(input != NULL) {
+            in()->stop.store(1, std::memory_order_release);
+            for(int w = 0; w < workers; w++) {
+                if(!alive[w]) continue;
+                int status;
+                //a hung one doesn't get to hold up the exit
+                for(int tries = 0; tries < 100 && waitpid(pids[w], &status, WNOHANG) == 0; tries++) {
+                    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+                }
+                if(waitpid(pids[w], &status, WNOHANG) == 0) {
+                    kill(pids[w], SIGKILL);
+                    waitpid(pids[w], &status, 0);
+                }
+                alive[w] = false;
+            }
+            munmap(input, inputSize);
+        }
+        if(output != NULL) munmap(output, outputSize);
+#endif
+        input = output = NULL;
+        living = 0;
+        workers = 0;
+    }
+};
+
+#endif
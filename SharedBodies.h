@@ -0,0 +1,287 @@
+#ifndef __SHARED_BODIES_H__
+#define __SHARED_BODIES_H__
+
+#include <stdint.h>
+#include <string.h>
+#include <atomic>
+#include <string>
+#ifndef _WIN32
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
+// Every body's world position, published into POSIX shared memory so other
+// processes can follow the simulation live. SharedBodiesWriter lives in the
+// simulation, SharedBodiesReader is all a reader needs (include this header).
+//
+// The region holds the body names once, then SHARED_SLOTS snapshots of
+// { x, y, z, radius } per body. Each snapshot is written under its own
+// seqlock: the sequence is odd while the slot is being written and bumped to
+// the next even number when it's done. The writer fills the slot after the
+// newest and then points latest at it, so it never waits for anyone, and a
+// reader reads the newest slot in place and checks the sequence afterwards.
+// A reader has SHARED_SLOTS - 1 publishes before the slot it's reading gets
+// reused, retrying is only needed if it is slower than that.
+//
+// Body ids are indices into the snapshot. A new scene (or a different number
+// of bodies) gets a new region under the same name, and the old one is
+// marked retired so readers know to open the name again.
+//
+//   SharedBodiesReader reader;
+//   if(reader.open("/solarsystem")) {
+//       SharedBodiesView view;
+//       if(reader.latest(view)) {
+//           ... view.bodies[i][0..3], reader.name(i) ...
+//           if(reader.stillValid(view)) { the numbers read are consistent }
+//       }
+//   }
+
+const char SHARED_MAGIC[8] = { 'S', 'O', 'L', 'B', 'O', 'D', 'Y', 0 };
+const uint32_t SHARED_VERSION = 1;
+//snapshots in the ring
+const uint32_t SHARED_SLOTS = 4;
+const uint64_t SHARED_ALIGN = 64;
+
+static_assert(ATOMIC_INT_LOCK_FREE == 2 && ATOMIC_LLONG_LOCK_FREE == 2,
+        "shared memory atomics have to be lock free to work across processes");
+
+struct SharedBodiesHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t bodyCount;
+    uint32_t slotCount;
+    uint32_t nameBytes;
+    //byte offsets from the start of the region
+    uint64_t nameOffsetsOffset;
+    uint64_t namesOffset;
+    uint64_t slotsOffset;
+    uint64_t slotStride;
+    //set once the writer has moved to a new region, open the name again
+    std::atomic<uint32_t> retired;
+    //snapshots published so far, the newest is in slot (latest - 1) % slotCount
+    std::atomic<uint64_t> latest;
+};
+
+struct SharedBodiesSlot {
+    //odd while being written
+    std::atomic<uint32_t> sequence;
+    uint32_t bodyCount;
+    //the simulation tick the positions are from
+    uint64_t tick;
+    //followed by bodyCount x { x, y, z, radius }, SHARED_ALIGN aligned
+};
+
+//a snapshot as seen by a reader, pointing straight into shared memory
+struct SharedBodiesView {
+    uint64_t tick;
+    uint32_t bodyCount;
+    const float (*bodies)[4];
+    //for stillValid()
+    const SharedBodiesSlot* slot;
+    uint32_t sequence;
+};
+
+//the region shared by a writer and a reader
+class SharedRegion {
+    protected:
+    //the shm name it was opened with
+    std::string path;
+    void* base;
+    size_t size;
+
+    SharedBodiesHeader* header() const {
+        return (SharedBodiesHeader*) base;
+    }
+
+    SharedBodiesSlot* slot( uint32_t i ) const {
+        return (SharedBodiesSlot*) ((char*) base + header()->slotsOffset + i * header()->slotStride);
+    }
+
+    void unmap() {
+#ifndef _WIN32
+        if(base != NULL) munmap(base, size);
+#endif
+        base = NULL;
+        size = 0;
+    }
+
+    public:
+    SharedRegion() : base(NULL), size(0) {}
+
+    bool isOpen() const {
+        return base != NULL;
+    }
+
+    uint32_t bodyCount() const {
+        return header()->bodyCount;
+    }
+
+    const char* name( uint32_t body ) const {
+        const uint32_t* offsets = (const uint32_t*) ((char*) base + header()->nameOffsetsOffset);
+        return (const char*) base + header()->namesOffset + offsets[body];
+    }
+};
+
+class SharedBodiesWriter : public SharedRegion {
+    public:
+    ~SharedBodiesWriter() {
+        close();
+    }
+
+    //make a fresh region for count bodies with these names, replacing any old one
+    bool create( const char* regionName, uint32_t count, const char* const* names ) {
+        close();
+#ifdef _WIN32
+        return false;
+#else
+        uint64_t nameBytes = 0;
+        for(uint32_t i = 0; i < count; i++) nameBytes += strlen(names[i]) + 1;
+        uint64_t nameOffsetsOffset = sizeof(SharedBodiesHeader);
+        uint64_t namesOffset = nameOffsetsOffset + count * sizeof(uint32_t);
+        uint64_t slotsOffset = (namesOffset + nameBytes + SHARED_ALIGN - 1) / SHARED_ALIGN * SHARED_ALIGN;
+        uint64_t slotStride = SHARED_ALIGN + (count * 4 * sizeof(float) + SHARED_ALIGN - 1) / SHARED_ALIGN * SHARED_ALIGN;
+        size_t total = slotsOffset + SHARED_SLOTS * slotStride;
+        //readers still holding the old region see it retired, the name now means the new one
+        shm_unlink(regionName);
+        int fd = shm_open(regionName, O_CREAT | O_EXCL | O_RDWR, 0644);
+        if(fd < 0) return false;
+        void* p = MAP_FAILED;
+        if(ftruncate(fd, total) == 0) {
+            p = mmap(NULL, total, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        }
+        ::close(fd);
+        if(p == MAP_FAILED) {
+            shm_unlink(regionName);
+            return false;
+        }
+        path = regionName;
+        base = p;
+        size = total;
+        //the fresh region is all zeros, so every sequence starts out even and nothing is published
+        SharedBodiesHeader* h = header();
+        memcpy(h->magic, SHARED_MAGIC, sizeof(h->magic));
+        h->version = SHARED_VERSION;
+        h->bodyCount = count;
+        h->slotCount = SHARED_SLOTS;
+        h->nameBytes = nameBytes;
+        h->nameOffsetsOffset = nameOffsetsOffset;
+        h->namesOffset = namesOffset;
+        h->slotsOffset = slotsOffset;
+        h->slotStride = slotStride;
+        uint32_t* offsets = (uint32_t*) ((char*) base + nameOffsetsOffset);
+        char* pool = (char*) base + namesOffset;
+        uint32_t at = 0;
+        for(uint32_t i = 0; i < count; i++) {
+            offsets[i] = at;
+            size_t n = strlen(names[i]) + 1;
+            memcpy(pool + at, names[i], n);
+            at += n;
+        }
+        return true;
+#endif
+    }
+
+    //write a snapshot, radius is the size of each body
+    void publish( uint64_t tick, const float (*positions)[4], const float* radius, uint32_t count ) {
+        if(base == NULL) return;
+        SharedBodiesHeader* h = header();
+        if(count > h->bodyCount) count = h->bodyCount;
+        uint64_t next = h->latest.load(std::memory_order_relaxed) + 1;
+        SharedBodiesSlot* s = slot((next - 1) % h->slotCount);
+        uint32_t sequence = s->sequence.load(std::memory_order_relaxed);
+        s->sequence.store(sequence + 1, std::memory_order_relaxed);
+        //the odd sequence has to be visible before any of the new numbers
+        std::atomic_thread_fence(std::memory_order_release);
+        s->tick = tick;
+        s->bodyCount = count;
+        float (*out)[4] = (float (*)[4]) ((char*) s + SHARED_ALIGN);
+        for(uint32_t i = 0; i < count; i++) {
+            out[i][0] = positions[i][0];
+            out[i][1] = positions[i][1];
+            out[i][2] = positions[i][2];
+            out[i][3] = radius[i];
+        }
+        s->sequence.store(sequence + 2, std::memory_order_release);
+        h->latest.store(next, std::memory_order_release);
+    }
+
+    //retire the region and take the name down
+    void close() {
+#ifndef _WIN32
+        if(base != NULL) {
+            header()->retired.store(1, std::memory_order_release);
+            shm_unlink(path.c_str());
+        }
+#endif
+        unmap();
+    }
+};
+
+class SharedBodiesReader : public SharedRegion {
+    public:
+    ~SharedBodiesReader() {
+        close();
+    }
+
+    //map a region by name, false if there is none (yet)
+    bool open( const char* regionName ) {
+        close();
+#ifdef _WIN32
+        return false;
+#else
+        int fd = shm_open(regionName, O_RDONLY, 0);
+        if(fd < 0) return false;
+        struct stat st;
+        void* p = MAP_FAILED;
+        if(fstat(fd, &st) == 0 && (size_t) st.st_size >= sizeof(SharedBodiesHeader)) {
+            p = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+        }
+        ::close(fd);
+        if(p == MAP_FAILED) return false;
+        path = regionName;
+        base = p;
+        size = st.st_size;
+        const SharedBodiesHeader* h = header();
+        if(memcmp(h->magic, SHARED_MAGIC, sizeof(h->magic)) != 0 || h->version != SHARED_VERSION
+                || h->slotsOffset + h->slotCount * h->slotStride > size) {
+            unmap();
+            return false;
+        }
+        return true;
+#endif
+    }
+
+    void close() {
+        unmap();
+    }
+
+    //the writer has moved on, open the name again to follow it
+    bool retired() const {
+        return header()->retired.load(std::memory_order_acquire) != 0;
+    }
+
+    //the newest snapshot, false if nothing is published yet or it is being rewritten
+    //read what you need from view, then check stillValid() before trusting it
+    bool latest( SharedBodiesView& view ) const {
+        uint64_t n = header()->latest.load(std::memory_order_acquire);
+        if(n == 0) return false;
+        const SharedBodiesSlot* s = slot((n - 1) % header()->slotCount);
+        view.sequence = s->sequence.load(std::memory_order_acquire);
+        if(view.sequence & 1) return false;
+        view.slot = s;
+        view.tick = s->tick;
+        view.bodyCount = s->bodyCount;
+        view.bodies = (const float (*)[4]) ((const char*) s + SHARED_ALIGN);
+        return true;
+    }
+
+    //nothing in view was overwritten while it was being read
+    bool stillValid( const SharedBodiesView& view ) const {
+        std::atomic_thread_fence(std::memory_order_acquire);
+        return view.slot->sequence.load(std::memory_order_relaxed) == view.sequence;
+    }
+};
+
+#endif
@@ -0,0 +1,161 @@
+#ifndef __TEXTURE_FILE_H__
+#define __TEXTURE_FILE_H__
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <string>
+#ifndef _WIN32
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
+// Virtual texture files (.vtex), what tools/maketexture writes and
+// VirtualTextures streams from.
+//
+// A texture is square and wraps around a sphere (longitude across, latitude
+// down). It is cut into square tiles at every mip level: level 0 is
+// 1 << (levels - 1) tiles a side, each level after it half that, down to a
+// single tile for the whole texture. Every tile repeats border texels of its
+// neighbours on each side (wrapping across, clamped at the poles), so a tile
+// can be filtered on its own wherever it ends up.
+//
+// Tiles are stored BC1 (DXT1) compressed, all the same size, level 0 first
+// and row by row within a level, so where any tile is is simple arithmetic.
+// Like binary scenes they are in the byte order of the machine that made them.
+
+const char TEXTURE_MAGIC[4] = { 'V', 'T', 'E', 'X' };
+const uint32_t TEXTURE_VERSION = 1;
+//page tables hold tile coordinates and levels in bytes (see VirtualTexture.h)
+const uint32_t TEXTURE_MAX_LEVELS = 8;
+
+struct TextureHeader {
+    char magic[4];
+    uint32_t version;
+    //texels along a tile's side not counting its borders, and the border on each side
+    uint32_t tileSize;
+    uint32_t border;
+    uint32_t levels;
+    //compressed size of every tile, borders included
+    uint32_t tileBytes;
+    //where the tiles start
+    uint32_t tileOffset;
+    uint32_t pad;
+};
+
+//bytes of one BC1 compressed tile of side texels
+inline uint32_t textureTileBytes( uint32_t side ) {
+    return (side / 4) * (side / 4) * 8;
+}
+
+// A .vtex file mapped read only. The tiles are read straight out of the
+// mapping, and release() lets the kernel drop the pages of ones that have
+// been copied out, so reading a texture doesn't leave it all resident.
+class TextureFile {
+    void* mapping;
+    size_t mappingSize;
+    TextureHeader header;
+    //index of the first tile of each level
+    uint32_t first[TEXTURE_MAX_LEVELS + 1];
+
+    public:
+    TextureFile() : mapping(NULL), mappingSize(0) {
+        memset(&header, 0, sizeof(header));
+    }
+
+    ~TextureFile() {
+        close();
+    }
+
+    bool open( const char* filename, std::string& error ) {
+        close();
+#ifdef _WIN32
+        error = "textures need mmap";
+        return false;
+#else
+        int fd = ::open(filename, O_RDONLY);
+        if(fd < 0) {
+            error = std::string("can't open ") + filename;
+            return false;
+        }
+        struct stat st;
+        void* p = MAP_FAILED;
+        if(fstat(fd, &st) == 0 && (size_t) st.st_size >= sizeof(TextureHeader)) {
+            p = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        }
+        ::close(fd);
+        if(p == MAP_FAILED) {
+            error = std::string("can't map ") + filename;
+            return false;
+        }
+        mapping = p;
+        mappingSize = st.st_size;
+        memcpy(&header, p, sizeof(header));
+        uint32_t side = header.tileSize + 2 * header.border;
+        bool ok = memcmp(header.magic, TEXTURE_MAGIC, 4) == 0 && header.version == TEXTURE_VERSION
+            && header.levels >= 1 && header.levels <= TEXTURE_MAX_LEVELS
+            && header.tileSize > 0 && side % 4 == 0 && header.tileBytes == textureTileBytes(side);
+        if(ok) {
+            first[0] = 0;
+            for(uint32_t l = 0; l < header.levels; l++) {
+                first[l + 1] = first[l] + tiles(l) * tiles(l);
+            }
+            ok = header.tileOffset + (uint64_t) first[header.levels] * header.tileBytes <= mappingSize;
+        }
+        if(!ok) {
+            close();
+            error = std::string(filename) + " isn't a version " + std::to_string(TEXTURE_VERSION) + " texture";
+            return false;
+        }
+        return true;
+#endif
+    }
+
+    void close() {
+#ifndef _WIN32
+        if(mapping != NULL) munmap(mapping, mappingSize);
+#endif
+        mapping = NULL;
+        mappingSize = 0;
+    }
+
+    const TextureHeader& info() const {
+        return header;
+    }
+
+    //tiles along a side of level
+    uint32_t tiles( uint32_t level ) const {
+        return 1u << (header.levels - 1 - level);
+    }
+
+    //all the tiles at every level
+    uint32_t tileCount() const {
+        return first[header.levels];
+    }
+
+    //where the tile at x, y of level is counting from the first tile of level 0
+    uint32_t index( uint32_t level, uint32_t x, uint32_t y ) const {
+        return first[level] + y * tiles(level) + x;
+    }
+
+    //the compressed tile at x, y of level
+    const unsigned char* tile( uint32_t level, uint32_t x, uint32_t y ) const {
+        return (const unsigned char*) mapping + header.tileOffset + (uint64_t) index(level, x, y) * header.tileBytes;
+    }
+
+    //done reading the tile, its pages can go (the ones it doesn't share with a neighbour)
+    void release( uint32_t level, uint32_t x, uint32_t y ) const {
+#ifndef _WIN32
+        uintptr_t page = sysconf(_SC_PAGESIZE);
+        uintptr_t start = (uintptr_t) tile(level, x, y);
+        uintptr_t end = start + header.tileBytes;
+        start = (start + page - 1) / page * page;
+        end = end / page * page;
+        if(end > start) madvise((void*) start, end - start, MADV_DONTNEED);
+#endif
+    }
+};
+
+#endif
@@ -0,0 +1,260 @@
+#ifndef __TIMELINE_H__
+#define __TIMELINE_H__
+
+#include <stdint.h>
+#include <string.h>
+#include <math.h>
+#include <assert.h>
+#include <vector>
+#include <deque>
+
+//ticks between keyframes, the most a seek ever has to decode
+const int TIMELINE_KEYFRAME_TICKS = 60;
+//angles are stored as 32 bit fractions of a full turn
+const double TIMELINE_STEPS_PER_DEGREE = 4294967296.0 / 360.0;
+//how far (in degrees) a played back angle may be from the recorded one
+const double TIMELINE_TOLERANCE = 0.001;
+
+// Recording of every body's orbit angle, one frame per tick, so the last few
+// minutes can be scrubbed through without simulating them again.
+//
+// Angles and speeds are quantized to 32 bits of a turn, so they wrap around on
+// their own. Every TIMELINE_KEYFRAME_TICKS ticks a keyframe stores both in
+// full. In the frames between them each body is predicted to have moved by
+// its speed, and only what the prediction can't know is written down: a
+// change of speed, or an angle that ended up more than TIMELINE_TOLERANCE
+// away (rounding in the simulation adds up). Those are zigzag varints, and the
+// bodies that did what was predicted are collapsed into runs, so a frame
+// where nothing changed speed is a few bytes no matter how many bodies.
+//
+// A keyframe and the frames after it form a segment. When the recording goes
+// over its byte budget the oldest segment is dropped and its memory reused
+// for the next one, so the recording is a ring of segments and never holds
+// more than the budget plus one segment.
+class Timeline {
+    //what the low two bits of a token say the rest of it is
+    enum { TOKEN_RUN, TOKEN_NUDGE, TOKEN_SPEED };
+
+    struct Segment {
+        int firstTick;
+        //the keyframe followed by the frames, and where each frame ends
+        std::vector<unsigned char> data;
+        std::vector<uint32_t> frameEnds;
+    };
+
+    std::deque<Segment> segments;
+    //an evicted segment kept around so its buffers can be reused
+    Segment spare;
+    size_t budget;
+    size_t used;
+    int bodyCount;
+    //every body as of the last tick, the way playback will see it
+    std::vector<uint32_t> lastAngle;
+    std::vector<uint32_t> lastSpeed;
+
+    static uint32_t quantize( float degrees ) {
+        //through a 64 bit int so any angle wraps instead of overflowing
+        return (uint32_t) llrint(degrees * TIMELINE_STEPS_PER_DEGREE);
+    }
+
+    static void putToken( std::vector<unsigned char>& out, int kind, uint64_t v ) {
+        v = v << 2 | kind;
+        while(v >= 0x80) {
+            out.push_back((v & 0x7f) | 0x80);
+            v >>= 7;
+        }
+        out.push_back(v);
+    }
+
+    static uint64_t getToken( const unsigned char*& p ) {
+        uint64_t v = 0;
+        for(int shift = 0; ; shift += 7) {
+            unsigned char b = *p++;
+            v |= (uint64_t) (b & 0x7f) << shift;
+            if(b < 0x80) return v;
+        }
+    }
+
+    static uint32_t zigzag( int32_t v ) {
+        return ((uint32_t) v << 1) ^ (uint32_t) (v >> 31);
+    }
+
+    static int32_t unzigzag( uint32_t z ) {
+        return (int32_t) ((z >> 1) ^ -(z & 1));
+    }
+
+    static void putRun( std::vector<unsigned char>& out, int& run ) {
+        if(run > 0) putToken(out, TOKEN_RUN, run);
+        run = 0;
+    }
+
+    size_t segmentBytes( const Segment& s ) const {
+        return s.data.size() + s.frameEnds.size() * sizeof(uint32_t);
+    }
+
+    //play a segment forward to tick
+    void decode( const Segment& s, int tick, std::vector<uint32_t>& angle, std::vector<uint32_t>& speed ) const {
+        const unsigned char* p = &s.data[0];
+        //in the byte order of the machine, the recording never leaves memory
+        memcpy(&angle[0], p, bodyCount * 4);
+        memcpy(&speed[0], p + bodyCount * 4, bodyCount * 4);
+        p += bodyCount * 8;
+        for(int t = s.firstTick + 1; t <= tick; t++) {
+            int run = 0;
+            for(int i = 0; i < bodyCount; i++) {
+                int32_t nudge = 0;
+                while(run == 0) {
+                    uint64_t token = getToken(p);
+                    int kind = token & 3;
+                    if(kind == TOKEN_RUN) {
+                        run = token >> 2;
+                    } else if(kind == TOKEN_SPEED) {
+                        speed[i] += unzigzag(token >> 2);
+                    } else {
+                        nudge = unzigzag(token >> 2);
+                        break;
+                    }
+                }
+                if(nudge == 0) run--;
+                angle[i] += speed[i] + nudge;
+            }
+        }
+    }
+
+    //every segment but the newest holds exactly TIMELINE_KEYFRAME_TICKS ticks
+    const Segment& segmentFor( int tick ) const {
+        return segments[(tick - first()) / TIMELINE_KEYFRAME_TICKS];
+    }
+
+    public:
+    Timeline() : budget(0), used(0), bodyCount(0) {}
+
+    //how many bytes the recording may use, 0 turns recording off
+    void setBudget( size_t bytes ) {
+        budget = bytes;
+        if(budget == 0) clear();
+    }
+
+    //forget everything, the next record starts over at tick 0
+    void clear() {
+        segments.clear();
+        used = 0;
+        bodyCount = 0;
+    }
+
+    bool empty() const {
+        return segments.empty();
+    }
+
+    //the oldest and newest ticks still recorded
+    int first() const {
+        return segments.front().firstTick;
+    }
+
+    int last() const {
+        return segments.back().firstTick + segments.back().frameEnds.size() - 1;
+    }
+
+    size_t bytes() const {
+        return used;
+    }
+
+    //bytes the same ticks would take as plain floats
+    size_t rawBytes() const {
+        return empty() ? 0 : (size_t) (last() - first() + 1) * bodyCount * sizeof(float);
+    }
+
+    //add the angles of n bodies, and the speed they are about to move at, as the next tick
+    void record( const float* rot, const float* rotSpeed, int n ) {
+        if(budget == 0 || n == 0) return;
+        assert(empty() || n == bodyCount);
+        if(empty() || (int) segments.back().frameEnds.size() >= TIMELINE_KEYFRAME_TICKS) {
+            //ticks carry on counting even if everything before this one has to go
+            int tick = empty() ? 0 : last() + 1;
+            //make room by dropping the oldest segments, the one starting here always stays
+            while(!segments.empty() && used > budget) {
+                used -= segmentBytes(segments.front());
+                spare.data.swap(segments.front().data);
+                spare.frameEnds.swap(segments.front().frameEnds);
+                segments.pop_front();
+            }
+            segments.push_back(Segment());
+            Segment& s = segments.back();
+            s.firstTick = tick;
+            s.data.swap(spare.data);
+            s.frameEnds.swap(spare.frameEnds);
+            s.frameEnds.clear();
+            bodyCount = n;
+            lastAngle.resize(n);
+            lastSpeed.resize(n);
+            for(int i = 0; i < n; i++) {
+                lastAngle[i] = quantize(rot[i]);
+                lastSpeed[i] = quantize(rotSpeed[i]);
+            }
+            s.data.resize(n * 8);
+            memcpy(&s.data[0], &lastAngle[0], n * 4);
+            memcpy(&s.data[n * 4], &lastSpeed[0], n * 4);
+            s.frameEnds.push_back(s.data.size());
+            used += segmentBytes(s);
+            return;
+        }
+        Segment& s = segments.back();
+        size_t before = segmentBytes(s);
+        const int32_t tolerance = TIMELINE_TOLERANCE * TIMELINE_STEPS_PER_DEGREE;
+        int run = 0;
+        for(int i = 0; i < n; i++) {
+            uint32_t speed = quantize(rotSpeed[i]);
+            if(speed != lastSpeed[i]) {
+                putRun(s.data, run);
+                putToken(s.data, TOKEN_SPEED, zigzag(speed - lastSpeed[i]));
+                lastSpeed[i] = speed;
+            }
+            uint32_t predicted = lastAngle[i] + speed;
+            int32_t nudge = (int32_t) (quantize(rot[i]) - predicted);
+            if(nudge >= -tolerance && nudge <= tolerance) {
+                run++;
+                nudge = 0;
+            } else {
+                putRun(s.data, run);
+                putToken(s.data, TOKEN_NUDGE, zigzag(nudge));
+            }
+            lastAngle[i] = predicted + nudge;
+        }
+        putRun(s.data, run);
+        s.frameEnds.push_back(s.data.size());
+        used += segmentBytes(s) - before;
+    }
+
+    //the angles (in degrees, 0 to 360) and speeds as of a recorded tick
+    void seek( int tick, float* rot, float* rotSpeed ) const {
+        assert(!empty() && tick >= first() && tick <= last());
+        std::vector<uint32_t> angle(bodyCount), speed(bodyCount);
+        decode(segmentFor(tick), tick, angle, speed);
+        for(int i = 0; i < bodyCount; i++) {
+            rot[i] = angle[i] / TIMELINE_STEPS_PER_DEGREE;
+            //speeds are signed
+            rotSpeed[i] = (int32_t) speed[i] / TIMELINE_STEPS_PER_DEGREE;
+        }
+    }
+
+    //forget every tick after this one, recording carries on from here
+    void truncate( int tick ) {
+        if(empty() || tick >= last()) return;
+        if(tick < first()) {
+            clear();
+            return;
+        }
+        while(segments.size() > 1 && segments.back().firstTick > tick) {
+            used -= segmentBytes(segments.back());
+            segments.pop_back();
+        }
+        Segment& s = segments.back();
+        size_t before = segmentBytes(s);
+        s.frameEnds.resize(tick - s.firstTick + 1);
+        s.data.resize(s.frameEnds.back());
+        used -= before - segmentBytes(s);
+        decode(s, tick, lastAngle, lastSpeed);
+    }
+};
+
+#endif
@@ -0,0 +1,61 @@
+#ifndef __TRIPLE_BUFFER_H__
+#define __TRIPLE_BUFFER_H__
+
+#include <atomic>
+
+// Hands values from one writer thread to one reader thread without either
+// ever waiting on the other. There are three slots: the writer fills its back
+// slot and publish() swaps it with the middle one, the reader's update() swaps
+// the middle one with its front slot if something new was published since
+// the last time. Each side only ever touches its own slot, so whatever the
+// reader is looking at stays put until its next update().
+//
+// The writer gets back the slot from two publishes ago, so it has to fill in
+// all of it. Slots are reused, anything with vectors keeps their capacity.
+//
+//   writer:  T& t = buffer.writing(); ... fill t ...; buffer.publish();
+//   reader:  buffer.update(); const T& t = buffer.reading();
+template<class T>
+class TripleBuffer {
+    //set on middle while it holds something the reader hasn't taken
+    enum { FRESH = 4, INDEX = 3 };
+
+    T slots[3];
+    //the slot between the two, | FRESH if it's newer than the reader's
+    std::atomic<int> middle;
+    //only the writer touches back, only the reader touches front
+    int back;
+    int front;
+
+    public:
+    TripleBuffer() : middle(1), back(0), front(2) {}
+
+    //the slot to fill before the next publish
+    T& writing() {
+        return slots[back];
+    }
+
+    //hand the filled slot over, it's what the reader sees next
+    void publish() {
+        back = middle.exchange(back | FRESH, std::memory_order_acq_rel) & INDEX;
+    }
+
+    //take the newest published value if there is one, true if it changed
+    bool update() {
+        if(!(middle.load(std::memory_order_relaxed) & FRESH)) return false;
+        front = middle.exchange(front, std::memory_order_acq_rel) & INDEX;
+        return true;
+    }
+
+    //whether something's been published since the last update, for the reader to peek at
+    bool fresh() const {
+        return middle.load(std::memory_order_relaxed) & FRESH;
+    }
+
+    //the value taken by the last update, stays the same until the next one
+    const T& reading() const {
+        return slots[front];
+    }
+};
+
+#endif
@@ -0,0 +1,648 @@
+#ifndef __VIRTUAL_TEXTURE_H__
+#define __VIRTUAL_TEXTURE_H__
+
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include <atomic>
+#include <deque>
+#include <vector>
+#include <string>
+#include <algorithm>
+#include <unordered_map>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include "Angel.h"
+#include "MpscQueue.h"
+#include "TextureFile.h"
+
+//where find() looks for name.vtex, and what it falls back to
+const char* const TEXTURE_DIR = "textures/";
+const char* const TEXTURE_DEFAULT = "default";
+//the feedback pass is this many times smaller than the window each way
+const int VT_FEEDBACK_SCALE = 8;
+//tiles on their way from the files to the atlas at once, each has a staging buffer
+const int VT_STAGING_TILES = 32;
+//tiles copied into the atlas per frame at most, anything else waits a frame
+const int VT_UPLOADS_PER_FRAME = 16;
+//requests and results in flight, never more than VT_STAGING_TILES
+const unsigned int VT_QUEUE_SIZE = 64;
+//page table entries hold slot coordinates in a byte
+const int VT_MAX_SLOTS_SIDE = 256;
+//slotOf for a tile that's on its way
+const int VT_LOADING = -2;
+
+// Planet textures too big to keep on the GPU, streamed in as they're seen.
+//
+// Every texture is a TextureFile, cut into tiles at every mip level. Only the
+// tiles something on screen needs are resident, in one fixed size BC1 atlas
+// of equal slots, and per texture a page table (one texel per tile, one mip
+// level per texture level) says which slot holds each tile. Entries of tiles
+// that aren't resident point at their nearest resident ancestor instead, and
+// the single tile of the coarsest level of every texture is pinned, so a
+// lookup always finds something, just blurrier while the finer tile streams in.
+//
+// Which tiles are needed comes from a feedback pass: the textured meshes are
+// drawn again, VT_FEEDBACK_SCALE times smaller, writing the texture, level and
+// tile each fragment would like. That is read back through a pair of pixel
+// buffers two frames later, so the read never waits on the GPU.
+//
+// Missing tiles (and their missing ancestors, coarsest first) are handed to a
+// loader thread, which copies each out of the mapped file into a staging
+// buffer and lets the kernel drop the pages again. Finished tiles go into the
+// atlas, in a free slot or the least recently wanted one. The atlas, page
+// tables and staging buffers are sized once from the budget, so that's all
+// the memory texturing ever holds on to.
+//
+//   find() while the scene is built (no GL), for each material's texture
+//   update() once a frame on the GL thread, before anything textured is drawn
+//   bindAtlas(), then bind() before each mesh, unbind() after
+//   beginFeedback(), bind() and draw each textured mesh, endFeedback()
+//   or skipFeedback() when nothing drawn was textured
+class VirtualTextures {
+    //one page table texel, the atlas slot of a tile and the level it's really from
+    struct Page {
+        unsigned char x, y, level, valid;
+        bool operator==( const Page& p ) const {
+            return memcmp(this, &p, sizeof(Page)) == 0;
+        }
+    };
+    struct Texture {
+        std::string name;
+        TextureFile file;
+        //the slot of every tile (see TextureFile::index) or -1, VT_LOADING
+        std::vector<int> slotOf;
+        //every level's page table one after another, like the tiles in the file
+        std::vector<Page> pages;
+        GLuint pageTable;
+        //prepare() has been at it, and it worked: the coarsest tile is pinned and the page table made
+        bool prepared;
+        bool ready;
+        bool dirty;
+    };
+    struct Slot {
+        //what's in it, texture -1 for nothing
+        int texture;
+        uint32_t level, x, y;
+        //the last frame it was wanted
+        long used;
+        bool pinned;
+    };
+    struct Request {
+        const TextureFile* file;
+        int texture;
+        uint32_t level, x, y;
+        int staging;
+    };
+    struct Wanted {
+        int texture;
+        uint32_t level, x, y;
+        bool operator<( const Wanted& w ) const {
+            if(level != w.level) return level > w.level;
+            if(texture != w.texture) return texture < w.texture;
+            if(y != w.y) return y < w.y;
+            return x < w.x;
+        }
+        bool operator==( const Wanted& w ) const {
+            return texture == w.texture && level == w.level && x == w.x && y == w.y;
+        }
+    };
+
+    //never moves, the loader reads the files through pointers
+    std::deque<Texture> textures;
+    //what find() found for every name it was asked, -1 if nothing
+    std::unordered_map<std::string, int> found;
+    size_t budget;
+    //every texture has tiles this big, set by the first one
+    uint32_t tileSize;
+    uint32_t border;
+    uint32_t tileBytes;
+    //texels along the side of a slot, borders included
+    int slotSide;
+    int slotsSide;
+    std::vector<Slot> slots;
+    GLuint atlas;
+    //S3TC checked for and the atlas made, or texturing given up on
+    bool started;
+    bool supported;
+    int atlasUnit;
+
+    //the loader thread and what goes back and forth
+    std::thread loader;
+    MpscQueue<Request, VT_QUEUE_SIZE> requests;
+    MpscQueue<Request, VT_QUEUE_SIZE> results;
+    std::atomic<int> queued;
+    std::atomic<bool> stopping;
+    std::mutex sleepLock;
+    std::condition_variable wake;
+    std::vector<unsigned char> staging;
+    std::vector<int> freeStaging;
+
+    //the feedback target and the two buffers it's read back through
+    GLuint feedbackFbo;
+    GLuint feedbackColor;
+    GLuint feedbackDepth;
+    int feedbackWidth;
+    int feedbackHeight;
+    GLuint readback[2];
+    //whatever was being drawn to before, what endFeedback() goes back to
+    GLint windowFbo;
+    //the frame each buffer holds the feedback of, -1 for none
+    long readbackFrame[2];
+    int nextReadback;
+    std::vector<uint32_t> feedback;
+    std::vector<Wanted> wanted;
+
+    //the frame being drawn, the last one whose feedback has to be read, the last one read
+    long frame;
+    long touched;
+    long read;
+    //something was loaded with nowhere to put it, the atlas can't hold what the feedback wants
+    //it isn't asked for again until the feedback wants something else, it's drawn from coarser tiles meanwhile
+    bool starved;
+    //which wanted tiles were asked for last, and which of those didn't fit
+    uint64_t asking;
+    uint64_t starvedOn;
+    bool drewTextured;
+    //tiles handed to the loader and not in the atlas yet
+    int loading;
+    int resident;
+
+    static Page pageFor( int slot, int slotsSide, uint32_t level ) {
+        Page p = { (unsigned char) (slot % slotsSide), (unsigned char) (slot / slotsSide), (unsigned char) level, 255 };
+        return p;
+    }
+
+    //copy tiles out of the files until we're told to stop
+    void load() {
+        Request r;
+        for(;;) {
+            {
+                std::unique_lock<std::mutex> guard(sleepLock);
+                wake.wait(guard, [this] { return stopping.load() || queued.load() > 0; });
+                if(stopping) return;
+            }
+            while(requests.pop(r)) {
+                queued--;
+                memcpy(&staging[(size_t) r.staging * tileBytes], r.file->tile(r.level, r.x, r.y), tileBytes);
+                r.file->release(r.level, r.x, r.y);
+                //can't be full, there are fewer staging buffers than cells
+                results.push(r);
+            }
+        }
+    }
+
+    //point the page table at (level, x, y) and everything under it that isn't resident itself
+    //at that tile if it is, otherwise at fallback, what its parent's entry says
+    void fill( Texture& t, uint32_t level, uint32_t x, uint32_t y, const Page& fallback ) {
+        uint32_t i = t.file.index(level, x, y);
+        Page p = t.slotOf[i] >= 0 ? pageFor(t.slotOf[i], slotsSide, level) : fallback;
+        if(t.pages[i] == p) return;
+        t.pages[i] = p;
+        t.dirty = true;
+        if(level == 0) return;
+        for(uint32_t c = 0; c < 4; c++) {
+            fill(t, level - 1, x * 2 + c % 2, y * 2 + c / 2, p);
+        }
+    }
+
+    //after (level, x, y) came or went
+    void refresh( Texture& t, uint32_t level, uint32_t x, uint32_t y ) {
+        Page fallback = { 0, 0, 0, 0 };
+        if(level + 1 < t.file.info().levels) {
+            fallback = t.pages[t.file.index(level + 1, x / 2, y / 2)];
+        }
+        fill(t, level, x, y, fallback);
+    }
+
+    void upload( int slot, const unsigned char* data ) {
+        glBindTexture(GL_TEXTURE_2D, atlas);
+        glCompressedTexSubImage2D(GL_TEXTURE_2D, 0, (slot % slotsSide) * slotSide, (slot / slotsSide) * slotSide,
+                slotSide, slotSide, GL_COMPRESSED_RGB_S3TC_DXT1_EXT, tileBytes, data);
+    }
+
+    //put a tile in slot, whatever was there goes
+    void place( int slot, int texture, uint32_t level, uint32_t x, uint32_t y, const unsigned char* data ) {
+        Slot& s = slots[slot];
+        if(s.texture >= 0) {
+            Texture& old = textures[s.texture];
+            old.slotOf[old.file.index(s.level, s.x, s.y)] = -1;
+            refresh(old, s.level, s.x, s.y);
+            resident--;
+        }
+        upload(slot, data);
+        s.texture = texture;
+        s.level = level;
+        s.x = x;
+        s.y = y;
+        s.used = frame;
+        Texture& t = textures[texture];
+        t.slotOf[t.file.index(level, x, y)] = slot;
+        refresh(t, level, x, y);
+        resident++;
+    }
+
+    //an empty slot, or else the one wanted longest ago that wasn't wanted this frame, -1 if none
+    int claimSlot() {
+        int best = -1;
+        for(size_t i = 0; i < slots.size(); i++) {
+            const Slot& s = slots[i];
+            if(s.texture < 0) return i;
+            if(s.pinned || s.used >= frame) continue;
+            if(best < 0 || s.used < slots[best].used) best = i;
+        }
+        return best;
+    }
+
+    //the atlas, the feedback target and the loader, once there's a context and something to texture
+    void start() {
+        started = true;
+        supported = glewIsSupported("GL_EXT_texture_compression_s3tc");
+        if(!supported) {
+            printf("no S3TC texture compression, planets won't be textured\n");
+            return;
+        }
+        GLint maxSize;
+        glGetIntegerv(GL_MAX_TEXTURE_SIZE, &maxSize);
+        //the page tables and staging buffers come out of the budget first
+        size_t fixed = (size_t) VT_STAGING_TILES * tileBytes;
+        for(size_t i = 0; i < textures.size(); i++) {
+            fixed += textures[i].pages.size() * sizeof(Page);
+        }
+        size_t left = budget > fixed ? budget - fixed : 0;
+        slotsSide = std::min((int) sqrt((double) (left / tileBytes)), std::min(maxSize / slotSide, VT_MAX_SLOTS_SIDE));
+        if(slotsSide < 2) {
+            printf("a %.1f MB texture budget doesn't fit any tiles, planets won't be textured\n", budget / 1048576.0);
+            supported = false;
+            return;
+        }
+        Slot empty = { -1, 0, 0, 0, -1, false };
+        slots.assign(slotsSide * slotsSide, empty);
+        glGenTextures(1, &atlas);
+        glBindTexture(GL_TEXTURE_2D, atlas);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, 0);
+        int side = slotsSide * slotSide;
+        glCompressedTexImage2D(GL_TEXTURE_2D, 0, GL_COMPRESSED_RGB_S3TC_DXT1_EXT, side, side, 0,
+                textureTileBytes(side), NULL);
+        glGenFramebuffers(1, &feedbackFbo);
+        glGenRenderbuffers(1, &feedbackColor);
+        glGenRenderbuffers(1, &feedbackDepth);
+        glGenBuffers(2, readback);
+        staging.resize((size_t) VT_STAGING_TILES * tileBytes);
+        for(int i = VT_STAGING_TILES - 1; i >= 0; i--) {
+            freeStaging.push_back(i);
+        }
+        stopping = false;
+        loader = std::thread(&VirtualTextures::load, this);
+    }
+
+    //the page table of a texture found since the last frame, and its coarsest tile pinned
+    void prepare( int texture ) {
+        Texture& t = textures[texture];
+        t.prepared = t.ready = true;
+        uint32_t levels = t.file.info().levels;
+        int slot = claimSlot();
+        if(slot < 0) {
+            printf("no room left in the atlas for %s, it won't be textured\n", t.name.c_str());
+            t.ready = false;
+            return;
+        }
+        glGenTextures(1, &t.pageTable);
+        glBindTexture(GL_TEXTURE_2D, t.pageTable);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST_MIPMAP_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, levels - 1);
+        for(uint32_t l = 0; l < levels; l++) {
+            glTexImage2D(GL_TEXTURE_2D, l, GL_RGBA8, t.file.tiles(l), t.file.tiles(l), 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+        }
+        place(slot, texture, levels - 1, 0, 0, t.file.tile(levels - 1, 0, 0));
+        t.file.release(levels - 1, 0, 0);
+        slots[slot].pinned = true;
+    }
+
+    //what the feedback read back wants, plus whatever it falls back on, is wanted this frame
+    void want( int texture, uint32_t level, uint32_t x, uint32_t y ) {
+        Texture& t = textures[texture];
+        for(; level < t.file.info().levels; level++, x /= 2, y /= 2) {
+            int slot = t.slotOf[t.file.index(level, x, y)];
+            if(slot >= 0) {
+                slots[slot].used = frame;
+            } else if(slot != VT_LOADING) {
+                Wanted w = { texture, level, x, y };
+                wanted.push_back(w);
+            }
+        }
+    }
+
+    //one number for a set of wanted tiles, to tell whether the feedback wants the same as before
+    static uint64_t hashWanted( const std::vector<Wanted>& w ) {
+        uint64_t h = 14695981039346656037ull;
+        for(size_t i = 0; i < w.size(); i++) {
+            uint32_t v[4] = { (uint32_t) w[i].texture, w[i].level, w[i].x, w[i].y };
+            for(int k = 0; k < 4; k++) {
+                h = (h ^ v[k]) * 1099511628211ull;
+            }
+        }
+        return h;
+    }
+
+    //read the feedback of two frames ago, and ask for the tiles it wants that we don't have
+    void readFeedback() {
+        int b = nextReadback;
+        if(readbackFrame[b] < 0) return;
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, readback[b]);
+        size_t count = (size_t) feedbackWidth * feedbackHeight;
+        const uint32_t* pixels = (const uint32_t*) glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0,
+                count * sizeof(uint32_t), GL_MAP_READ_BIT);
+        if(pixels != NULL) {
+            feedback.assign(pixels, pixels + count);
+            glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+        }
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+        read = std::max(read, readbackFrame[b]);
+        readbackFrame[b] = -1;
+        if(pixels == NULL) return;
+        //one look per tile however many fragments want it
+        std::sort(feedback.begin(), feedback.end());
+        feedback.erase(std::unique(feedback.begin(), feedback.end()), feedback.end());
+        wanted.clear();
+        for(size_t i = 0; i < feedback.size(); i++) {
+            const unsigned char* p = (const unsigned char*) &feedback[i];
+            int texture = p[3] - 1;
+            if(texture < 0 || texture >= (int) textures.size() || !textures[texture].ready) continue;
+            const TextureFile& f = textures[texture].file;
+            if(p[2] >= f.info().levels || p[0] >= f.tiles(p[2]) || p[1] >= f.tiles(p[2])) continue;
+            want(texture, p[2], p[0], p[1]);
+        }
+        //coarsest first, they're what everything falls back on
+        std::sort(wanted.begin(), wanted.end());
+        wanted.erase(std::unique(wanted.begin(), wanted.end()), wanted.end());
+        //the atlas couldn't hold this last time, asking again would only throw it away again
+        uint64_t h = hashWanted(wanted);
+        if(starved && h == starvedOn) return;
+        starved = false;
+        asking = h;
+        size_t asked = 0;
+        for(; asked < wanted.size() && !freeStaging.empty(); asked++) {
+            const Wanted& w = wanted[asked];
+            Texture& t = textures[w.texture];
+            Request r = { &t.file, w.texture, w.level, w.x, w.y, freeStaging.back() };
+            freeStaging.pop_back();
+            t.slotOf[t.file.index(w.level, w.x, w.y)] = VT_LOADING;
+            requests.push(r);
+            queued++;
+            loading++;
+        }
+        if(asked > 0) {
+            std::lock_guard<std::mutex> guard(sleepLock);
+            wake.notify_one();
+        }
+        //more than fits in the staging buffers, look again once these are in
+        if(asked < wanted.size()) {
+            touched = std::max(touched, frame);
+        }
+    }
+
+    public:
+    VirtualTextures() : budget(0), tileSize(0), border(0), tileBytes(0), slotSide(0), slotsSide(0), atlas(0),
+        started(false), supported(false), atlasUnit(0), queued(0), stopping(false),
+        feedbackFbo(0), feedbackColor(0), feedbackDepth(0), feedbackWidth(0), feedbackHeight(0), windowFbo(0), nextReadback(0),
+        frame(0), touched(0), read(-1), starved(false), asking(0), starvedOn(0), drewTextured(false), loading(0), resident(0) {
+        readbackFrame[0] = readbackFrame[1] = -1;
+    }
+
+    ~VirtualTextures() {
+        stop();
+    }
+
+    //bytes the atlas, page tables and staging buffers may add up to, 0 turns texturing off
+    //set before anything is found
+    void setBudget( size_t bytes ) {
+        budget = bytes;
+    }
+
+    //the texture for a material, TEXTURE_DIR/name.vtex or else the default one, -1 if neither is there
+    //only opens and maps files, GL is set up for it by the next update()
+    int find( const char* name ) {
+        if(budget == 0) return -1;
+        std::string key = name[0] == '\0' ? TEXTURE_DEFAULT : name;
+        std::unordered_map<std::string, int>::iterator i = found.find(key);
+        if(i != found.end()) return i->second;
+        int index = -1;
+        std::string filename = std::string(TEXTURE_DIR) + key + ".vtex";
+        textures.emplace_back();
+        Texture& t = textures.back();
+        std::string error;
+        bool opened = t.file.open(filename.c_str(), error);
+        if(opened && tileSize == 0) {
+            tileSize = t.file.info().tileSize;
+            border = t.file.info().border;
+            tileBytes = t.file.info().tileBytes;
+            slotSide = tileSize + 2 * border;
+        }
+        if(opened && (t.file.info().tileSize != tileSize || t.file.info().border != border)) {
+            printf("%s has %u texel tiles with %u texel borders, the other textures have %u and %u\n",
+                    filename.c_str(), t.file.info().tileSize, t.file.info().border, tileSize, border);
+        } else if(opened) {
+            t.name = key;
+            t.slotOf.assign(t.file.tileCount(), -1);
+            Page none = { 0, 0, 0, 0 };
+            t.pages.assign(t.file.tileCount(), none);
+            t.pageTable = 0;
+            t.prepared = t.ready = t.dirty = false;
+            index = textures.size() - 1;
+        }
+        if(index < 0) {
+            textures.pop_back();
+            //quietly, most materials don't have a texture of their own
+            if(!opened && key != TEXTURE_DEFAULT) index = find(TEXTURE_DEFAULT);
+        }
+        found[key] = index;
+        return index;
+    }
+
+    //let the loader go, GL is left to go with the context
+    void stop() {
+        if(!loader.joinable()) return;
+        {
+            std::lock_guard<std::mutex> guard(sleepLock);
+            stopping = true;
+            wake.notify_one();
+        }
+        loader.join();
+    }
+
+    //textures are being drawn, or will be once the next update() sets them up
+    bool enabled() const {
+        return !textures.empty() && (!started || supported);
+    }
+
+    //whether streaming is still settling, frames have to keep coming until it has
+    bool busy() const {
+        return enabled() && (read < touched || loading > 0);
+    }
+
+    //what's on screen moved, the feedback of this frame has to be looked at
+    void touch() {
+        touched = frame;
+    }
+
+    //set up anything new, read the feedback, start loading what it wants and put what's loaded in the atlas
+    void update() {
+        if(textures.empty()) return;
+        if(!started) start();
+        if(!supported) return;
+        for(size_t i = 0; i < textures.size(); i++) {
+            if(!textures[i].prepared) prepare(i);
+        }
+        drewTextured = false;
+        readFeedback();
+        Request r;
+        for(int n = 0; n < VT_UPLOADS_PER_FRAME && results.pop(r); n++) {
+            Texture& t = textures[r.texture];
+            const unsigned char* data = &staging[(size_t) r.staging * tileBytes];
+            int slot = claimSlot();
+            if(slot >= 0) {
+                place(slot, r.texture, r.level, r.x, r.y, data);
+            } else {
+                t.slotOf[t.file.index(r.level, r.x, r.y)] = -1;
+                starved = true;
+                starvedOn = asking;
+            }
+            freeStaging.push_back(r.staging);
+            loading--;
+        }
+        for(size_t i = 0; i < textures.size(); i++) {
+            Texture& t = textures[i];
+            if(!t.dirty) continue;
+            glBindTexture(GL_TEXTURE_2D, t.pageTable);
+            for(uint32_t l = 0; l < t.file.info().levels; l++) {
+                glTexSubImage2D(GL_TEXTURE_2D, l, 0, 0, t.file.tiles(l), t.file.tiles(l), GL_RGBA, GL_UNSIGNED_BYTE,
+                        &t.pages[t.file.index(l, 0, 0)]);
+            }
+            t.dirty = false;
+        }
+        glBindTexture(GL_TEXTURE_2D, 0);
+    }
+
+    //the atlas on unit, and each page table on the one after it
+    void bindAtlas( GLuint program, int unit ) {
+        if(!supported) return;
+        atlasUnit = unit;
+        glActiveTexture(GL_TEXTURE0 + unit);
+        glBindTexture(GL_TEXTURE_2D, atlas);
+        glUniform1i(glGetUniformLocation(program, "atlas"), unit);
+        glActiveTexture(GL_TEXTURE0);
+        glUniform4f(glGetUniformLocation(program, "atlasTile"), slotSide, border, tileSize, slotsSide * slotSide);
+    }
+
+    //draw with texture from now on, false (and drawn flat) if it isn't ready or is -1
+    bool bind( GLuint program, int texture ) {
+        bool textured = supported && texture >= 0 && textures[texture].ready;
+        glUniform1i(glGetUniformLocation(program, "textured"), textured);
+        if(!textured) return false;
+        const Texture& t = textures[texture];
+        glActiveTexture(GL_TEXTURE0 + atlasUnit + 1);
+        glBindTexture(GL_TEXTURE_2D, t.pageTable);
+        glUniform1i(glGetUniformLocation(program, "pageTable"), atlasUnit + 1);
+        glActiveTexture(GL_TEXTURE0);
+        glUniform1f(glGetUniformLocation(program, "virtualTiles"), t.file.tiles(0));
+        glUniform1i(glGetUniformLocation(program, "virtualLevels"), t.file.info().levels);
+        glUniform1i(glGetUniformLocation(program, "virtualTexture"), texture);
+        drewTextured = true;
+        return true;
+    }
+
+    //back to flat color for whatever else the program draws
+    void unbind( GLuint program ) {
+        glUniform1i(glGetUniformLocation(program, "textured"), 0);
+    }
+
+    //whether anything bound a texture since update()
+    bool drewAny() const {
+        return drewTextured;
+    }
+
+    //draw the textured meshes into the small feedback target after this, with depth of its own
+    void beginFeedback( GLuint program, int width, int height ) {
+        glGetIntegerv(GL_DRAW_FRAMEBUFFER_BINDING, &windowFbo);
+        int w = std::max(width / VT_FEEDBACK_SCALE, 1);
+        int h = std::max(height / VT_FEEDBACK_SCALE, 1);
+        if(w != feedbackWidth || h != feedbackHeight) {
+            feedbackWidth = w;
+            feedbackHeight = h;
+            glBindRenderbuffer(GL_RENDERBUFFER, feedbackColor);
+            glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, w, h);
+            glBindRenderbuffer(GL_RENDERBUFFER, feedbackDepth);
+            glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, w, h);
+            glBindRenderbuffer(GL_RENDERBUFFER, 0);
+            glBindFramebuffer(GL_FRAMEBUFFER, feedbackFbo);
+            glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, feedbackColor);
+            glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, feedbackDepth);
+            for(int i = 0; i < 2; i++) {
+                glBindBuffer(GL_PIXEL_PACK_BUFFER, readback[i]);
+                glBufferData(GL_PIXEL_PACK_BUFFER, (size_t) w * h * 4, NULL, GL_STREAM_READ);
+                readbackFrame[i] = -1;
+            }
+            glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+        }
+        glBindFramebuffer(GL_FRAMEBUFFER, feedbackFbo);
+        glViewport(0, 0, w, h);
+        GLfloat none[4] = { 0, 0, 0, 0 };
+        GLfloat far = 1.0;
+        glClearBufferfv(GL_COLOR, 0, none);
+        glClearBufferfv(GL_DEPTH, 0, &far);
+        //the ids written are exact, blending them would mix them up
+        glDisable(GL_BLEND);
+        glUseProgram(program);
+        glUniform4f(glGetUniformLocation(program, "atlasTile"), slotSide, border, tileSize, slotsSide * slotSide);
+        //the derivatives are this much bigger down here, the levels picked have to match the real pass
+        glUniform1f(glGetUniformLocation(program, "lodBias"), log2((float) VT_FEEDBACK_SCALE));
+    }
+
+    //start reading the feedback back and go back to drawing the window
+    void endFeedback( int width, int height ) {
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, readback[nextReadback]);
+        glReadPixels(0, 0, feedbackWidth, feedbackHeight, GL_RGBA, GL_UNSIGNED_BYTE, 0);
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+        readbackFrame[nextReadback] = frame;
+        nextReadback ^= 1;
+        glBindFramebuffer(GL_FRAMEBUFFER, windowFbo);
+        glViewport(0, 0, width, height);
+        glEnable(GL_BLEND);
+        frame++;
+    }
+
+    //nothing drawn this frame was textured, so there's no feedback to wait for
+    void skipFeedback() {
+        read = std::max(read, frame);
+        frame++;
+    }
+
+    int residentTiles() const {
+        return resident;
+    }
+
+    int loadingTiles() const {
+        return loading;
+    }
+
+    int slotCount() const {
+        return slots.size();
+    }
+
+    //what texturing holds on to, atlas, page tables and staging buffers
+    size_t bytes() const {
+        if(!supported) return 0;
+        size_t total = (size_t) textureTileBytes(slotsSide * slotSide) + staging.size();
+        for(size_t i = 0; i < textures.size(); i++) {
+            total += textures[i].pages.size() * sizeof(Page);
+        }
+        return total;
+    }
+};
+
+#endif
@@ -0,0 +1,240 @@
+// ------------------------
+// Microbenchmarks for vec.h, mat.h and Quaternion.h
+// ------------------------
+//
+// usage: bench_math [baseline file] [--write file]
+//
+// Every operation is measured two ways:
+//   single - a dependent chain, each result feeds the next call (latency)
+//   batch  - BATCH independent inputs to outputs (throughput)
+// Results are in ops/ns (higher is better). Given a baseline file the
+// change against it is printed next to each result, and anything slower by
+// more than NOISE makes the exit status 2. Rates only compare on the machine
+// that measured them, so baselines aren't committed: a baseline file that
+// isn't there yet is written by the run instead.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <map>
+#include <string>
+#include <chrono>
+
+#include "Angel.h"
+#include "Quaternion.h"
+
+//inputs per batch
+const int BATCH = 1024;
+//each measurement runs for at least this long, best of REPEATS is kept
+const double MIN_SECONDS = 0.05;
+const int REPEATS = 5;
+//changes smaller than this are noise
+const double NOISE = 0.15;
+
+//keeps results alive so the compiler can't throw the work away
+volatile float sink;
+
+inline void consume( const vec3& v ) { sink = v.x; }
+inline void consume( const vec4& v ) { sink = v.x; }
+inline void consume( const mat4& m ) { sink = m[0][0]; }
+
+//run body(iterations) until it takes MIN_SECONDS, best ops/ns of REPEATS runs
+//body returns how many operations it did
+template <typename Body>
+double measure( Body body ) {
+    double best = 0;
+    for(int r = 0; r < REPEATS; r++) {
+        long long ops = 0;
+        double elapsed = 0;
+        int iterations = 1;
+        while(elapsed < MIN_SECONDS) {
+            std::chrono::steady_clock::time_point t0 = std::chrono::steady_clock::now();
+            ops = body(iterations);
+            elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+            if(elapsed < MIN_SECONDS) iterations *= 2;
+        }
+        double rate = ops / (elapsed * 1e9);
+        if(rate > best) best = rate;
+    }
+    return best;
+}
+
+//random inputs, the same every run
+float frand() {
+    return (rand() % 2000) / 1000.0 - 1.0;
+}
+
+vec3 axes3[BATCH];
+vec4 points[BATCH];
+float angles[BATCH];
+mat4 matrices[BATCH];
+Quaternion quats[BATCH];
+vec3 out3[BATCH];
+vec4 out4[BATCH];
+mat4 outm[BATCH];
+Quaternion outq[BATCH];
+
+void initInputs() {
+    srand(1);
+    for(int i = 0; i < BATCH; i++) {
+        axes3[i] = normalize(vec3(frand(), frand(), frand()) + vec3(0.0, 0.0, 2.0));
+        points[i] = vec4(frand() * 100, frand() * 100, frand() * 100, 1.0);
+        angles[i] = frand() * 180.0;
+        matrices[i] = rotateAroundAxis(axes3[i], angles[i]) * Translate(points[i]);
+        quats[i].FromAxis(axes3[i], angles[i] * DegreesToRadians);
+    }
+}
+
+std::map<std::string, double> results;
+std::map<std::string, double> baseline;
+int regressions = 0;
+
+void report( const std::string& name, double rate ) {
+    results[name] = rate;
+    printf("%-28s %10.4f ops/ns", name.c_str(), rate);
+    if(baseline.count(name)) {
+        double change = rate / baseline[name] - 1.0;
+        if(change < -NOISE) regressions++;
+        printf("   %+6.1f%%%s", change * 100.0,
+                change < -NOISE ? "  REGRESSION" : change > NOISE ? "  faster" : "");
+    }
+    printf("\n");
+}
+
+// single: feed each result into the next call
+// batch: independent calls over the input arrays
+#define BENCH(name, single, batch) \
+    report(std::string(name) + " single", measure([&](int n) -> long long { single; return n; })); \
+    report(std::string(name) + " batch", measure([&](int n) -> long long { \
+        for(int it = 0; it < n; it++) { for(int i = 0; i < BATCH; i++) { batch; } } \
+        return (long long) n * BATCH; }))
+
+void run() {
+    BENCH("rotateAroundAxis",
+        { mat4 m; float a = 1.0; for(int i = 0; i < n; i++) { m = rotateAroundAxis(axes3[i % BATCH], a); a = m[0][1]; } consume(m); },
+        { outm[i] = rotateAroundAxis(axes3[i], angles[i]); });
+    consume(outm[0]);
+
+    BENCH("Quaternion::getMatrix",
+        { Quaternion q = quats[0]; mat4 m; for(int i = 0; i < n; i++) { m = q.getMatrix(); q = Quaternion(m[0][1], m[0][2], m[1][2], m[1][1]); } consume(m); },
+        { outm[i] = quats[i].getMatrix(); });
+    consume(outm[0]);
+
+    BENCH("Quaternion::operator*",
+        { Quaternion q = quats[0]; for(int i = 0; i < n; i++) { q = q * quats[i % BATCH]; } consume(q.getMatrix()); },
+        { outq[i] = quats[i ^ 1] * quats[i]; });
+    consume(outq[0].getMatrix());
+
+    BENCH("mat4::operator*(mat4)",
+        { mat4 m = matrices[0]; for(int i = 0; i < n; i++) { m = m * matrices[i % BATCH]; } consume(m); },
+        { outm[i] = matrices[i] * matrices[(i + 1) % BATCH]; });
+    consume(outm[0]);
+
+    BENCH("mat4::operator*=(mat4)",
+        { mat4 m = matrices[0]; for(int i = 0; i < n; i++) { m *= matrices[i % BATCH]; } consume(m); },
+        { outm[i] = matrices[i]; outm[i] *= matrices[(i + 1) % BATCH]; });
+    consume(outm[0]);
+
+    BENCH("mat4::operator*(vec4)",
+        { vec4 v = points[0]; for(int i = 0; i < n; i++) { v = matrices[i % BATCH] * v; } consume(v); },
+        { out4[i] = matrices[i] * points[i]; });
+    consume(out4[0]);
+
+    BENCH("LookAt",
+        { mat4 m; vec4 eye = points[0]; for(int i = 0; i < n; i++) { m = LookAt(eye, points[i % BATCH], vec4(0.0,1.0,0.0,0.0)); eye.x = m[0][3]; } consume(m); },
+        { outm[i] = LookAt(points[i], points[(i + 1) % BATCH], vec4(0.0,1.0,0.0,0.0)); });
+    consume(outm[0]);
+
+    BENCH("Perspective",
+        { mat4 m; float fov = 75.0; for(int i = 0; i < n; i++) { m = Perspective(fov, 16.0/9.0, 0.1, 250.0); fov = 60.0 + m[0][0]; } consume(m); },
+        { outm[i] = Perspective(angles[i] * 0.1 + 60.0, 16.0/9.0, 0.1, 250.0); });
+    consume(outm[0]);
+
+    BENCH("normalize(vec3)",
+        { vec3 v = axes3[0]; for(int i = 0; i < n; i++) { v = normalize(v + axes3[i % BATCH]); } consume(v); },
+        { out3[i] = normalize(axes3[i] + vec3(1.0, 0.0, 0.0)); });
+    consume(out3[0]);
+
+    BENCH("normalize(vec4)",
+        { vec4 v = points[0]; for(int i = 0; i < n; i++) { v = normalize(v + points[i % BATCH]); } consume(v); },
+        { out4[i] = normalize(points[i]); });
+    consume(out4[0]);
+
+    BENCH("cross(vec3)",
+        { vec3 v = axes3[0]; for(int i = 0; i < n; i++) { v = cross(v, axes3[i % BATCH]) + axes3[i % BATCH]; } consume(v); },
+        { out3[i] = cross(axes3[i], axes3[(i + 1) % BATCH]); });
+    consume(out3[0]);
+
+    BENCH("cross(vec4)",
+        { vec4 v = points[0]; for(int i = 0; i < n; i++) { v = points[i % BATCH] + vec4(cross(v, points[i % BATCH]) * 1e-4, 0.0); } consume(v); },
+        { out3[i] = cross(points[i], points[(i + 1) % BATCH]); });
+    consume(out3[0]);
+
+    //the chain every satellite runs per frame in Satellite::render()
+    BENCH("satellite transform",
+        { mat4 m = matrices[0]; for(int i = 0; i < n; i++) { int k = i % BATCH;
+            m *= Translate(0.0, 0.0, 0.0); m *= rotateAroundAxis(axes3[k], angles[k]);
+            m *= matrices[k]; m *= Translate(10.0, 0.0, 0.0); } consume(m); },
+        { mat4 m = matrices[(i + 7) % BATCH]; m *= Translate(0.0, 0.0, 0.0); m *= rotateAroundAxis(axes3[i], angles[i]);
+            m *= matrices[i]; m *= Translate(10.0, 0.0, 0.0); outm[i] = m * Scale(2.0, 2.0, 2.0); });
+    consume(outm[0]);
+}
+
+bool readBaseline( const char* filename ) {
+    FILE* fp = fopen(filename, "r");
+    if(fp == NULL) return false;
+    char line[256];
+    while(fgets(line, sizeof(line), fp)) {
+        if(line[0] == '#') continue;
+        //names have spaces in them, the rate is the last field
+        char* last = strrchr(line, ' ');
+        if(last == NULL) continue;
+        double rate = atof(last + 1);
+        while(last > line && *last == ' ') last--;
+        baseline[std::string(line, last + 1 - line)] = rate;
+    }
+    fclose(fp);
+    return true;
+}
+
+bool writeBaseline( const char* filename ) {
+    FILE* fp = fopen(filename, "w");
+    if(fp == NULL) return false;
+    fprintf(fp, "# bench_math baseline, ops/ns (higher is better)\n");
+    for(std::map<std::string, double>::iterator i = results.begin(); i != results.end(); ++i) {
+        fprintf(fp, "%s %.6f\n", i->first.c_str(), i->second);
+    }
+    fclose(fp);
+    return true;
+}
+
+int main(int argc, char** argv)
+{
+    const char* write = NULL;
+    for(int i = 1; i < argc; i++) {
+        if(strcmp(argv[i], "--write") == 0 && i + 1 < argc) {
+            write = argv[++i];
+        } else if(access(argv[i], F_OK) != 0 && write == NULL) {
+            printf("no baseline at %s yet, this run will be it\n", argv[i]);
+            write = argv[i];
+        } else if(!readBaseline(argv[i])) {
+            fprintf(stderr, "Failed to read baseline %s\n", argv[i]);
+            return 1;
+        }
+    }
+    initInputs();
+    run();
+    if(write != NULL) {
+        if(!writeBaseline(write)) {
+            fprintf(stderr, "Failed to write %s\n", write);
+            return 1;
+        }
+        printf("baseline written to %s\n", write);
+    }
+    if(regressions > 0) {
+        printf("%d regressions of more than %.0f%%\n", regressions, NOISE * 100.0);
+        return 2;
+    }
+    return 0;
+}
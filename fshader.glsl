@@ -1,33 +1,107 @@
-#version 120
+#version 130
 uniform int renderType;
 
 // per-fragment interpolated values from the vertex shader
 varying  vec3 fN;
-varying  vec3 fL;
 varying  vec3 fV;
+varying  vec3 fP;
+varying  vec4 fClip;
+varying vec3 fObject;
 
 uniform float shininess, ambientAmt, diffuseAmt, specularAmt;
 varying vec4 fColor;
 
+//clustered lights (see LightClusters.h)
+uniform sampler2D lightTex;
+uniform sampler2D clusterTex;
+uniform sampler2D indexTex;
+uniform ivec3 clusterSize;
+uniform vec2 clusterDepth;
+
+//find the offset/count of the cluster containing this fragment
+vec2 cluster()
+{
+    ivec2 tile = ivec2(clamp((fClip.xy / fClip.w * 0.5 + 0.5) * vec2(clusterSize.xy),
+                vec2(0.0), vec2(clusterSize.xy - 1)));
+    int slice = int(clamp(log(fClip.w / clusterDepth.x) / clusterDepth.y * float(clusterSize.z),
+                0.0, float(clusterSize.z - 1)));
+    return texelFetch(clusterTex, ivec2(tile.y * clusterSize.x + tile.x, slice), 0).rg;
+}
+
+//virtual textures (see VirtualTexture.h)
+uniform int textured;
+uniform sampler2D atlas;
+uniform sampler2D pageTable;
+//slot side, border and tile size in texels, then the atlas side
+uniform vec4 atlasTile;
+//tiles along a side of level 0, and how many levels
+uniform float virtualTiles;
+uniform int virtualLevels;
+
+//where on the texture this fragment is (longitude across, latitude down) and the mip level it wants
+//fshaderfeedback.glsl works it out the same way
+vec3 virtualCoord()
+{
+    vec3 d = normalize(fObject);
+    float u = atan(d.z, d.x) / 6.2831853 + 0.5;
+    float v = acos(clamp(d.y, -1.0, 1.0)) / 3.1415927;
+    //u jumps from 1 back to 0 at the seam, take its derivative from a copy that doesn't there
+    float du = min(fwidth(u), fwidth(fract(u + 0.5)));
+    float lod = log2(max(max(du, fwidth(v)) * virtualTiles * atlasTile.z, 1e-6));
+    return vec3(min(vec2(u, v), vec2(0.99999)), lod);
+}
+
+//the color of the finest tile resident for this fragment
+vec4 virtualTexel()
+{
+    vec3 c = virtualCoord();
+    int level = int(clamp(floor(c.z), 0.0, float(virtualLevels - 1)));
+    ivec2 tile = ivec2(c.xy * float(int(virtualTiles) >> level));
+    //slot x and y, and the level the tile in it is really from, coarser while the one wanted loads
+    vec4 page = texelFetch(pageTable, tile, level) * 255.0;
+    float tiles = float(int(virtualTiles) >> int(page.z + 0.5));
+    vec2 texel = page.xy * atlasTile.x + atlasTile.y + fract(c.xy * tiles) * atlasTile.z;
+    return texture(atlas, texel / atlasTile.w);
+}
+
 void main() 
 { 
+    //the body's own color, times its texture if it has one
+    vec4 base = fColor;
+    if(textured == 1)
+        base *= virtualTexel();
+
     //no or Gouraud Shading
     if(renderType == -1 || renderType == 1 || renderType == 3)
-        gl_FragColor = fColor;
+        gl_FragColor = base;
     //Smooth or Phong Shading
     else if(renderType == 0 || renderType == 2){
         vec3 N,V,L,H;
 
         N = normalize(fN);
         V = normalize(fV);
-        L = normalize(fL);
-        H = normalize(L + V);
-
-        vec4 ambient = ambientAmt*fColor;
-        vec4 diffuse = max(dot(L,N),0.0)*diffuseAmt*fColor;
-        vec4 specular = pow(max(dot(N,H),0.0),shininess)*specularAmt*vec4(1.0,1.0,1.0,1.0);
-        if(dot(L,N) < 0.0){
-            specular = vec4(0.0,0.0,0.0,1.0);
+
+        vec4 ambient = ambientAmt*base;
+        vec4 diffuse = vec4(0.0);
+        vec4 specular = vec4(0.0);
+
+        //only the lights binned into this fragment's cluster
+        vec2 c = cluster();
+        for(int i = 0; i < int(c.y); i++) {
+            int index = int(c.x) + i;
+            int l = int(texelFetch(indexTex, ivec2(index % LIGHT_INDEX_WIDTH, index / LIGHT_INDEX_WIDTH), 0).r);
+            vec4 light = texelFetch(lightTex, ivec2(l, 0), 0);
+            vec4 color = texelFetch(lightTex, ivec2(l, 1), 0);
+            L = light.xyz - fP;
+            //smooth falloff to zero at the light's range
+            float atten = clamp(1.0 - pow(length(L) / light.w, 4.0), 0.0, 1.0);
+            atten *= atten * color.w;
+            L = normalize(L);
+            H = normalize(L + V);
+            diffuse += atten*max(dot(L,N),0.0)*diffuseAmt*base*color;
+            if(dot(L,N) >= 0.0){
+                specular += atten*pow(max(dot(N,H),0.0),shininess)*specularAmt*color;
+            }
         }
         gl_FragColor = ambient + diffuse + specular;
         gl_FragColor.a = 1.0;
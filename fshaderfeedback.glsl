@@ -0,0 +1,32 @@
+#version 130
+
+//which tile of which virtual texture every fragment wants (see VirtualTexture.h)
+varying vec3 fObject;
+
+uniform float virtualTiles;
+uniform int virtualLevels;
+uniform int virtualTexture;
+//slot side, border and tile size in texels, then the atlas side
+uniform vec4 atlasTile;
+//this pass is drawn smaller, its derivatives are this many levels bigger
+uniform float lodBias;
+
+//the same as in fshader.glsl
+vec3 virtualCoord()
+{
+    vec3 d = normalize(fObject);
+    float u = atan(d.z, d.x) / 6.2831853 + 0.5;
+    float v = acos(clamp(d.y, -1.0, 1.0)) / 3.1415927;
+    float du = min(fwidth(u), fwidth(fract(u + 0.5)));
+    float lod = log2(max(max(du, fwidth(v)) * virtualTiles * atlasTile.z, 1e-6));
+    return vec3(min(vec2(u, v), vec2(0.99999)), lod);
+}
+
+void main()
+{
+    vec3 c = virtualCoord();
+    int level = int(clamp(floor(c.z - lodBias), 0.0, float(virtualLevels - 1)));
+    ivec2 tile = ivec2(c.xy * float(int(virtualTiles) >> level));
+    //read back as bytes: tile x, tile y, level, texture + 1 (0 is nothing)
+    gl_FragColor = vec4(vec3(tile, level), virtualTexture + 1) / 255.0;
+}
@@ -0,0 +1,78 @@
+#version 130
+#extension GL_ARB_uniform_buffer_object : require
+//ray cast a sphere in view space (eye at the origin)
+varying vec3 fRay;
+varying vec3 fCenter;
+varying float fRadius;
+varying vec4 fColor;
+varying vec4 fMaterial;
+//same block as vshader.glsl
+layout(std140, row_major) uniform Camera {
+    mat4 camera_view;
+    mat4 projection_view;
+    vec4 cameraEye;
+};
+
+//clustered lights (see LightClusters.h)
+uniform sampler2D lightTex;
+uniform sampler2D clusterTex;
+uniform sampler2D indexTex;
+uniform ivec3 clusterSize;
+uniform vec2 clusterDepth;
+
+//find the offset/count of the cluster containing a clip space position
+vec2 cluster(vec4 clip)
+{
+    ivec2 tile = ivec2(clamp((clip.xy / clip.w * 0.5 + 0.5) * vec2(clusterSize.xy),
+                vec2(0.0), vec2(clusterSize.xy - 1)));
+    int slice = int(clamp(log(clip.w / clusterDepth.x) / clusterDepth.y * float(clusterSize.z),
+                0.0, float(clusterSize.z - 1)));
+    return texelFetch(clusterTex, ivec2(tile.y * clusterSize.x + tile.x, slice), 0).rg;
+}
+
+void main()
+{
+    //intersect the eye ray with the sphere, miss = outside the silhouette
+    vec3 D = normalize(fRay);
+    float b = dot(D, fCenter);
+    float h = b*b - dot(fCenter,fCenter) + fRadius*fRadius;
+    if(h < 0.0)
+        discard;
+    vec3 P = D * (b - sqrt(h));
+    vec4 clip = projection_view * vec4(P,1.0);
+    gl_FragDepth = (clip.z / clip.w) * 0.5 + 0.5;
+
+    float ambientAmt = fMaterial.x;
+    float diffuseAmt = fMaterial.y;
+    float specularAmt = fMaterial.z;
+    float shininess = fMaterial.w;
+    vec3 N,V,L,H;
+    N = (P - fCenter) / fRadius;
+    V = normalize(-P);
+
+    vec4 ambient = ambientAmt*fColor;
+    vec4 diffuse = vec4(0.0);
+    vec4 specular = vec4(0.0);
+
+    //only the lights binned into this fragment's cluster
+    vec2 c = cluster(clip);
+    for(int i = 0; i < int(c.y); i++) {
+        int index = int(c.x) + i;
+        int l = int(texelFetch(indexTex, ivec2(index % LIGHT_INDEX_WIDTH, index / LIGHT_INDEX_WIDTH), 0).r);
+        vec4 light = texelFetch(lightTex, ivec2(l, 0), 0);
+        vec4 color = texelFetch(lightTex, ivec2(l, 1), 0);
+        //lights are kept in world space
+        L = (camera_view * vec4(light.xyz,1.0)).xyz - P;
+        //smooth falloff to zero at the light's range
+        float atten = clamp(1.0 - pow(length(L) / light.w, 4.0), 0.0, 1.0);
+        atten *= atten * color.w;
+        L = normalize(L);
+        H = normalize(L + V);
+        diffuse += atten*max(dot(L,N),0.0)*diffuseAmt*fColor*color;
+        if(dot(L,N) >= 0.0){
+            specular += atten*pow(max(dot(N,H),0.0),shininess)*specularAmt*color;
+        }
+    }
+    gl_FragColor = ambient + diffuse + specular;
+    gl_FragColor.a = 1.0;
+}
@@ -9,12 +9,32 @@
 #include <assert.h>
 #include <math.h>
 #include <vector>
+#include <algorithm>
 #include <string>
+#include <string.h>
 #include <sstream>
+#include <atomic>
+#include <thread>
+#include <chrono>
 
 //file needed for vector arrays
 #include "Angel.h"
 #include "Quaternion.h"
+#include "LightClusters.h"
+#include "GpuProfiler.h"
+#include "Profiler.h"
+#include "Benchmark.h"
+#include "Arena.h"
+#include "Bvh.h"
+#include "Collisions.h"
+#include "Scene.h"
+#include "Timeline.h"
+#include "SharedBodies.h"
+#include "TripleBuffer.h"
+#include "MpscQueue.h"
+#include "Shards.h"
+#include "Jobs.h"
+#include "VirtualTexture.h"
 
 //include openGL files based on OS
 #if defined(__APPLE__)
@@ -27,21 +47,62 @@
 #include <GL/glut.h>
 #endif
 
+//scene settings, all of these can be set from the command line
 //how many points make up a single trajectory
-const int TRAJECTORY_SIZE = 32;
+int trajectorySize = 32;
 //the number of stars to generate
-const int NUM_STARS = 10000;
+int numStars = 10000;
+//the stars are derived in the vertex shader from gl_VertexID unless this is set (--star-vbo),
+//then they're generated here and uploaded like before. the shader draws one random number
+//for all of them, so the same seed makes a different galaxy in each mode
+bool starVbo = false;
+//stars closer than this (manhattan distance) to the origin are moved away
+const float STAR_EXCLUSION = 200.0;
 //number of solar systems to generate
-const int NUM_SOLAR_SYSTEMS = 24;
+int numSolarSystems = 24;
+//how deep moons of the random systems nest, 1 = moons never have moons of their own
+int moonDepth = 1;
 //dimensions of space
-const int SPACE_X = 3000;
-const int SPACE_Y = 3000;
-const int SPACE_Z = 3000;
+int spaceX = 3000;
+int spaceY = 3000;
+int spaceZ = 3000;
+//projection settings
+const float ASPECT_RATIO = 16.0/9.0;
+const float Z_NEAR = 0.1;
+const float Z_FAR = 250.0;
+//how far past its outermost orbit a sun still lights things
+const float LIGHT_RANGE_SCALE = 1.5;
+//where the 'p' key dumps the gpu timings
+const char* const GPU_PROFILE_FILE = "gpu_profile.txt";
+//where the 'c' key (or --trace) writes a cpu capture, and how many frames it covers
+const char* const CPU_TRACE_FILE = "cpu_trace.json";
+const int CPU_TRACE_FRAMES = 120;
+//frames at the start of a benchmark that don't count towards the results
+const int BENCHMARK_WARMUP = 10;
+//bodies smaller than this on screen (diameter in pixels) are drawn as impostors
+const float IMPOSTOR_PIXELS = 16.0;
+//how much further out than the far plane, or than where it shrinks to one impostor,
+//a system has to be before the simulation stops placing its bodies
+const float SYSTEM_SIM_MARGIN = 1.5;
+
+//how a body picks between its sphere mesh and a ray cast impostor
+enum { IMPOSTOR_AUTO, IMPOSTOR_ALWAYS, IMPOSTOR_NEVER };
+//what a body ends up as on screen this frame
+enum { VISIBLE_CULLED, VISIBLE_IMPOSTOR, VISIBLE_MESH };
+//what a whole solar system ends up as on screen this frame
+enum { SYSTEM_CULLED, SYSTEM_AGGREGATE, SYSTEM_BODIES };
 
 //the programs for the set of shaders
 GLuint planetsProgram;
 GLuint starsProgram;
 GLuint textProgram;
+GLuint impostorProgram;
+GLuint feedbackProgram;
+//the programs as startup compiles them, see programFiles
+enum { PROGRAM_PLANETS, PROGRAM_STARS, PROGRAM_TEXT, PROGRAM_IMPOSTOR, PROGRAM_FEEDBACK, PROGRAM_COUNT };
+//linked and set up, anything drawn with a program that isn't yet is skipped
+//(impostors are drawn as meshes until theirs is)
+bool programReady[PROGRAM_COUNT];
 
 //prev x,y locations for mouse
 int prevX;
@@ -52,9 +113,9 @@ float yLoc;
 float zLoc;
 float zRot;
 float yRot;
-//whether or not to animate things
-bool spinning;
-//the camera (planet) we are attached to
+//whether or not to animate things, input flips it and the simulation reads it
+std::atomic<bool> spinning;
+//the body (planet) the camera is attached to, -1 for none
 int camera;
 //if we are staring at the sun
 bool staring;
@@ -64,6 +125,101 @@ bool drawTrajectories;
 bool drawAxes;
 //the field of view
 float fov;
+//draw small/distant bodies as impostors
+bool useImpostors;
+//whole systems smaller than this on screen (diameter in pixels) are drawn as one impostor, 0 = never
+float systemLodPixels = 24.0;
+//megabytes the planet textures may hold on to, 0 = draw them flat
+int textureMB = 16;
+//size of the window
+int windowWidth = 1280;
+int windowHeight = 720;
+
+//what went into the current frame, reset every frame
+struct FrameStats {
+    int drawCalls;
+    int meshes;
+    int impostors;
+    int culled;
+    //systems drawn as one impostor, and left unplaced by the simulation
+    int aggregated;
+    int deferred;
+    //cpu time spent ticking and frustum culling, only measured while benchmarking
+    double simMs;
+    double cullMs;
+};
+FrameStats frameStats;
+
+//benchmark mode: fixed seed, scripted camera, fixed number of frames
+bool benchmarking;
+int benchmarkFrames = 1000;
+int benchmarkFrame;
+//where the results go, NULL = stdout
+const char* benchmarkOut = NULL;
+//seed for rand(), 0 = leave it unseeded like a normal run
+//benchmarks and batch runs can't be unseeded, they use 1 instead of 0
+unsigned int randomSeed = 0;
+//frames per point of a sweep, unless --frames says otherwise
+const int SWEEP_FRAMES = 120;
+//sweep mode: rerun the benchmark for each size of one setting, one csv row per size
+//the setting being swept (systems, stars or depth), NULL = no sweep
+const char* sweepAxis = NULL;
+int sweepPoint;
+//the values each setting is swept over, roughly 3x apart
+const int SWEEP_SYSTEMS[] = { 10, 30, 100, 300, 1000, 3000, 10000, 30000, 100000 };
+const int SWEEP_STARS[] = { 10000, 30000, 100000, 300000, 1000000, 3000000, 10000000 };
+const int SWEEP_DEPTHS[] = { 1, 2, 4, 8, 16, 32, 64 };
+
+//every sun's light, binned into view space clusters each frame
+LightClusters lightClusters;
+//GPU time of each render pass
+GpuProfiler gpuProfiler;
+//the planet textures, streamed in as they're seen
+VirtualTextures virtualTextures;
+//texture units the atlas and page tables go on, after the light clusters
+const int TEXTURE_UNIT = 3;
+//startup's and every frame's jobs, see Jobs.h
+JobSystem jobs;
+//worker threads for them (--jobs), -1 = one less than the cores, the caller helps out
+int jobThreads = -1;
+//every body, child list and name of the current scene, freed together on reload
+Arena sceneArena;
+//every body's bounding sphere, for picking and nearby queries
+Bvh bvh;
+//how many nearby bodies the overlay lists for the body we are riding
+const int NEARBY_BODIES = 3;
+//mouse movement (pixels) between press and release that still counts as a click
+const int CLICK_SLOP = 3;
+//finds bodies passing through each other
+CollisionGrid collisions;
+//contacts that started or ended this tick
+std::vector<ContactEvent> contactEvents;
+//the latest contact, for the overlay
+std::string lastContact;
+//when two bodies touch, the bigger one swallows the smaller
+std::atomic<bool> mergeOnContact;
+//scene file to load instead of generating one, NULL = generate
+const char* sceneFile = NULL;
+//where --save-scene writes the scene before quitting (binary for .scb), NULL = run normally
+const char* saveSceneFile = NULL;
+//what the current scene was built from, a binary scene file stays mapped here
+Scene scene;
+//the last few minutes of orbits, for scrubbing back through
+Timeline timeline;
+//megabytes the timeline may use, 0 = don't record
+int timelineMB = 64;
+//the recorded tick on screen while scrubbing, -1 = live
+int playhead = -1;
+//ticks the { and } keys jump
+const int SCRUB_JUMP = 60;
+//ticks simulated since the scene was built, the tick on screen while scrubbing
+unsigned long long simTicks;
+//shared memory other processes can read every body's position from, see SharedBodies.h
+SharedBodiesWriter sharedBodies;
+//the name it's published under (--export), NULL = don't publish
+const char* exportName = NULL;
+//the name --export uses when it isn't given one
+const char* const DEFAULT_EXPORT_NAME = "/solarsystem";
 
 //the origin of main solar system
 vec4 origin(10.0,10.0,10.0,1.0);
@@ -73,6 +229,13 @@ GLuint spheres[8];
 GLuint circle;
 GLuint axes;
 GLuint stars;
+//buffer behind stars when they aren't procedural
+GLuint starBuffer;
+GLuint impostorQuads;
+//buffer holding the impostor instances for this frame
+GLuint impostorBuffer;
+//seed for the procedural starfield
+int starSeed;
 
 //the number of vertcies for our spheres
 int sphereVertices[8];
@@ -91,33 +254,10 @@ void setDefaults() {
     drawTrajectories = true;
     drawAxes = true;
     fov = 75.0;
+    useImpostors = true;
+    mergeOnContact = false;
 }
 
-// Matrix stack that can be used to push and pop the modelview matrix.
-class MatrixStack {
-    int    _index;
-    int    _size;
-    mat4*  _matrices;
-
-    public:
-    MatrixStack( int numMatrices = 32 ):_index(0), _size(numMatrices)
-    { _matrices = new mat4[numMatrices]; }
-
-    ~MatrixStack()
-    { delete[]_matrices; }
-
-    void push( const mat4& m ) {
-        assert( _index + 1 < _size );
-        _matrices[_index++] = m;
-    }
-
-    mat4& pop( void ) {
-        assert( _index - 1 >= 0 );
-        _index--;
-        return _matrices[_index];
-    }
-};
-
 // RGBA colors
 vec4 colors[8] = {
     vec4( 1.0, 1.0, 1.0, 1.0 ),  // white
@@ -130,51 +270,130 @@ vec4 colors[8] = {
     vec4( 0.0, 0.0, 0.0, 1.0 )   // black
 };
 
-//the model view stack
-MatrixStack mvstack;
-//the model view matrix
-mat4 model_view;
 //location of model view in planetsProgram
 GLuint mloc;
 //the camera view matrix
 mat4 camera_view;
-//location of camera view in planetsProgram
-GLuint cloc;
-//location of camera view in starsProgram
-GLuint clocs;
 //the projection view matrix
 mat4 projection_view;
-//the location of projection in planetsProgram
-GLuint ploc;
-//the location of projection in starsProgram
-GLuint plocs;
-//the location of camera position in planetsProgram
-GLuint cploc;
+//where the camera is, for the specular highlights too
+vec4 cameraEye;
 //the location of the rendertype in planetsProgram
 GLuint rtloc;
 
-//generate a rotation mat4 matrix around a given vec3 axis and degree in radians
-mat4 rotateAroundAxis(vec3 axis, const float theta) {
-    Quaternion q;
-    GLfloat angle = DegreesToRadians * theta;
-    q.FromAxis(axis, angle);
-    return q.getMatrix();
+//the Camera uniform block the shaders share, std140 with row major matrices like mat4
+struct CameraBlock {
+    mat4 camera_view;
+    mat4 projection_view;
+    vec4 cameraEye;
+};
+//camera buffers in flight, this frame's is written while the gpu may still read the last ones
+const int CAMERA_BUFFERS = 3;
+//the uniform buffer binding Camera is read from
+const GLuint CAMERA_BINDING = 0;
+GLuint cameraBuffers[CAMERA_BUFFERS];
+int cameraBuffer;
+
+//input to swap latency (ms) of the newest LATENCY_SAMPLES input events
+const int LATENCY_SAMPLES = 1024;
+std::vector<double> latencies;
+int latencyNext;
+//input events ever measured
+long latencyCount;
+//when each input event handled this frame came in, measured once the frame is swapped
+//only the ones that changed something, the rest never show
+std::vector<double> latchedInput;
+//a redisplay is on its way, input waits for it instead of being handled straight away
+//glut draws the window once before anything else
+bool redrawPosted = true;
+
+//one ray cast sphere, laid out the way the impostor attributes read it
+struct Impostor {
+    //world center, w = radius
+    vec4 sphere;
+    vec4 color;
+    //ambient, diffuse, specular, shininess
+    vec4 material;
+};
+//impostors queued up while rendering, drawn in one batch afterwards
+std::vector<Impostor> impostors;
+
+//whether a sphere around p (in view space) is entirely outside the frustum
+//the frustum planes come straight out of projection_view so this matches what gets clipped
+bool outsideFrustum(const vec4& p, float radius) {
+    const mat4& proj = projection_view;
+    //left/right, bottom/top, near/far planes are the last row plus/minus the others
+    for(int axis = 0; axis < 3; axis++) {
+        for(int side = -1; side <= 1; side += 2) {
+            vec4 plane = proj[3] + side * proj[axis];
+            float len = sqrt(plane.x * plane.x + plane.y * plane.y + plane.z * plane.z);
+            if(len > 0 && dot(plane, p) / len < -radius) {
+                return true;
+            }
+        }
+    }
+    return false;
+}
+
+//decide if a sphere is off screen, small enough for an impostor, or needs the mesh
+int classifySphere(const vec4& center, float radius, int impostor) {
+    vec4 p = camera_view * center;
+    const mat4& proj = projection_view;
+    //clip space w, the distance everything on screen gets divided by
+    float w = dot(proj[3], p);
+    if(outsideFrustum(p, radius)) {
+        return VISIBLE_CULLED;
+    }
+    if(!useImpostors || impostor == IMPOSTOR_NEVER || !programReady[PROGRAM_IMPOSTOR]) {
+        return VISIBLE_MESH;
+    }
+    //impostors can't handle the camera inside or right up against the sphere
+    float depth = length(vec3(p.x, p.y, p.z));
+    if(depth < radius * 2.0) {
+        return VISIBLE_MESH;
+    }
+    if(impostor == IMPOSTOR_ALWAYS) {
+        return VISIBLE_IMPOSTOR;
+    }
+    //projected diameter in pixels
+    if(radius * proj[1][1] * windowHeight / w < IMPOSTOR_PIXELS) {
+        return VISIBLE_IMPOSTOR;
+    }
+    return VISIBLE_MESH;
+}
+
+//whether distant systems get drawn as one impostor each right now
+bool systemLodOn() {
+    return systemLodPixels > 0 && useImpostors && programReady[PROGRAM_IMPOSTOR];
 }
 
-//render an axis based on the current model view
-void renderAxes() {
-    //store the model_view
-    mvstack.push(model_view);
-        //scale the matrix so it is double the size of the model_view
-        model_view *= Scale(2,2,2);
+//one trajectory waiting to be drawn
+struct Trajectory {
+    mat4 model;
+    vec4 color;
+};
+//trajectories and axes queued up while rendering the satellites
+//they get drawn afterwards in their own passes so they can be timed separately
+std::vector<Trajectory> trajectoryQueue;
+std::vector<mat4> axesQueue;
+
+//queue the axes of a body drawn with model
+void renderAxes(const mat4& model) {
+    //scale the matrix so it is double the size of the body
+    axesQueue.push_back(model * Scale(2,2,2));
+}
+
+//draw all the queued axes
+void flushAxes() {
+    //push the render type (-1 = no shading)
+    glUniform1i( rtloc, -1 );
+    //bind the vertex array for axes
+    glBindVertexArray(axes);
+    //get vColor locaiton
+    GLuint loc = glGetUniformLocation(planetsProgram, "vColor");
+    for(std::vector<mat4>::iterator i = axesQueue.begin(); i != axesQueue.end(); ++i) {
         //push model_view to the gpu
-        glUniformMatrix4fv(mloc, 1, GL_TRUE, model_view);
-        //push the render type (-1 = no shading)
-        glUniform1i( rtloc, -1 );
-        //bind the vertex array for axes
-        glBindVertexArray(axes);
-        //get vColor locaiton
-        GLuint loc = glGetUniformLocation(planetsProgram, "vColor");
+        glUniformMatrix4fv(mloc, 1, GL_TRUE, *i);
         //draw the 3 lines and set colors accordingly
         //red = x axis
         //green = y axis
@@ -185,72 +404,265 @@ void renderAxes() {
         glDrawArrays(GL_LINE_LOOP,2,2);
         glUniform4fv(loc, 1, colors[6]);
         glDrawArrays(GL_LINE_LOOP,4,2);
-   //reset the model_view
-   model_view = mvstack.pop();
+        frameStats.drawCalls += 3;
+    }
 }
 
-//draw a trajectory with a radius, color, and rotated
+//queue a trajectory with a radius, color, and rotated
+//orbit is the frame of whatever it goes around
 //rotMatrix is a matrix that rotates around a given yaw and pitch
-void renderTrajectory(mat4 rotMatrix, float radius, vec4 color) {
-    //store the model view
-    mvstack.push(model_view);
-        //the following are done in reverse (because matrix math)
-        //rotate it based on the rotationMatrix
-        model_view *= rotMatrix;
-        //scale the matrix based on radius (in all directions)
-        model_view *= Scale(radius,radius,radius);
-        //get and set the color
-        GLuint loc = glGetUniformLocation(planetsProgram, "vColor");
-        glUniform4fv(loc, 1, color);
+void renderTrajectory(const mat4& orbit, mat4 rotMatrix, float radius, vec4 color) {
+    Trajectory t;
+    //the following are done in reverse (because matrix math)
+    //rotate it based on the rotationMatrix
+    //scale the matrix based on radius (in all directions)
+    t.model = orbit * rotMatrix * Scale(radius,radius,radius);
+    t.color = color;
+    trajectoryQueue.push_back(t);
+}
+
+//draw all the queued trajectories
+void flushTrajectories() {
+    GLuint loc = glGetUniformLocation(planetsProgram, "vColor");
+    //no shading
+    glUniform1i( rtloc, -1 );
+    //bind the vertex array
+    glBindVertexArray(circle);
+    for(std::vector<Trajectory>::iterator i = trajectoryQueue.begin(); i != trajectoryQueue.end(); ++i) {
+        //set the color
+        glUniform4fv(loc, 1, i->color);
         //push the model_view to gpu
-        glUniformMatrix4fv(mloc, 1, GL_TRUE, model_view);
-        //no shading
-        glUniform1i( rtloc, -1 );
-        //bind the vertex array
-        glBindVertexArray(circle);
+        glUniformMatrix4fv(mloc, 1, GL_TRUE, i->model);
         //draw it in a line loop
-        glDrawArrays(GL_LINE_LOOP,0,TRAJECTORY_SIZE);
-    //reset the model_view
-    model_view = mvstack.pop();
+        glDrawArrays(GL_LINE_LOOP,0,trajectorySize);
+        frameStats.drawCalls++;
+    }
+}
+
+class Satellite;
+//handle to a body, an index into bodies
+typedef int Body;
+
+// What changes about the bodies every frame, in dense arrays indexed by Body.
+// Ticking walks just these arrays, the orbit setup, materials and names stay
+// cold in each body's Satellite and only the render walk touches them.
+struct Bodies {
+    //rotation in orbit (degrees) and how much it turns each tick
+    std::vector<float> rot;
+    std::vector<float> rotSpeed;
+    //the axis of rotation
+    std::vector<vec3> axis;
+    //how far out the orbit is
+    std::vector<float> radius;
+    //radius of the body itself, 0 once it has been swallowed by another
+    std::vector<float> extent;
+    //world location, worked out by placeBodies() every tick anything moves
+    std::vector<vec4> loc;
+    //the rest of each body
+    std::vector<Satellite*> satellite;
+
+    Body add( Satellite* s, float rotSpeed, const vec3& axis, float radius, float extent ) {
+        rot.push_back(0.0);
+        this->rotSpeed.push_back(rotSpeed);
+        this->axis.push_back(axis);
+        this->radius.push_back(radius);
+        this->extent.push_back(extent);
+        loc.push_back(vec4(0.0,0.0,0.0,1.0));
+        satellite.push_back(s);
+        return rot.size() - 1;
+    }
+
+    int size() const {
+        return rot.size();
+    }
+
+    void clear() {
+        rot.clear();
+        rotSpeed.clear();
+        axis.clear();
+        radius.clear();
+        extent.clear();
+        loc.clear();
+        satellite.clear();
+    }
+};
+Bodies bodies;
+
+// Everything drawing a frame needs from the simulation, as of one tick.
+// The simulation fills one of these after every tick and publishes it through
+// simFrames, rendering draws the newest one it has taken and never looks at
+// bodies' per-tick arrays, so neither side waits for the other.
+struct SimFrame {
+    //the tick this is, the recorded one on screen while scrubbing
+    unsigned long long tick;
+    //per body, indexed by Body
+    std::vector<float> rot;
+    std::vector<vec4> loc;
+    std::vector<float> extent;
+    //extentVersion as of this frame
+    unsigned extentVersion;
+    //per sun, how far its system reaches from the sun's center, see updateSystemReach()
+    std::vector<float> reach;
+    //for the overlay
+    int contacts;
+    std::string lastContact;
+    //ticks recorded, 0 if there's no recording
+    int recordedTicks;
+    size_t recordedBytes;
+    size_t rawBytes;
+    //how far behind the newest recorded tick this one is while scrubbing
+    int scrubbedBack;
+    bool scrubbing;
+    //shard worker processes still going, 0 if everything is placed in this process
+    int workers;
+    //systems too far from the camera to be placed this tick, they keep where they last were
+    int deferred;
+};
+//from the simulation to rendering
+TripleBuffer<SimFrame> simFrames;
+//the frame being drawn (and clicked on), taken at the start of every display
+const SimFrame* shown;
+
+//the camera as of the last frame drawn, what the simulation decides which systems to place by
+struct SimView {
+    vec4 eye;
+    //projected diameter in pixels of a unit sphere a unit away, 0 before anything is drawn
+    float pixels;
+    //systemLodPixels, 0 while systems aren't being drawn as one impostor
+    float lodPixels;
+};
+//from rendering to the simulation
+TripleBuffer<SimView> simViews;
+
+//what drawing the shown frame works out for each body, indexed by Body
+//each system's jobs only ever write the entries of its own bodies
+struct DrawBodies {
+    //model view of the sphere, scaled to its size
+    std::vector<mat4> model;
+    //model view of the frame it orbits in, for its trajectory
+    std::vector<mat4> orbit;
+    //VISIBLE_CULLED, VISIBLE_IMPOSTOR or VISIBLE_MESH
+    std::vector<int> visibility;
+};
+DrawBodies drawBodies;
+
+//where a body is drawn this frame, the translation of its model view
+//the same place the simulation puts it, even in the systems it's leaving unplaced
+vec4 drawnAt(Body b) {
+    const mat4& m = drawBodies.model[b];
+    return vec4(m[0][3], m[1][3], m[2][3], 1.0);
+}
+
+//the same for each system, indexed like suns
+struct DrawSystems {
+    //SYSTEM_CULLED, SYSTEM_AGGREGATE or SYSTEM_BODIES
+    std::vector<int> lod;
+    //what a system is drawn as when it's SYSTEM_AGGREGATE, made with the frame graph
+    //and again when a frame comes with other extents than the ones it was made from
+    std::vector<Impostor> aggregate;
+    unsigned extentVersion;
+};
+DrawSystems drawSystems;
+
+//what input asks the simulation to do, applied at the start of its next tick
+enum { SIM_SPEED, SIM_SCRUB };
+struct SimCommand {
+    int kind;
+    //SIM_SPEED: the body and how much faster it should go
+    //SIM_SCRUB: how many ticks to move the playhead
+    Body body;
+    float amount;
+};
+//commands waiting for the next tick, more than a tick's worth of input ever needs
+const int SIM_COMMANDS = 1024;
+MpscQueue<SimCommand, SIM_COMMANDS> simCommands;
+
+//queue up a command for the simulation, dropped if it's somehow this far behind
+void simCommand(int kind, Body body, float amount) {
+    SimCommand c = { kind, body, amount };
+    simCommands.push(c);
+}
+
+//shard worker processes placing the solar systems (--workers), 0 = all in this process
+int shardWorkers = 0;
+ShardPool shards;
+//what started us, the workers run it again
+const char* programName = "solarsystem";
+//index, input and output descriptors when this process is one of the workers (--shard-worker)
+char** shardWorkerArgs = NULL;
+//the bodies of each sun's system, what a shard worker copies angles in and positions out for
+//and what the frame's jobs for that system go through, see collectSystems()
+std::vector< std::vector<Body> > sunBodies;
+//how far each sun's system reaches from the sun's center, the simulation's and every frame's
+//worked out again for a new scene, and when bodies merge since that grows the bigger one
+std::vector<float> systemReach;
+bool reachStale;
+//counts the ticks a body's extent changed in, so rendering can tell its frames have new ones
+unsigned extentVersion;
+//systems placeBodies() places this tick, and the ones whose angles moved since they last were
+//(too far from the camera to matter while they stay that way)
+std::vector<char> systemPlacing;
+std::vector<char> systemUnplaced;
+int deferredSystems;
+
+//input as it comes in from glut, applied by handleInput() at the start of the next frame
+enum { INPUT_KEY, INPUT_SPECIAL, INPUT_MOUSE, INPUT_MOTION, INPUT_PASSIVE };
+struct InputEvent {
+    int kind;
+    //milliseconds() when it came in
+    double time;
+    //the key, special key or mouse button, and whether the button went up or down
+    int key;
+    int state;
+    //where the mouse was
+    int x;
+    int y;
+};
+//events waiting for the next frame, a frame's worth of mouse moves fits many times over
+const int INPUT_EVENTS = 4096;
+MpscQueue<InputEvent, INPUT_EVENTS> inputQueue;
+//where --record-input writes every event as it's applied, NULL = don't
+const char* inputLogFile = NULL;
+FILE* inputLog;
+
+//stamp an event and queue it up, safe from any thread
+void queueInput(int kind, int key, int state, int x, int y) {
+    InputEvent e = { kind, milliseconds(), key, state, x, y };
+    inputQueue.push(e);
 }
 
 class Satellite {
     private:
-        //rotation in orbit (degrees)
-        float rot;
-        //the axis of rotation
-        vec3 axis;
+        //our slot in bodies
+        Body body;
         //the rotation matrix to offset the orbit (orthagonal to the axis)
         mat4 rotMatrix;
         //the render type of this satellite
         int renderType;
-        //speeds
-        float rotSpeed;
-        //how far out orbit is
-        float radius;
         //the center of the orbit offset
         vec4 center;
         //complexity/resolution of the sphere
         int complexity;
-        //radius of the sphere
-        float size;
         vec4 color;
         float ambient;
         float diffuse;
         float specular;
         float shininess;
-        //all the child satellites
-        std::vector<Satellite*> sats;
-        //the name of the satellite
-        std::string name;
-
-        //location of the satellite
-        vec4 loc;
+        //whether to draw as an impostor (auto, always, never)
+        int impostor;
+        //the child satellites, a linked list through nextSibling
+        Satellite* firstChild;
+        Satellite* lastChild;
+        Satellite* nextSibling;
+        //the name of the satellite, lives in the scene arena
+        const char* name;
+        //its material's virtual texture, -1 for none
+        int texture;
 
     public:
         Satellite( float rotHoriz, float rotVert, float rotSpeed, float radius,
                 vec4 center, int complexity, float size, vec4 color, int renderType,
-                float ambient, float diffuse, float specular, float shininess, std::string name ) {
+                float ambient, float diffuse, float specular, float shininess, const char* name ) {
             //generate the rotation matrix and the axis of rotation
             //kinda tricky math hard to explain
             Quaternion q1;
@@ -259,28 +671,26 @@ class Satellite {
             q2.FromAxis(vec3(0.0,1.0,0.0),DegreesToRadians * rotHoriz);
             this->rotMatrix = (q1 * q2).getMatrix();
             vec4 y = this->rotMatrix * vec4(0.0,1.0,0.0,0.0);
-            this->axis = vec3(y.x,y.y,y.z);
-            this->rot = 0;
-            this->rotSpeed = rotSpeed;
-            this->radius = radius;
+            this->body = bodies.add(this, rotSpeed, vec3(y.x,y.y,y.z), radius, size);
             this->center = center;
             this->complexity = complexity;
-            this->size = size;
             this->color = color;
             this->renderType = renderType;
             this->ambient = ambient;
             this->diffuse = diffuse;
             this->specular = specular;
             this->shininess = shininess;
-            this->name = name;
-            this->loc = vec4(0.0,0.0,0.0,1.0);
+            this->name = sceneArena.copy(name);
+            this->firstChild = this->lastChild = this->nextSibling = NULL;
+            this->impostor = IMPOSTOR_AUTO;
+            this->texture = -1;
         }
 
-        //return a string of the stats for our planet
-        std::string getStats() {
+        //return a string of the stats for our planet, loc is where it is
+        std::string getStats( const vec4& loc ) {
             std::ostringstream stats;
             stats << this->name << std::endl;
-            stats << "Location: " << this->loc.x << ", " << this->loc.y << ", " << this->loc.z << std::endl;
+            stats << "Location: " << loc.x << ", " << loc.y << ", " << loc.z << std::endl;
             stats << "Shading type: ";
             switch(this->renderType) {
                 case 0:
@@ -298,17 +708,20 @@ class Satellite {
 
         //add a satellite to our planet
         void addSatellite( Satellite* sat ) {
-            sats.push_back(sat);
+            if(lastChild == NULL) {
+                firstChild = sat;
+            } else {
+                lastChild->nextSibling = sat;
+            }
+            lastChild = sat;
         }
 
-        //if we are spinning, update the rotation and all the child satellites rotations
-        void tick() {
-            if(spinning) {
-                this->rot += this->rotSpeed;
-                for(std::vector<Satellite*>::iterator i = sats.begin(); i != sats.end(); ++i) {
-                    (*i)->tick();
-                }
-            }
+        Body getBody() {
+            return this->body;
+        }
+
+        const char* getName() {
+            return this->name;
         }
 
         //return the center of our satellite
@@ -317,71 +730,191 @@ class Satellite {
             return this->center;
         }
 
-        //increase the speed of rotaiton
-        void increaseSpeed( float speed ) {
-            this->rotSpeed += speed;
-        }
-
-        //return the angle of this planet
-        float getAngle() {
-            return this->rot;
-        }
-
-        vec4 getCamera() {
-            //return the location plus a little bit more so we are above planet
-            return this->loc+vec4(0,this->size*2,0,1.0);
-        }
-
-        void render() {
-            //just set our loc to be 0 for now
-            this->loc = vec4(0.0,0.0,0.0,1.0);
-            mvstack.push(model_view);
-                //draw trajectories if we enabled
-                //at this time there should be nothing modified to the model_view
-                //so we are basically drawing the trajectory centered on the parent satellite
-                if(drawTrajectories) {
-                    renderTrajectory(this->rotMatrix, this->radius, this->color);
-                }
-                //these are "computed" in reverse becausee of matrix math
-                //offset of the orbit
-                model_view *= Translate(center.x,center.y,center.z);
-                //rotate it around our axis of rotation
-                model_view *= rotateAroundAxis(axis, rot);
-                //rotate it into the orbit
-                model_view *= this->rotMatrix;
-                //translate it out of the radius of the orbit
-                model_view *= Translate(this->radius,0,0);
-                //render each child satellite with our modified model_view
-                for(std::vector<Satellite*>::iterator i = this->sats.begin(); i != this->sats.end(); ++i) {
-                    (*i)->render();
-                }
-                //store the location
-                this->loc = model_view * this->loc;
-                //scale the planet
-                model_view *= Scale(this->size,this->size,this->size);
-                //push planet properties
-                glUniform1f( glGetUniformLocation(planetsProgram, "shininess"), this->shininess );
-                glUniform1f( glGetUniformLocation(planetsProgram, "specularAmt"), this->specular );
-                glUniform1f( glGetUniformLocation(planetsProgram, "diffuseAmt"), this->diffuse );
-                glUniform1f( glGetUniformLocation(planetsProgram, "ambientAmt"), this->ambient );
-                GLuint loc = glGetUniformLocation(planetsProgram, "vColor");
-                glUniform4fv(loc, 1, this->color);
-                //bind model view
-                glUniformMatrix4fv(mloc, 1, GL_TRUE, model_view);
-                glBindVertexArray(spheres[complexity]);
-                glUniform1i( rtloc, this->renderType );
-                glDrawArrays(GL_TRIANGLES,0,sphereVertices[complexity]);
-                //if we have axis on, draw them
-                if(drawAxes) {
-                    renderAxes();
-                }
-            model_view = mvstack.pop();
+        //how far out this satellite and everything orbiting it reaches
+        //from its own center, useful for sizing the light of the suns
+        //extent is the radius of every body
+        float getReach( const float* extent ) {
+            float reach = extent[body];
+            for(Satellite* i = firstChild; i != NULL; i = i->nextSibling) {
+                reach = fmax(reach, bodies.radius[i->body] + i->getReach(extent));
+            }
+            return reach;
+        }
+
+        //how far out this satellite and everything orbiting it can get from where it is
+        //unlike getReach() this counts the centers orbits are offset by, so it's a true bound
+        float getBound( const float* extent ) {
+            float bound = extent[body];
+            for(Satellite* i = firstChild; i != NULL; i = i->nextSibling) {
+                vec4 c = i->center;
+                bound = fmax(bound, length(vec3(c.x,c.y,c.z)) + bodies.radius[i->body] + i->getBound(extent));
+            }
+            return bound;
+        }
+
+        //one impostor standing in for this satellite and everything orbiting it, at the center of its orbit
+        //it's as big as all of them put together, colored and shaded like them weighted by area
+        Impostor aggregate( const float* extent ) {
+            Impostor sum;
+            addLook(extent, sum);
+            float area = sum.sphere.w;
+            if(area > 0) {
+                sum.color /= area;
+                sum.material /= area;
+            }
+            sum.sphere = vec4(center.x, center.y, center.z, sqrt(area));
+            return sum;
+        }
+
+        //add our area, and our color and material by area, to sum, then everything orbiting us
+        void addLook( const float* extent, Impostor& sum ) {
+            float area = extent[body] * extent[body];
+            sum.sphere.w += area;
+            sum.color += area * this->color;
+            sum.material += area * vec4(this->ambient, this->diffuse, this->specular, this->shininess);
+            for(Satellite* i = firstChild; i != NULL; i = i->nextSibling) {
+                i->addLook(extent, sum);
+            }
+        }
+
+        void setTexture( int texture ) {
+            this->texture = texture;
+        }
+
+        //choose how this satellite is drawn (auto, always, never an impostor)
+        void setImpostor( int impostor ) {
+            this->impostor = impostor;
+        }
+
+        //work out where this satellite and everything orbiting it is
+        //parent is the frame of whatever we orbit, the same transforms transform() makes
+        void place( const mat4& parent ) {
+            mat4 frame = parent * Translate(center.x,center.y,center.z)
+                * rotateAroundAxis(bodies.axis[body], bodies.rot[body])
+                * this->rotMatrix * Translate(bodies.radius[body],0,0);
+            bodies.loc[body] = frame * vec4(0.0,0.0,0.0,1.0);
+            for(Satellite* i = this->firstChild; i != NULL; i = i->nextSibling) {
+                i->place(frame);
+            }
+        }
+
+        //add our body and the bodies of everything orbiting us to out
+        void collectBodies( std::vector<Body>& out ) {
+            out.push_back(body);
+            for(Satellite* i = this->firstChild; i != NULL; i = i->nextSibling) {
+                i->collectBodies(out);
+            }
+        }
+
+        //work out the model views of this satellite and everything orbiting it as they are in frame
+        //parent is the frame of whatever we orbit, the same transforms place() makes
+        void transform( const mat4& parent, const SimFrame& frame ) {
+            float size = frame.extent[body];
+            //these are "computed" in reverse becausee of matrix math
+            //offset of the orbit, rotate it around our axis of rotation,
+            //rotate it into the orbit, and translate it out of the radius of the orbit
+            mat4 model = parent * Translate(center.x,center.y,center.z)
+                * rotateAroundAxis(bodies.axis[body], frame.rot[body])
+                * this->rotMatrix * Translate(bodies.radius[body],0,0);
+            //the trajectory is drawn centered on the parent satellite
+            drawBodies.orbit[body] = parent;
+            for(Satellite* i = this->firstChild; i != NULL; i = i->nextSibling) {
+                i->transform(model, frame);
+            }
+            //scale the planet
+            drawBodies.model[body] = model * Scale(size,size,size);
+        }
+
+        //off screen, impostor or mesh, as it is in frame, transform() comes first
+        int classify( const SimFrame& frame ) {
+            float size = frame.extent[body];
+            //swallowed bodies are gone, but still carry their moons around
+            return size > 0 ? classifySphere(drawnAt(body), size, this->impostor) : VISIBLE_CULLED;
+        }
+
+        //queue up whatever drawing this satellite takes this frame, transform() and classify() come first
+        //meshes go on meshes, impostors are all drawn together afterwards
+        void queue( const SimFrame& frame, std::vector<Body>& meshes ) {
+            int visibility = drawBodies.visibility[body];
+            //draw trajectories if we enabled
+            if(drawTrajectories) {
+                renderTrajectory(drawBodies.orbit[body], this->rotMatrix, bodies.radius[body], this->color);
+            }
+            if(visibility == VISIBLE_IMPOSTOR) {
+                vec4 loc = drawnAt(body);
+                Impostor imp;
+                imp.sphere = vec4(loc.x, loc.y, loc.z, frame.extent[body]);
+                imp.color = this->color;
+                imp.material = vec4(this->ambient, this->diffuse, this->specular, this->shininess);
+                impostors.push_back(imp);
+                frameStats.impostors++;
+            } else if(visibility == VISIBLE_MESH) {
+                meshes.push_back(body);
+                frameStats.meshes++;
+            } else {
+                frameStats.culled++;
+            }
+            //if we have axis on, draw them
+            if(drawAxes && visibility != VISIBLE_CULLED) {
+                renderAxes(drawBodies.model[body]);
+            }
+        }
+
+        //draw the mesh queue() put on the list, on the GL thread
+        void draw() {
+            //push planet properties
+            glUniform1f( glGetUniformLocation(planetsProgram, "shininess"), this->shininess );
+            glUniform1f( glGetUniformLocation(planetsProgram, "specularAmt"), this->specular );
+            glUniform1f( glGetUniformLocation(planetsProgram, "diffuseAmt"), this->diffuse );
+            glUniform1f( glGetUniformLocation(planetsProgram, "ambientAmt"), this->ambient );
+            GLuint loc = glGetUniformLocation(planetsProgram, "vColor");
+            glUniform4fv(loc, 1, this->color);
+            virtualTextures.bind(planetsProgram, this->texture);
+            //bind model view
+            glUniformMatrix4fv(mloc, 1, GL_TRUE, drawBodies.model[body]);
+            glBindVertexArray(spheres[complexity]);
+            glUniform1i( rtloc, this->renderType );
+            glDrawArrays(GL_TRIANGLES,0,sphereVertices[complexity]);
+            frameStats.drawCalls++;
+        }
+
+        //draw the mesh again into the texture feedback, if it's textured
+        void drawFeedback() {
+            if(!virtualTextures.bind(feedbackProgram, this->texture)) return;
+            glUniformMatrix4fv(glGetUniformLocation(feedbackProgram, "model_view"), 1, GL_TRUE, drawBodies.model[body]);
+            glBindVertexArray(spheres[complexity]);
+            glDrawArrays(GL_TRIANGLES,0,sphereVertices[complexity]);
+            frameStats.drawCalls++;
         }
 };
 
+//the body handle API, what the camera, overlay and controls use instead of Satellite*
+
+//these read the frame on screen
+
+//where the camera sits when riding on a body, a little above it
+vec4 bodyCamera(Body b) {
+    return shown->loc[b]+vec4(0,shown->extent[b]*2,0,1.0);
+}
+
+//the angle of a body around its orbit
+float bodyAngle(Body b) {
+    return shown->rot[b];
+}
+
+//name, location and shading of a body for the overlay
+std::string bodyStats(Body b) {
+    return bodies.satellite[b]->getStats(shown->loc[b]);
+}
+
+//increase the speed of rotaiton, from the simulation's next tick on
+void bodyIncreaseSpeed(Body b, float speed) {
+    simCommand(SIM_SPEED, b, speed);
+}
+
+//the bodies of the main solar system, what the number keys pick between
+std::vector<Body> sats;
 //all the suns
-std::vector<Satellite*> sats;
-//all the satellites
 std::vector<Satellite*> suns;
 
 void triangle(vec3 flatNormals[], vec3 normals[], vec4 points[], const vec4& a, const vec4& b, const vec4& c, int& index )
@@ -450,33 +983,63 @@ void tetrahedron( vec3 flatNormals[], vec3 normals[], vec4 points[], int count )
     divide_triangle( flatNormals, normals, points, v[0], v[2], v[3], count, index );
 }
 
-void initSphere() {
-    //bind to planets now
-    glUseProgram(planetsProgram);
-    //genreate 8 vertex arrays, one for each complexity
-    glGenVertexArrays(8, spheres);
+//the sphere meshes on the cpu, made by a startup job and let go of once they're on the gpu
+struct SphereMesh {
+    std::vector<vec4> points;
+    std::vector<vec3> normals;
+    std::vector<vec3> flatNormals;
+};
+SphereMesh sphereMeshes[8];
+GLuint sphereBuffers[8];
+
+//one mesh for each complexity
+void makeSpheres() {
+    PROFILE_ZONE("makeSpheres");
     for(int numDivisions = 0; numDivisions < 8; numDivisions++) {
         int numVertices = 3 * pow(4,numDivisions+1);
         //store the number of vertices
         sphereVertices[numDivisions] = numVertices;
 
         //generate points, flatnormals and normals
-        vec4 points[numVertices];
-        vec3 flatNormals[numVertices];
-        vec3 normals[numVertices];
-        tetrahedron(flatNormals,normals,points,numDivisions);
-
-        // Create and initialize a buffer object
-        GLuint buffer;
-        glGenBuffers( 1, &buffer );
-        glBindBuffer( GL_ARRAY_BUFFER, buffer );
-        glBufferData( GL_ARRAY_BUFFER, sizeof(points) + sizeof(normals) + sizeof(flatNormals),
-                NULL, GL_STATIC_DRAW );
-        glBufferSubData( GL_ARRAY_BUFFER, 0, sizeof(points), points );
-        glBufferSubData( GL_ARRAY_BUFFER, sizeof(points), sizeof(normals), normals );
-        glBufferSubData( GL_ARRAY_BUFFER, sizeof(points)+sizeof(normals), sizeof(flatNormals), flatNormals );
+        SphereMesh& m = sphereMeshes[numDivisions];
+        m.points.resize(numVertices);
+        m.normals.resize(numVertices);
+        m.flatNormals.resize(numVertices);
+        tetrahedron(&m.flatNormals[0],&m.normals[0],&m.points[0],numDivisions);
+    }
+}
+
+//the buffers don't need a program, so they can go up while the shaders compile
+void uploadSpheres() {
+    PROFILE_ZONE("uploadSpheres");
+    glGenBuffers( 8, sphereBuffers );
+    for(int numDivisions = 0; numDivisions < 8; numDivisions++) {
+        SphereMesh& m = sphereMeshes[numDivisions];
+        GLsizeiptr pointsSize = m.points.size() * sizeof(vec4);
+        GLsizeiptr normalsSize = m.normals.size() * sizeof(vec3);
+        glBindBuffer( GL_ARRAY_BUFFER, sphereBuffers[numDivisions] );
+        glBufferData( GL_ARRAY_BUFFER, pointsSize + 2 * normalsSize, NULL, GL_STATIC_DRAW );
+        glBufferSubData( GL_ARRAY_BUFFER, 0, pointsSize, &m.points[0] );
+        glBufferSubData( GL_ARRAY_BUFFER, pointsSize, normalsSize, &m.normals[0] );
+        glBufferSubData( GL_ARRAY_BUFFER, pointsSize + normalsSize, normalsSize, &m.flatNormals[0] );
+        m = SphereMesh();
+    }
+}
+
+//the vertex arrays, once planetsProgram has linked
+void setupSpheres() {
+    PROFILE_ZONE("setupSpheres");
+    //bind to planets now
+    glUseProgram(planetsProgram);
+    //genreate 8 vertex arrays, one for each complexity
+    glGenVertexArrays(8, spheres);
+    for(int numDivisions = 0; numDivisions < 8; numDivisions++) {
+        int numVertices = sphereVertices[numDivisions];
+        GLsizeiptr pointsSize = numVertices * sizeof(vec4);
+        GLsizeiptr normalsSize = numVertices * sizeof(vec3);
 
         glBindVertexArray(spheres[numDivisions]);
+        glBindBuffer( GL_ARRAY_BUFFER, sphereBuffers[numDivisions] );
 
         // set up vertex arrays
         GLuint vPosition = glGetAttribLocation( planetsProgram, "vPosition" );
@@ -487,22 +1050,23 @@ void initSphere() {
         GLuint vNormal = glGetAttribLocation( planetsProgram, "vNormal" );
         glEnableVertexAttribArray( vNormal );
         glVertexAttribPointer( vNormal, 3, GL_FLOAT, GL_FALSE, 0,
-                BUFFER_OFFSET(sizeof(points)) );
+                BUFFER_OFFSET(pointsSize) );
 
         GLuint vFlatNormal = glGetAttribLocation( planetsProgram, "vFlatNormal" );
         glEnableVertexAttribArray( vFlatNormal );
         glVertexAttribPointer( vFlatNormal, 3, GL_FLOAT, GL_FALSE, 0,
-                BUFFER_OFFSET(sizeof(points)+sizeof(normals)) );
+                BUFFER_OFFSET(pointsSize+normalsSize) );
     }
 }
 
 void initCircle() {
+    PROFILE_ZONE("initCircle");
     //bind to planets now
     glUseProgram(planetsProgram);
-    vec4 points[TRAJECTORY_SIZE];
+    std::vector<vec4> points(trajectorySize);
     //generate the number of points around the circle
-    for(int i = 0; i<TRAJECTORY_SIZE;i++) {
-            float angle = 2.0f * M_PI * i / (float) TRAJECTORY_SIZE;
+    for(int i = 0; i<trajectorySize;i++) {
+            float angle = 2.0f * M_PI * i / (float) trajectorySize;
             points[i].x = cos(angle);
             points[i].z = sin(angle);
             points[i].w = 1.0;
@@ -510,7 +1074,7 @@ void initCircle() {
     GLuint buffer;
     glGenBuffers( 1, &buffer );
     glBindBuffer( GL_ARRAY_BUFFER, buffer );
-    glBufferData( GL_ARRAY_BUFFER, sizeof(points), points, GL_STATIC_DRAW );
+    glBufferData( GL_ARRAY_BUFFER, points.size() * sizeof(vec4), &points[0], GL_STATIC_DRAW );
     glGenVertexArrays(1, &circle);
     glBindVertexArray(circle);
     GLuint vPosition = glGetAttribLocation( planetsProgram, "vPosition" );
@@ -519,6 +1083,7 @@ void initCircle() {
 }
 
 void initAxes() {
+    PROFILE_ZONE("initAxes");
     //bind to planets now
     glUseProgram(planetsProgram);
     vec4 points[6] = { vec4(0.0,0.0,0.0,1.0), vec4(1.0,0.0,0.0,1.0),
@@ -536,14 +1101,24 @@ void initAxes() {
     glVertexAttribPointer( vPosition, 4, GL_FLOAT, GL_FALSE, 0, BUFFER_OFFSET(0) );
 }
 
-void initStars() {
-    //bind to the correct program before initing the arrays/variables
-    //if you are not on the correct program before calling these, they will fail
-    glUseProgram(starsProgram);
-    vec4 points[NUM_STARS];
-    vec4 colors[NUM_STARS];
-    float sizes[NUM_STARS];
-    for(int i = 0;i<NUM_STARS;i++) {
+//the generated stars until uploadStars() hands them over, empty when they're procedural
+std::vector<vec4> starPoints;
+std::vector<vec4> starColors;
+std::vector<float> starSizes;
+
+//draw the stars' random numbers, before the scene's so a seed always makes the same galaxy
+void makeStars() {
+    PROFILE_ZONE("makeStars");
+    if(!starVbo) {
+        //the shader does all the work, it just needs the seed
+        starSeed = rand();
+        return;
+    }
+    //on the heap, millions of stars don't fit on the stack
+    starPoints.resize(numStars);
+    starColors.resize(numStars);
+    starSizes.resize(numStars);
+    for(int i = 0;i<numStars;i++) {
         //choose a random color
         float r = (rand() % 500) / 500.0;
         float g = (rand() % 500) / 500.0;
@@ -551,32 +1126,61 @@ void initStars() {
         //and calpha
         float a = (rand() % 500) / 500.0;
         //and x,y,z location
-        float x = (rand() % SPACE_X)-(SPACE_X/2);
-        float y = (rand() % SPACE_Y)-(SPACE_Y/2);
-        float z = (rand() % SPACE_Z)-(SPACE_Z/2);
+        float x = (rand() % spaceX)-(spaceX/2);
+        float y = (rand() % spaceY)-(spaceY/2);
+        float z = (rand() % spaceZ)-(spaceZ/2);
         //if it is near origin, try again
         //dont want it overlapping our beautiful default solar system
-        if(abs(x)+abs(y)+abs(z) < 200) {
+        if(abs(x)+abs(y)+abs(z) < STAR_EXCLUSION) {
             i--;
             continue;
         }
         //size is between 0.5-1.7
         float s = (rand() % 600)/500.0+0.5;
-        points[i] = vec4(x,y,z,1.0);
+        starPoints[i] = vec4(x,y,z,1.0);
         //switch these two to change between white/colored stars
-        //colors[i] = vec4(1.0,1.0,1.0,a);
-        colors[i] = vec4(r,g,b,a);
-        sizes[i] = s;
+        //starColors[i] = vec4(1.0,1.0,1.0,a);
+        starColors[i] = vec4(r,g,b,a);
+        starSizes[i] = s;
+    }
+}
+
+//hand the stars makeStars() made to starsProgram
+void uploadStars() {
+    PROFILE_ZONE("uploadStars");
+    //bind to the correct program before initing the arrays/variables
+    //if you are not on the correct program before calling these, they will fail
+    glUseProgram(starsProgram);
+    if(!starVbo) {
+        //just the seed and the bounds
+        glUniform1i( glGetUniformLocation(starsProgram, "seed"), starSeed );
+        glUniform3f( glGetUniformLocation(starsProgram, "space"), spaceX, spaceY, spaceZ );
+        glUniform1f( glGetUniformLocation(starsProgram, "exclusion"), STAR_EXCLUSION );
+        //no attributes, but a vertex array still has to be bound to draw
+        if(stars == 0) {
+            glGenVertexArrays(1, &stars);
+        }
+        return;
     }
 
+    //throw away the old stars if we are regenerating them
+    if(stars != 0) {
+        glDeleteVertexArrays(1, &stars);
+        glDeleteBuffers(1, &starBuffer);
+    }
     // Create and initialize a buffer object
-    GLuint buffer;
-    glGenBuffers( 1, &buffer );
-    glBindBuffer( GL_ARRAY_BUFFER, buffer );
-    glBufferData( GL_ARRAY_BUFFER, sizeof(points) + sizeof(colors) + sizeof(sizes), NULL, GL_STATIC_DRAW );
-    glBufferSubData( GL_ARRAY_BUFFER, 0, sizeof(points), points );
-    glBufferSubData( GL_ARRAY_BUFFER, sizeof(points), sizeof(colors), colors );
-    glBufferSubData( GL_ARRAY_BUFFER, sizeof(points) + sizeof(colors), sizeof(sizes), sizes );
+    glGenBuffers( 1, &starBuffer );
+    glBindBuffer( GL_ARRAY_BUFFER, starBuffer );
+    GLsizeiptr pointsSize = numStars * sizeof(vec4);
+    GLsizeiptr colorsSize = numStars * sizeof(vec4);
+    GLsizeiptr sizesSize = numStars * sizeof(float);
+    glBufferData( GL_ARRAY_BUFFER, pointsSize + colorsSize + sizesSize, NULL, GL_STATIC_DRAW );
+    glBufferSubData( GL_ARRAY_BUFFER, 0, pointsSize, &starPoints[0] );
+    glBufferSubData( GL_ARRAY_BUFFER, pointsSize, colorsSize, &starColors[0] );
+    glBufferSubData( GL_ARRAY_BUFFER, pointsSize + colorsSize, sizesSize, &starSizes[0] );
+    std::vector<vec4>().swap(starPoints);
+    std::vector<vec4>().swap(starColors);
+    std::vector<float>().swap(starSizes);
 
     glGenVertexArrays(1, &stars);
     glBindVertexArray(stars);
@@ -590,70 +1194,112 @@ void initStars() {
     GLuint vColor = glGetAttribLocation( starsProgram, "vColor" );
     glEnableVertexAttribArray( vColor );
     glVertexAttribPointer( vColor, 4, GL_FLOAT, GL_FALSE, 0,
-            BUFFER_OFFSET(sizeof(points)) );
+            BUFFER_OFFSET(pointsSize) );
 
     GLuint size = glGetAttribLocation( starsProgram, "size" );
     glEnableVertexAttribArray( size );
     glVertexAttribPointer( size, 1, GL_FLOAT, GL_FALSE, 0,
-            BUFFER_OFFSET(sizeof(points)+sizeof(colors)) );
+            BUFFER_OFFSET(pointsSize+colorsSize) );
 }
 
-void initSolarSystem() {
-    //bind to planets now
-    glUseProgram(planetsProgram);
+void initStars() {
+    makeStars();
+    uploadStars();
+}
+
+void initImpostors() {
+    PROFILE_ZONE("initImpostors");
+    glUseProgram(impostorProgram);
+    //a quad as a triangle strip, corners from -1 to 1
+    vec2 corners[4] = { vec2(-1.0,-1.0), vec2(1.0,-1.0), vec2(-1.0,1.0), vec2(1.0,1.0) };
+    GLuint buffer;
+    glGenBuffers( 1, &buffer );
+    glBindBuffer( GL_ARRAY_BUFFER, buffer );
+    glBufferData( GL_ARRAY_BUFFER, sizeof(corners), corners, GL_STATIC_DRAW );
+    glGenVertexArrays(1, &impostorQuads);
+    glBindVertexArray(impostorQuads);
+    GLuint vCorner = glGetAttribLocation( impostorProgram, "vCorner" );
+    glEnableVertexAttribArray( vCorner );
+    glVertexAttribPointer( vCorner, 2, GL_FLOAT, GL_FALSE, 0, BUFFER_OFFSET(0) );
+
+    //the rest come from the instance buffer, one Impostor per quad
+    glGenBuffers( 1, &impostorBuffer );
+    glBindBuffer( GL_ARRAY_BUFFER, impostorBuffer );
+    const char* names[3] = { "vSphere", "vColor", "vMaterial" };
+    for(int i = 0; i < 3; i++) {
+        GLuint attrib = glGetAttribLocation( impostorProgram, names[i] );
+        glEnableVertexAttribArray( attrib );
+        glVertexAttribPointer( attrib, 4, GL_FLOAT, GL_FALSE, sizeof(Impostor),
+                BUFFER_OFFSET(i * sizeof(vec4)) );
+        glVertexAttribDivisor( attrib, 1 );
+    }
+}
+
+//the camera uniform buffers, each program is pointed at them once it has linked
+void initCamera() {
+    glGenBuffers( CAMERA_BUFFERS, cameraBuffers );
+    for(int i = 0; i < CAMERA_BUFFERS; i++) {
+        glBindBuffer( GL_UNIFORM_BUFFER, cameraBuffers[i] );
+        glBufferData( GL_UNIFORM_BUFFER, sizeof(CameraBlock), NULL, GL_STREAM_DRAW );
+    }
+}
+
+//hang a chain of moons off a body, each one orbiting the one before it
+void addMoons(Scene& scene, int parent, float parentSize, int levels) {
+    vec4 zero(0.0,0.0,0.0,1.0);
+    for(int level = 0; level < levels; level++) {
+        float size = parentSize * 0.6;
+        float radius = parentSize + size + rand()%4 + 1;
+        float speed = (rand()%500)/500.0+0.5;
+        int complexity = rand()%4;
+        int rt = rand()%3;
+        float angleVert = rand()%70;
+        float angleHoriz = rand()%360;
+        parent = scene.add(parent,angleHoriz,angleVert,speed,radius,zero,complexity,size,
+                colors[rand()%8],rt,0.4,0.2,0.6,1.3,"Unnamed");
+        parentSize = size;
+    }
+}
+
+//the built in scene, the main solar system plus numSolarSystems random ones
+void describeSolarSystem(Scene& scene) {
+    PROFILE_ZONE("describeSolarSystem");
+    scene.clear();
     //zero
     vec4 zero(0.0,0.0,0.0,1.0);
     //sun
     vec4 orange = 0.5*colors[3] + 0.5*colors[1];
-    Satellite *sun = new Satellite(180.0,0.0,0.0,0.0,origin,7,6.0,
-            orange,0,1.0,1.0,1.0,9.0,"Sun");
-    suns.push_back(sun);
-    sats.push_back(sun);
+    int sun = scene.add(-1,180.0,0.0,0.0,0.0,origin,7,6.0,
+            orange,0,1.0,1.0,1.0,9.0,"Sun","sunlight");
     //icy planet
     vec4 icy = colors[0] - 0.2*colors[3] - 0.2*colors[5];
-    Satellite *ice = new Satellite(0.0,0.0,0.7,57.0,zero,1,5.0,
-            icy,0,0.5,0.5,0.8,6.0,"Frostivus");
-    sats.push_back(ice);
-    sun->addSatellite(ice);
+    scene.add(sun,0.0,0.0,0.7,57.0,zero,1,5.0,
+            icy,0,0.5,0.5,0.8,6.0,"Frostivus","ice");
     //swampy planet
     vec4 swampy = 0.8*colors[5] + 0.4*colors[3];
-    Satellite *swamp = new Satellite(-30.0,15.0,0.75,48.0,zero,2,3.0,
-            swampy,1,0.5,0.5,0.0,3.0,"Bogoria");
-    sats.push_back(swamp);
-    sun->addSatellite(swamp);
+    scene.add(sun,-30.0,15.0,0.75,48.0,zero,2,3.0,
+            swampy,1,0.5,0.5,0.0,3.0,"Bogoria","swamp");
     //clammy planet + moon
     vec4 water = 0.9*colors[6] + 0.3*colors[5];
-    Satellite *clam = new Satellite(0.0,-15.0,-0.6,37.0,zero,6,5.0,
-            water,2,0.4,0.3,0.8,9.0,"Atlantis");
-    sats.push_back(clam);
-    sun->addSatellite(clam);
-    Satellite *moon = new Satellite(0.0,80.0,0.5,8.5,zero,2,2.0,
-            colors[2],2,0.4,0.2,0.6,2.3,"Titan");
-    sats.push_back(moon);
-    clam->addSatellite(moon);
-    Satellite *moon2 = new Satellite(0.0,-80.0,0.8,3.5,zero,3,0.5,
-            colors[7],0,0.4,0.2,0.6,1.3,"Titan junior");
-    sats.push_back(moon2);
-    moon->addSatellite(moon2);
+    int clam = scene.add(sun,0.0,-15.0,-0.6,37.0,zero,6,5.0,
+            water,2,0.4,0.3,0.8,9.0,"Atlantis","water");
+    int moon = scene.add(clam,0.0,80.0,0.5,8.5,zero,2,2.0,
+            colors[2],2,0.4,0.2,0.6,2.3,"Titan","titan");
+    scene.add(moon,0.0,-80.0,0.8,3.5,zero,3,0.5,
+            colors[7],0,0.4,0.2,0.6,1.3,"Titan junior","coal");
     //mud planet
     vec4 muddy = 0.8*colors[3] + 0.3*colors[5] + 0.2*colors[6];
-    Satellite *mud = new Satellite(-30,45,1.0,11.0,zero,3,2.0,
-            muddy,1,0.4,0.1,0.0,9.0,"Murs");
-    sats.push_back(mud);
-    sun->addSatellite(mud);
-    Satellite *moon3 = new Satellite(0.0,20,1,3.5,zero,3,0.5,
-            colors[3],0,0.4,0.2,0.6,1.3,"Dwurf");
-    sats.push_back(moon3);
-    mud->addSatellite(moon3);
+    int mud = scene.add(sun,-30,45,1.0,11.0,zero,3,2.0,
+            muddy,1,0.4,0.1,0.0,9.0,"Murs","mud");
+    scene.add(mud,0.0,20,1,3.5,zero,3,0.5,
+            colors[3],0,0.4,0.2,0.6,1.3,"Dwurf","dust");
     //murs2
-    Satellite *murs = new Satellite(0,-10,1.0,18.0,zero,3,2.0,
-            colors[2],1,0.4,0.1,0.0,9.0,"Murs Omega");
-    sats.push_back(murs);
-    sun->addSatellite(murs);
+    scene.add(sun,0,-10,1.0,18.0,zero,3,2.0,
+            colors[2],1,0.4,0.1,0.0,9.0,"Murs Omega","rust");
     //add other random solar systems
-    for(int i = 0;i < NUM_SOLAR_SYSTEMS; i++){
+    for(int i = 0;i < numSolarSystems; i++){
         int numPlanets = rand() % 5 + 2;
-        vec4 loc(rand()%(SPACE_X/2)-(SPACE_X/4),rand()%(SPACE_Y/2)-(SPACE_Y/4),rand()%(SPACE_Z/2)-(SPACE_Z/4),1.0);
+        vec4 loc(rand()%(spaceX/2)-(spaceX/4),rand()%(spaceY/2)-(spaceY/4),rand()%(spaceZ/2)-(spaceZ/4),1.0);
         float speed = 0;
         float radius = 0;
         int complexity = rand()%6;
@@ -665,9 +1311,8 @@ void initSolarSystem() {
         int shininess = rand()%14;
         float angleVert = rand()%70;
         float angleHoriz = rand()%360;
-        Satellite *sun = new Satellite(angleHoriz,angleVert,speed,radius,loc,complexity,size,
+        int sun = scene.add(-1,angleHoriz,angleVert,speed,radius,loc,complexity,size,
                 colors[rand()%8],rt,amb,diff,spec,shininess,"Unnamed");
-        suns.push_back(sun);
         for(int j = 0;j < numPlanets; j++) {
             speed = (rand()%500)/500.0+0.5;
             radius += rand()%30+size;
@@ -680,9 +1325,8 @@ void initSolarSystem() {
             shininess = rand()%14;
             angleVert = rand()%70;
             angleHoriz = rand()%360;
-            Satellite *s = new Satellite(angleHoriz,angleVert,speed,radius,zero,complexity,size,
+            int s = scene.add(sun,angleHoriz,angleVert,speed,radius,zero,complexity,size,
                     colors[rand()%8],rt,amb,diff,spec,shininess,"Unnamed");
-            sun->addSatellite(s);
             if((rand()%4)==0) {
                 speed = (rand()%500)/500.0+0.5;
                 float radius2 = rand()%10+size;
@@ -695,40 +1339,296 @@ void initSolarSystem() {
                 shininess = rand()%14;
                 angleVert = rand()%70;
                 angleHoriz = rand()%360;
-                Satellite *m = new Satellite(angleHoriz,angleVert,speed,radius2,zero,complexity,size,
+                int m = scene.add(s,angleHoriz,angleVert,speed,radius2,zero,complexity,size,
                         colors[rand()%8],rt,amb,diff,spec,shininess,"Unnamed");
-                s->addSatellite(m);
+                addMoons(scene, m, size, moonDepth - 1);
             }
         }
     }
 }
 
-void init()
-{
+//fill in scene from --scene, or generate it
+bool describeScene() {
+    if(sceneFile == NULL) {
+        describeSolarSystem(scene);
+        return true;
+    }
+    double start = milliseconds();
+    std::string error;
+    bool ok = scene.load(sceneFile, error);
+    double loaded = milliseconds();
+    if(!ok || !scene.check(error)) {
+        std::cerr << "Failed to load scene: " << error << std::endl;
+        return false;
+    }
+    printf("Loaded %s: %d bodies, %d materials in %.2f ms, checked in %.2f ms\n", sceneFile,
+            scene.bodyCount(), scene.materialCount(), loaded - start, milliseconds() - loaded);
+    return true;
+}
 
-    model_view = mat4(1.0f);
-    camera_view = mat4(1.0f);
-    projection_view = mat4(1.0f);
+//make a Satellite for every body, parents come first so one pass does it
+//bodies orbiting nothing are suns, the number keys get the first one's system
+void buildScene(const Scene& scene) {
+    PROFILE_ZONE("buildScene");
+    std::vector<Satellite*> made(scene.bodyCount());
+    std::vector<int> root(scene.bodyCount());
+    for(int i = 0; i < scene.bodyCount(); i++) {
+        const SceneBody& b = scene.body(i);
+        const SceneMaterial& m = scene.material(b.material);
+        made[i] = sceneArena.make<Satellite>(b.rotHoriz,b.rotVert,b.rotSpeed,b.radius,
+                vec4(b.center[0],b.center[1],b.center[2],1.0),b.complexity,b.size,
+                vec4(m.color[0],m.color[1],m.color[2],m.color[3]),m.renderType,
+                m.ambient,m.diffuse,m.specular,m.shininess,scene.name(b.name));
+        made[i]->setTexture(virtualTextures.find(scene.name(m.name)));
+        if(b.parent < 0) {
+            root[i] = i;
+            suns.push_back(made[i]);
+        } else {
+            root[i] = root[b.parent];
+            made[b.parent]->addSatellite(made[i]);
+        }
+        if(root[i] == 0) {
+            sats.push_back(made[i]->getBody());
+        }
+    }
+}
 
-    // Load shaders and use the resulting shader program
-    planetsProgram = InitShader( "vshader.glsl", "fshader.glsl" );
-    starsProgram = InitShader( "vshaderstars.glsl", "fshaderstars.glsl" );
-    textProgram = InitShader( "vshadertext.glsl", "fshadertext.glsl" );
+//generate or load the scene and build it, false if it couldn't be loaded
+//nothing here touches GL, startup runs it on a job thread
+bool buildSolarSystem() {
+    PROFILE_ZONE("buildSolarSystem");
+    if(!describeScene()) {
+        return false;
+    }
+    double start = milliseconds();
+    buildScene(scene);
+    if(sceneFile != NULL) {
+        printf("Built %d bodies in %.2f ms\n", scene.bodyCount(), milliseconds() - start);
+    }
+    return true;
+}
 
-    initStars();
+void initSolarSystem() {
+    if(!buildSolarSystem()) {
+        exit(1);
+    }
+}
+
+void setupPlanets() {
+    setupSpheres();
     initCircle();
     initAxes();
-    initSphere();
-    initSolarSystem();
-
     //store the locations
     mloc = glGetUniformLocation( planetsProgram, "model_view" );
-    cloc = glGetUniformLocation( planetsProgram, "camera_view" );
-    ploc = glGetUniformLocation( planetsProgram, "projection_view" );
-    clocs = glGetUniformLocation( starsProgram, "camera_view" );
-    plocs = glGetUniformLocation( starsProgram, "projection_view" );
-    cploc = glGetUniformLocation( planetsProgram, "cameraPosition" );
     rtloc = glGetUniformLocation( planetsProgram, "renderType" );
+}
+
+//the feedback pass draws the spheres' vertex arrays, which were set up with the planets' attribute locations
+void setupFeedback() {
+    const char* names[3] = { "vPosition", "vNormal", "vFlatNormal" };
+    bool same = true;
+    for(int i = 0; i < 3; i++) {
+        same = same && glGetAttribLocation(feedbackProgram, names[i]) == glGetAttribLocation(planetsProgram, names[i]);
+    }
+    if(same) return;
+    for(int i = 0; i < 3; i++) {
+        GLint location = glGetAttribLocation(planetsProgram, names[i]);
+        if(location >= 0) glBindAttribLocation(feedbackProgram, location, names[i]);
+    }
+    glLinkProgram(feedbackProgram);
+    //checked like FinishShader() checks the first link
+    GLint linked;
+    glGetProgramiv(feedbackProgram, GL_LINK_STATUS, &linked);
+    if(!linked) {
+        GLint logSize;
+        glGetProgramiv(feedbackProgram, GL_INFO_LOG_LENGTH, &logSize);
+        std::vector<char> log(std::max(logSize, 1), '\0');
+        glGetProgramInfoLog(feedbackProgram, log.size(), NULL, &log[0]);
+        std::cerr << "Feedback program failed to link with the planets' attribute locations" << std::endl;
+        std::cerr << &log[0] << std::endl;
+        exit(EXIT_FAILURE);
+    }
+}
+
+//where each program comes from, and what has to be set up once it has linked
+struct ProgramFiles {
+    GLuint* program;
+    const char* vertexFile;
+    const char* fragmentFile;
+    //NULL if there's nothing to set up
+    void (*setup)();
+    //read by a startup job, let go of once compiling has started
+    char* vertexSource;
+    char* fragmentSource;
+};
+ProgramFiles programFiles[PROGRAM_COUNT] = {
+    { &planetsProgram, "vshader.glsl", "fshader.glsl", setupPlanets, NULL, NULL },
+    //--star-vbo swaps in vshaderstars.glsl
+    { &starsProgram, "vshaderstarsproc.glsl", "fshaderstars.glsl", uploadStars, NULL, NULL },
+    { &textProgram, "vshadertext.glsl", "fshadertext.glsl", NULL, NULL, NULL },
+    { &impostorProgram, "vshaderimpostor.glsl", "fshaderimpostor.glsl", initImpostors, NULL, NULL },
+    { &feedbackProgram, "vshader.glsl", "fshaderfeedback.glsl", setupFeedback, NULL, NULL },
+};
+
+// Startup overlaps everything it can. The shader files, the stars, the scene
+// and the sphere meshes are made by jobs while glut brings the window up,
+// then every program is handed to the driver at once and the meshes are
+// uploaded while it compiles them (on its own threads, with
+// KHR_parallel_shader_compile). The first frame only waits for the planets'
+// program, the others join in as the driver finishes them.
+JobGraph startupGraph;
+//milliseconds() as main() starts, everything below is measured from it
+double startupStart;
+//the window and context are up, the cpu side is made and uploaded
+double windowMs;
+double builtMs;
+//the first frame is swapped, every program is ready, -1 until then
+double firstFrameMs = -1;
+double shadersMs = -1;
+//the scene couldn't be loaded
+bool startupFailed;
+
+//source with what the shaders have to agree on with us defined right after its #version line
+//takes the source from ReadShaderSource() and returns another one to delete [] the same way
+char* defineShaderConstants(char* source) {
+    if(source == NULL) return NULL;
+    std::string defines = "#define LIGHT_INDEX_WIDTH " + std::to_string(LIGHT_INDEX_WIDTH) + "\n";
+    std::string text = source;
+    delete [] source;
+    size_t at = 0;
+    if(text.compare(0, 8, "#version") == 0) {
+        at = text.find('\n');
+        at = at == std::string::npos ? text.size() : at + 1;
+    }
+    text.insert(at, defines);
+    char* result = new char[text.size() + 1];
+    memcpy(result, text.c_str(), text.size() + 1);
+    return result;
+}
+
+void readShadersJob(void*, int p) {
+    ProgramFiles& f = programFiles[p];
+    f.vertexSource = defineShaderConstants(ReadShaderSource(f.vertexFile));
+    f.fragmentSource = defineShaderConstants(ReadShaderSource(f.fragmentFile));
+}
+
+//start every program at once, pinned to the thread with the context
+void compileJob(void*, int) {
+    UseParallelShaderCompile();
+    for(int p = 0; p < PROGRAM_COUNT; p++) {
+        ProgramFiles& f = programFiles[p];
+        if(f.vertexSource == NULL || f.fragmentSource == NULL) {
+            std::cerr << "Failed to read " << (f.vertexSource == NULL ? f.vertexFile : f.fragmentFile) << std::endl;
+            exit(EXIT_FAILURE);
+        }
+        *f.program = StartShader(f.vertexSource, f.fragmentSource);
+        delete [] f.vertexSource;
+        delete [] f.fragmentSource;
+        f.vertexSource = f.fragmentSource = NULL;
+    }
+}
+
+void starsJob(void*, int) {
+    makeStars();
+}
+
+//after starsJob, the stars take their random numbers first
+void sceneJob(void*, int) {
+    startupFailed = !buildSolarSystem();
+}
+
+void spheresJob(void*, int) {
+    makeSpheres();
+}
+
+//while the driver compiles, pinned like compileJob
+void uploadJob(void*, int) {
+    uploadSpheres();
+}
+
+//start the cpu side of startup on the job threads, init() waits for it once there's a context
+void startStartup() {
+    startupGraph.clear();
+    int compile = startupGraph.add("compile", compileJob, NULL, 0, true);
+    for(int p = 0; p < PROGRAM_COUNT; p++) {
+        startupGraph.after(compile, startupGraph.add("readShaders", readShadersJob, NULL, p));
+    }
+    int stars = startupGraph.add("makeStars", starsJob, NULL);
+    startupGraph.after(startupGraph.add("buildSolarSystem", sceneJob, NULL), stars);
+    int upload = startupGraph.add("uploadSpheres", uploadJob, NULL, 0, true);
+    startupGraph.after(upload, startupGraph.add("makeSpheres", spheresJob, NULL));
+    startupGraph.after(upload, compile);
+    jobs.submit(startupGraph);
+}
+
+//wait for a program, check it and set up everything drawn with it
+void finishProgram(int p) {
+    PROFILE_ZONE("finishProgram");
+    ProgramFiles& f = programFiles[p];
+    FinishShader(*f.program, f.vertexFile, f.fragmentFile);
+    GLuint block = glGetUniformBlockIndex(*f.program, "Camera");
+    if(block != GL_INVALID_INDEX) {
+        glUniformBlockBinding( *f.program, block, CAMERA_BINDING );
+    }
+    if(f.setup != NULL) {
+        f.setup();
+    }
+    programReady[p] = true;
+}
+
+//set up whichever programs the driver has finished since the last call, or all of them if wait
+void pollPrograms(bool wait) {
+    if(shadersMs >= 0) return;
+    bool all = true;
+    for(int p = 0; p < PROGRAM_COUNT; p++) {
+        if(programReady[p]) continue;
+        if(wait || ShaderDone(*programFiles[p].program)) {
+            finishProgram(p);
+        } else {
+            all = false;
+        }
+    }
+    if(all) {
+        shadersMs = milliseconds() - startupStart;
+        //before the first frame it goes out with that report
+        if(firstFrameMs >= 0) {
+            printf("all shaders ready after %.1f ms\n", shadersMs);
+        }
+    }
+}
+
+//print how long the first frame took, right after it's swapped
+void reportFirstFrame() {
+    firstFrameMs = milliseconds() - startupStart;
+    printf("first frame after %.1f ms (window %.1f ms, scene and meshes %.1f ms)\n",
+            firstFrameMs, windowMs, builtMs);
+    if(shadersMs >= 0) {
+        printf("all shaders ready after %.1f ms\n", shadersMs);
+    }
+}
+
+void init()
+{
+    PROFILE_ZONE("init");
+    windowMs = milliseconds() - startupStart;
+
+    camera_view = mat4(1.0f);
+    projection_view = mat4(1.0f);
+
+    //everything startStartup() began, the compiles and uploads run here
+    jobs.wait(startupGraph);
+    if(startupFailed) {
+        exit(1);
+    }
+    builtMs = milliseconds() - startupStart;
+
+    lightClusters.init();
+    gpuProfiler.init();
+    initCamera();
+    //the planets are the least a frame needs
+    finishProgram(PROGRAM_PLANETS);
+    //the benchmark compares frames, they all get everything
+    pollPrograms(benchmarking);
 
     glEnable(GL_DEPTH_TEST);
     glEnable(GL_CULL_FACE);
@@ -760,45 +1660,202 @@ void initGlut(int& argc, char** argv)
     init();
 }
 
-void drawSpheres() {
-    //make sure we are on planets shaders
+//draw every impostor queued up this frame in one instanced call
+void drawImpostors() {
+    PROFILE_ZONE("drawImpostors");
+    if(impostors.empty()) return;
+    glUseProgram(impostorProgram);
+    lightClusters.bind(impostorProgram, 0);
+    glBindBuffer( GL_ARRAY_BUFFER, impostorBuffer );
+    glBufferData( GL_ARRAY_BUFFER, impostors.size() * sizeof(Impostor), &impostors[0], GL_STREAM_DRAW );
+    glBindVertexArray(impostorQuads);
+    glDrawArraysInstanced(GL_TRIANGLE_STRIP, 0, 4, impostors.size());
+    frameStats.drawCalls++;
     glUseProgram(planetsProgram);
-    //render each sun
-    for(std::vector<Satellite*>::iterator i = suns.begin(); i != suns.end(); ++i) {
-        //set the light location to be the center of the suns
-        glUniform4fv( glGetUniformLocation(planetsProgram, "lightPosition"),
-                1, (*i)->getCenter() );
-        //render it
-        (*i)->render();
+}
+
+//drawing the shown frame: each system's culling and LOD with the transforms of
+//the ones drawn body by body, then culling and picking impostor or mesh for
+//their bodies, then filling the instance and draw lists from all of them, then
+//the GL submission, pinned to the thread with the context. the lights get
+//binned alongside all of that
+JobGraph frameGraph;
+//refitting the bvh, left to finish while the next frame starts
+JobGraph bvhGraph;
+//placeBodies() on the simulation thread, a job per system
+JobGraph placeGraph;
+//what each system's cull job spent, the benchmark adds them up
+std::vector<double> systemCullMs;
+//bodies drawn as meshes this frame, in drawing order
+std::vector<Body> meshQueue;
+
+//the bodies of every sun's system, its satellite first, collected once per scene
+void collectSystems() {
+    sunBodies.assign(suns.size(), std::vector<Body>());
+    for(size_t i = 0; i < suns.size(); i++) {
+        suns[i]->collectBodies(sunBodies[i]);
     }
 }
 
-void drawStars() {
-    //bind to stars shaders
-    glUseProgram(starsProgram);
-    //starsssssssssssssssssss
-    glBindVertexArray(stars);
-    glDrawArrays(GL_POINTS,0,NUM_STARS);
+//decide if a whole system is off screen, small enough to be one impostor, or drawn body by body
+int classifySystem(int sun, const SimFrame& frame) {
+    vec4 p = camera_view * suns[sun]->getCenter();
+    float reach = frame.reach[sun];
+    if(outsideFrustum(p, reach)) {
+        return SYSTEM_CULLED;
+    }
+    if(!systemLodOn()) {
+        return SYSTEM_BODIES;
+    }
+    //projected diameter in pixels, by distance rather than depth like the simulation works it out
+    float distance = length(vec3(p.x, p.y, p.z));
+    if(reach * projection_view[1][1] * windowHeight < systemLodPixels * distance) {
+        return SYSTEM_AGGREGATE;
+    }
+    return SYSTEM_BODIES;
 }
 
-void doCamera() {
-    //eye and ref are same
-    vec4 eye = vec4(xLoc,yLoc,zLoc,1.0);
-    vec4 ref = vec4(xLoc,yLoc,zLoc,1.0);
-    //direciton based off of angle
-    vec4 direction = vec4(cos(zRot)*sin(yRot),
-            sin(zRot), cos(zRot)*cos(yRot),0.0);
-    //if we are on top of a planet
-    //get the eye and ref respectively
-    if(camera != -1) {
-        eye = ref = sats[camera]->getCamera();
-        float angle = sats[camera]->getAngle();
-        direction = RotateY(-angle) * direction;
+//culling and LOD for one whole system, then the model views if it's drawn body by body
+//those come from the angles, so a system the simulation hasn't placed lately is still drawn right
+void transformJob(void*, int sun) {
+    double start = benchmarking ? milliseconds() : 0.0;
+    drawSystems.lod[sun] = classifySystem(sun, *shown);
+    if(benchmarking) {
+        systemCullMs[sun] = milliseconds() - start;
     }
-    //add direction to ref to get our direction vector
-    ref += direction;
-    //calculate right based on angles
-    vec4 right = vec4(sin(yRot-M_PI/2.0f), 0 , cos(yRot-M_PI/2.0f), 0.0);
+    if(drawSystems.lod[sun] != SYSTEM_BODIES) return;
+    suns[sun]->transform(mat4(1.0f), *shown);
+}
+
+//frustum culling and picking impostor or mesh for each body of a system drawn body by body
+void cullJob(void*, int sun) {
+    if(drawSystems.lod[sun] != SYSTEM_BODIES) return;
+    double start = benchmarking ? milliseconds() : 0.0;
+    const std::vector<Body>& system = sunBodies[sun];
+    for(size_t i = 0; i < system.size(); i++) {
+        drawBodies.visibility[system[i]] = bodies.satellite[system[i]]->classify(*shown);
+    }
+    if(benchmarking) {
+        systemCullMs[sun] += milliseconds() - start;
+    }
+}
+
+//every sun is a light reaching a bit past its outermost orbit
+//binned for the camera the spheres are drawn with, which keeps the nearest ones in view
+void lightsJob(void*, int) {
+    lightClusters.clear();
+    for(std::vector<Satellite*>::iterator i = suns.begin(); i != suns.end(); ++i) {
+        lightClusters.add((*i)->getCenter(), (*i)->getReach(&shown->extent[0]) * LIGHT_RANGE_SCALE);
+    }
+    lightClusters.build(camera_view, projection_view);
+}
+
+//the impostor instances, meshes, trajectories and axes of every system, in order
+void fillJob(void*, int) {
+    impostors.clear();
+    meshQueue.clear();
+    trajectoryQueue.clear();
+    axesQueue.clear();
+    for(size_t s = 0; s < sunBodies.size(); s++) {
+        const std::vector<Body>& system = sunBodies[s];
+        frameStats.cullMs += systemCullMs[s];
+        if(drawSystems.lod[s] == SYSTEM_CULLED) {
+            frameStats.culled += system.size();
+        } else if(drawSystems.lod[s] == SYSTEM_AGGREGATE) {
+            impostors.push_back(drawSystems.aggregate[s]);
+            frameStats.impostors++;
+            frameStats.aggregated++;
+        } else {
+            for(size_t i = 0; i < system.size(); i++) {
+                bodies.satellite[system[i]]->queue(*shown, meshQueue);
+            }
+        }
+    }
+    frameStats.deferred = shown->deferred;
+}
+
+void drawSpheres() {
+    PROFILE_ZONE("drawSpheres");
+    //make sure we are on planets shaders
+    glUseProgram(planetsProgram);
+    {
+        GpuZone zone(gpuProfiler, "lights");
+        lightClusters.upload();
+        lightClusters.bind(planetsProgram, 0);
+    }
+    {
+        GpuZone zone(gpuProfiler, "textures");
+        virtualTextures.update();
+        virtualTextures.bindAtlas(planetsProgram, TEXTURE_UNIT);
+    }
+    {
+        GpuZone zone(gpuProfiler, "spheres");
+        for(std::vector<Body>::iterator i = meshQueue.begin(); i != meshQueue.end(); ++i) {
+            bodies.satellite[*i]->draw();
+        }
+        virtualTextures.unbind(planetsProgram);
+    }
+    {
+        GpuZone zone(gpuProfiler, "impostors");
+        drawImpostors();
+    }
+    {
+        GpuZone zone(gpuProfiler, "trajectories");
+        flushTrajectories();
+    }
+    {
+        GpuZone zone(gpuProfiler, "axes");
+        flushAxes();
+    }
+}
+
+//which texture tiles the meshes just drawn want, a small pass read back a couple of frames later
+void drawFeedback() {
+    PROFILE_ZONE("drawFeedback");
+    //until its program is ready the feedback stays due, and the frames keep coming while it compiles
+    if(!virtualTextures.enabled() || !programReady[PROGRAM_FEEDBACK]) return;
+    if(!virtualTextures.drewAny()) {
+        virtualTextures.skipFeedback();
+        return;
+    }
+    GpuZone zone(gpuProfiler, "feedback");
+    virtualTextures.beginFeedback(feedbackProgram, windowWidth, windowHeight);
+    for(std::vector<Body>::iterator i = meshQueue.begin(); i != meshQueue.end(); ++i) {
+        bodies.satellite[*i]->drawFeedback();
+    }
+    virtualTextures.endFeedback(windowWidth, windowHeight);
+    glUseProgram(planetsProgram);
+}
+
+void drawStars() {
+    PROFILE_ZONE("drawStars");
+    if(!programReady[PROGRAM_STARS]) return;
+    GpuZone zone(gpuProfiler, "stars");
+    //bind to stars shaders
+    glUseProgram(starsProgram);
+    //starsssssssssssssssssss
+    glBindVertexArray(stars);
+    glDrawArrays(GL_POINTS,0,numStars);
+    frameStats.drawCalls++;
+}
+
+void doCamera() {
+    PROFILE_ZONE("doCamera");
+    //eye and ref are same
+    vec4 eye = vec4(xLoc,yLoc,zLoc,1.0);
+    vec4 ref = vec4(xLoc,yLoc,zLoc,1.0);
+    //direciton based off of angle
+    vec4 direction = vec4(cos(zRot)*sin(yRot),
+            sin(zRot), cos(zRot)*cos(yRot),0.0);
+    //if we are on top of a planet
+    //get the eye and ref respectively
+    if(camera != -1) {
+        eye = ref = bodyCamera(camera);
+        float angle = bodyAngle(camera);
+        direction = RotateY(-angle) * direction;
+    }
+    //add direction to ref to get our direction vector
+    ref += direction;
     //if we are staring at sun, this all doesnt matter
     //just set our ref/direction
     if(staring) {
@@ -806,31 +1863,122 @@ void doCamera() {
         direction = eye-origin;
     }
     vec4 up(0.0,1.0,0.0,0.0);
-    //store them in GPU
+    //latchCamera() hands them to the GPU
     camera_view = LookAt(eye,ref,up);
-    glUseProgram(planetsProgram);
-    glUniform4fv(cploc, 1, ref);
-    glUniformMatrix4fv(cloc, 1, GL_TRUE, camera_view);
-    glUseProgram(starsProgram);
-    glUniformMatrix4fv(clocs, 1, GL_TRUE, camera_view);
+    cameraEye = eye;
 }
 
-void doModel() {
+void submitJob(void*, int) {
     //draw our pretty things
     drawSpheres();
+    drawFeedback();
     drawStars();
 }
 
+//each system as one impostor, from the extents of the frame on screen
+void updateAggregates() {
+    drawSystems.aggregate.resize(suns.size());
+    for(size_t i = 0; i < suns.size(); i++) {
+        drawSystems.aggregate[i] = suns[i]->aggregate(&shown->extent[0]);
+    }
+    drawSystems.extentVersion = shown->extentVersion;
+}
+
+//the frame graph for the current scene, rebuilt whenever the scene is
+void buildFrameGraph() {
+    frameGraph.clear();
+    collectSystems();
+    drawBodies.model.resize(bodies.size());
+    drawBodies.orbit.resize(bodies.size());
+    drawBodies.visibility.resize(bodies.size());
+    systemCullMs.assign(suns.size(), 0.0);
+    drawSystems.lod.assign(suns.size(), SYSTEM_BODIES);
+    updateAggregates();
+    int fill = frameGraph.add("fill", fillJob, NULL);
+    int submit = frameGraph.add("submit", submitJob, NULL, 0, true);
+    int lights = frameGraph.add("lights", lightsJob, NULL);
+    frameGraph.after(submit, fill);
+    frameGraph.after(submit, lights);
+    for(size_t i = 0; i < suns.size(); i++) {
+        int transform = frameGraph.add("transform", transformJob, NULL, i);
+        int cull = frameGraph.add("cull", cullJob, NULL, i);
+        frameGraph.after(cull, transform);
+        frameGraph.after(fill, cull);
+    }
+}
+
+void doModel() {
+    PROFILE_ZONE("doModel");
+    if(frameGraph.size() == 0) {
+        buildFrameGraph();
+    } else if(shown->extentVersion != drawSystems.extentVersion) {
+        //bodies merged, the systems they're in look different as one impostor
+        updateAggregates();
+    }
+    jobs.run(frameGraph);
+}
+
 void doProjection() {
+    PROFILE_ZONE("doProjection");
     //generate our projection matrix with fov and near/far planes
-    projection_view = Perspective(fov,16.0/9.0,0.1f,250.0f);
-    glUseProgram(planetsProgram);
-    glUniformMatrix4fv(ploc, 1, GL_TRUE, projection_view);
-    glUseProgram(starsProgram);
-    glUniformMatrix4fv(plocs, 1, GL_TRUE, projection_view);
+    projection_view = Perspective(fov,ASPECT_RATIO,Z_NEAR,Z_FAR);
+}
+
+//upload the camera doCamera and doProjection just worked out, for everything drawn this frame
+//each frame writes the next buffer of the ring, the gpu may still be reading the others
+void latchCamera() {
+    CameraBlock block = { camera_view, projection_view, cameraEye };
+    cameraBuffer = (cameraBuffer + 1) % CAMERA_BUFFERS;
+    glBindBuffer( GL_UNIFORM_BUFFER, cameraBuffers[cameraBuffer] );
+    glBufferSubData( GL_UNIFORM_BUFFER, 0, sizeof(block), &block );
+    glBindBufferBase( GL_UNIFORM_BUFFER, CAMERA_BINDING, cameraBuffers[cameraBuffer] );
+}
+
+//hand the same camera to the simulation, for its next tick to leave the far systems be
+void publishView() {
+    SimView& v = simViews.writing();
+    v.eye = cameraEye;
+    v.pixels = projection_view[1][1] * windowHeight;
+    v.lodPixels = systemLodOn() ? systemLodPixels : 0.0;
+    simViews.publish();
+}
+
+//how long the input handled this frame took to make it to the screen
+void measureLatency() {
+    if(latchedInput.empty()) return;
+    double swapped = milliseconds();
+    if(latencies.size() < (size_t) LATENCY_SAMPLES) {
+        latencies.resize(LATENCY_SAMPLES);
+    }
+    for(size_t i = 0; i < latchedInput.size(); i++) {
+        latencies[latencyNext] = swapped - latchedInput[i];
+        latencyNext = (latencyNext + 1) % LATENCY_SAMPLES;
+        latencyCount++;
+    }
+    latchedInput.clear();
+}
+
+//the input to swap latency of the newest events
+Series recentLatency() {
+    Series s;
+    for(long i = 0; i < std::min(latencyCount, (long) LATENCY_SAMPLES); i++) {
+        s.add(latencies[i]);
+    }
+    return s;
+}
+
+//print the latencies on the way out, if there was any input
+void reportLatency() {
+    if(latencyCount == 0) return;
+    Series s = recentLatency();
+    printf("input to swap latency over the last %d of %ld events: p50 %.2f p95 %.2f p99 %.2f max %.2f ms\n",
+            s.size(), latencyCount, s.percentile(50), s.percentile(95), s.percentile(99), s.max());
 }
 
 void doOverlay() {
+    PROFILE_ZONE("doOverlay");
+    if(!programReady[PROGRAM_TEXT]) return;
+    GpuZone zone(gpuProfiler, "overlay");
     //unbind shaders so we can draw text
     glUseProgram(textProgram);
     //create an ostream so we can addd floats and things
@@ -842,10 +1990,17 @@ void doOverlay() {
     text << "\n    -/= = decrease/increase orbit speed\n      (of currently selected planet)";
     text << "\n    d = stare at sun";
     text << "\n    s = toggle animation";
+    text << "\n    [/] = step back/forward through the recording";
+    text << "\n    {/} = jump back/forward " << SCRUB_JUMP << " ticks";
     text << "\n    t = toggle drawing trajectories";
     text << "\n    a = toggle drawing axes";
+    text << "\n    b = toggle impostors for small bodies";
+    text << "\n    x = toggle merging bodies that touch";
+    text << "\n    click = ride on a body";
     text << "\n    n/w = decrease/increase fov";
     text << "\n    r = reset camera";
+    text << "\n    p = dump gpu timings to " << GPU_PROFILE_FILE;
+    text << "\n    c = capture cpu trace to " << CPU_TRACE_FILE;
     text << "\n    arrow keys = angle camera";
     text << "\n    ijkmuo = camera";
     text << "\n    q = quit";
@@ -854,8 +2009,44 @@ void doOverlay() {
     if(staring) text << "staring ";
     if(drawTrajectories) text << "trajectories ";
     if(drawAxes) text << "axes ";
+    if(useImpostors) text << "impostors ";
+    if(mergeOnContact) text << "merging ";
     text << "fov:";
     text << fov << std::endl;
+    text << "contacts: " << shown->contacts;
+    if(!shown->lastContact.empty()) text << " (last: " << shown->lastContact << ")";
+    text << std::endl;
+    if(latencyCount > 0) {
+        //only worked out again when there's been more input
+        static long counted = -1;
+        static std::string latency;
+        if(counted != latencyCount) {
+            Series s = recentLatency();
+            std::ostringstream line;
+            line << "input to swap: p50 " << s.percentile(50) << " p95 " << s.percentile(95)
+                << " p99 " << s.percentile(99) << " ms";
+            latency = line.str();
+            counted = latencyCount;
+        }
+        text << latency << std::endl;
+    }
+    if(shown->recordedTicks > 0) {
+        text << "recorded: " << shown->recordedTicks << " ticks in " << shown->recordedBytes / 1048576.0
+            << " MB (" << (double) shown->rawBytes / shown->recordedBytes << "x)";
+        if(shown->scrubbing) text << ", showing " << -shown->scrubbedBack;
+        text << std::endl;
+    }
+    if(shardWorkers > 0) {
+        text << "shard workers: " << shown->workers << " of " << shardWorkers << std::endl;
+    }
+    if(shown->deferred > 0) {
+        text << "systems left unplaced: " << shown->deferred << " of " << suns.size() << std::endl;
+    }
+    if(virtualTextures.slotCount() > 0) {
+        text << "texture tiles: " << virtualTextures.residentTiles() << " of " << virtualTextures.slotCount()
+            << " resident, " << virtualTextures.loadingTiles() << " loading, "
+            << virtualTextures.bytes() / 1048576.0 << " of " << textureMB << " MB" << std::endl;
+    }
     //set the color to be white
     glColor4f(1.0,1.0,1.0,1.0);
     //set the position to be top left cornerr
@@ -870,42 +2061,801 @@ void doOverlay() {
     if(camera == -1) {
         text << "satellite: none";
     } else {
-        text << sats[camera]->getStats();
+        text << bodyStats(camera);
+        //whatever is closest to it right now
+        std::vector<int> nearby;
+        vec4 loc = shown->loc[camera];
+        bvh.nearest(vec3(loc.x, loc.y, loc.z), NEARBY_BODIES, &shown->loc[0], nearby, camera);
+        text << "Nearby:" << std::endl;
+        for(size_t i = 0; i < nearby.size(); i++) {
+            text << "    " << bodies.satellite[nearby[i]]->getName() << " ("
+                << length(shown->loc[nearby[i]] - loc) << ")" << std::endl;
+        }
     }
     //set color to be white
     glColor4f(1.0,1.0,1.0,1.0);
     //move it slightly left
     glRasterPos3f(-0.6, 1, 0);
     glutBitmapString(GLUT_BITMAP_HELVETICA_12, (unsigned char*)text.str().c_str());
+    //rolling averages of the gpu timings over on the right
+    text.clear();
+    text.str("");
+    text << "\n\n\ngpu:" << gpuProfiler.report();
+    glColor4f(1.0,1.0,1.0,1.0);
+    glRasterPos3f(0.6, 1, 0);
+    glutBitmapString(GLUT_BITMAP_HELVETICA_12, (unsigned char*)text.str().c_str());
 }
 
-// Called when the window needs to be redrawn.
-void callbackDisplay()
-{
-    //clear the screen
-    glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+//if we are spinning, move every body along its orbit, false if paused
+//one pass over the dense rot/rotSpeed arrays, no tree walk
+bool tickBodies() {
+    PROFILE_ZONE("tick");
+    if(!spinning) return false;
+    //carrying on from a scrubbed to tick forgets what came after it
+    if(playhead >= 0) {
+        timeline.truncate(playhead);
+        simTicks = playhead;
+        playhead = -1;
+    }
+    float* rot = bodies.rot.data();
+    const float* rotSpeed = bodies.rotSpeed.data();
+    int n = bodies.size();
+    //where everything started goes in first
+    if(timeline.empty()) {
+        timeline.record(rot, rotSpeed, n);
+    }
+    for(int i = 0; i < n; i++) {
+        rot[i] += rotSpeed[i];
+    }
+    simTicks++;
+    timeline.record(rot, rotSpeed, n);
+    return true;
+}
 
-    //draw our things
-    doOverlay();
-    doModel();
-    //set our camera
-    doCamera();
-    //do our projection
-    doProjection();
-    //tell it to redraw
-    glutPostRedisplay();
-    //not sure...
-    glutSwapBuffers();
+//pause and go to the recorded tick that many ticks from the current one
+void scrub(int ticks) {
+    if(timeline.empty()) return;
+    spinning = false;
+    int from = playhead >= 0 ? playhead : timeline.last();
+    playhead = std::min(std::max(from + ticks, timeline.first()), timeline.last());
+    timeline.seek(playhead, bodies.rot.data(), bodies.rotSpeed.data());
 }
 
-// Called when the window is resized.
-void callbackReshape (int w, int h){
+//the scripted camera path for the benchmark, the same every run
+//quarters: free flight around the main system, riding on each planet,
+//staring at the sun while flying past, and an fov sweep from far out
+void benchmarkScript(int frame) {
+    float t = frame / (float) benchmarkFrames;
+    setDefaults();
+    //a scene whose first system is only a sun has no planets to hop between, it keeps circling instead
+    if(t < 0.25 || (t < 0.5 && sats.size() < 2)) {
+        //circle the main system looking in at it, bobbing up and down
+        float a = t / 0.25 * 2.0 * M_PI;
+        xLoc = origin.x + 150.0 * sin(a);
+        zLoc = origin.z - 150.0 * cos(a);
+        yLoc = 38.0 + 40.0 * sin(2.0 * a);
+        yRot = -a;
+        zRot = -0.3;
+    } else if(t < 0.5) {
+        //hop onto the next planet every 1/32nd of the run
+        int hop = (int) ((t - 0.25) * 32.0);
+        camera = sats[1 + hop % (sats.size() - 1)];
+        yRot = (t - 0.25) * 8.0 * M_PI;
+        zRot = 0.0;
+    } else if(t < 0.75) {
+        //fly a straight line through the system, always looking at the sun
+        staring = true;
+        xLoc = -300.0 + (t - 0.5) / 0.25 * 600.0;
+        yLoc = 60.0;
+        zLoc = -80.0;
+    } else {
+        //widen the fov from a vantage point that sees most of the galaxy
+        fov = 30.0 + (t - 0.75) / 0.25 * 120.0;
+        xLoc = 9.0;
+        yLoc = 300.0;
+        zLoc = -600.0;
+        zRot = -0.45;
+    }
+}
 
+//everything the benchmark records, one sample per frame
+struct BenchmarkSeries {
+    Series frameTimes;
+    Series cpuTimes;
+    Series gpuTimes;
+    Series simTimes;
+    Series cullTimes;
+    Series drawCalls;
+    Series meshes;
+    Series impostors;
+    Series culled;
+    Series aggregated;
+    Series deferred;
+};
+BenchmarkSeries benchmarkSeries;
+
+//summary of the run as json
+//a json string, quotes and backslashes escaped and control characters as \u escapes
+void writeJsonString(FILE* fp, const char* s) {
+    fputc('"', fp);
+    for(; s != NULL && *s != '\0'; s++) {
+        unsigned char c = *s;
+        if(c == '"' || c == '\\') {
+            fprintf(fp, "\\%c", c);
+        } else if(c < 0x20) {
+            fprintf(fp, "\\u%04x", c);
+        } else {
+            fputc(c, fp);
+        }
+    }
+    fputc('"', fp);
 }
 
-// Called when a key is pressed. x, y is the current mouse position.
-void callbackKeyboard(unsigned char key, int x, int y)
+void benchmarkReport(const BenchmarkSeries& b) {
+    FILE* fp = benchmarkOut ? fopen(benchmarkOut, "w") : stdout;
+    if(fp == NULL) {
+        std::cerr << "Failed to open " << benchmarkOut << std::endl;
+        fp = stdout;
+    }
+    fprintf(fp, "{\n  \"seed\": %u,\n  \"frames\": %d,\n  \"warmup\": %d,\n",
+            randomSeed, benchmarkFrames, BENCHMARK_WARMUP);
+    fprintf(fp, "  \"renderer\": ");
+    writeJsonString(fp, (const char*) glGetString(GL_RENDERER));
+    fprintf(fp, ",\n  ");
+    b.frameTimes.writeJson(fp, "frame_ms");
+    fprintf(fp, ",\n  ");
+    b.cpuTimes.writeJson(fp, "cpu_ms");
+    fprintf(fp, ",\n  ");
+    b.gpuTimes.writeJson(fp, "gpu_ms");
+    fprintf(fp, ",\n  ");
+    b.simTimes.writeJson(fp, "sim_ms");
+    fprintf(fp, ",\n  ");
+    b.cullTimes.writeJson(fp, "cull_ms");
+    fprintf(fp, ",\n  ");
+    b.drawCalls.writeJson(fp, "draw_calls");
+    fprintf(fp, ",\n  ");
+    b.meshes.writeJson(fp, "meshes");
+    fprintf(fp, ",\n  ");
+    b.impostors.writeJson(fp, "impostors");
+    fprintf(fp, ",\n  ");
+    b.culled.writeJson(fp, "culled");
+    fprintf(fp, ",\n  ");
+    b.aggregated.writeJson(fp, "aggregated_systems");
+    fprintf(fp, ",\n  ");
+    b.deferred.writeJson(fp, "deferred_systems");
+    fprintf(fp, ",\n  \"first_frame_ms\": %.2f", firstFrameMs);
+    fprintf(fp, "\n}\n");
+    if(fp != stdout) fclose(fp);
+}
+
+//point the swept setting at its value for a point of the sweep
+//returns false once we are past the last point
+bool sweepApply(int point) {
+    const int* values = SWEEP_SYSTEMS;
+    int count = sizeof(SWEEP_SYSTEMS) / sizeof(int);
+    int* setting = &numSolarSystems;
+    if(strcmp(sweepAxis, "stars") == 0) {
+        values = SWEEP_STARS;
+        count = sizeof(SWEEP_STARS) / sizeof(int);
+        setting = &numStars;
+    } else if(strcmp(sweepAxis, "depth") == 0) {
+        values = SWEEP_DEPTHS;
+        count = sizeof(SWEEP_DEPTHS) / sizeof(int);
+        setting = &moonDepth;
+    }
+    if(point >= count) return false;
+    *setting = values[point];
+    return true;
+}
+
+//one csv row per point of the sweep, means over the recorded frames
+//submit_ms is everything on the cpu that isn't ticking or culling
+void sweepRow(const BenchmarkSeries& b) {
+    static FILE* fp = NULL;
+    if(fp == NULL) {
+        fp = benchmarkOut ? fopen(benchmarkOut, "w") : stdout;
+        if(fp == NULL) {
+            std::cerr << "Failed to open " << benchmarkOut << std::endl;
+            fp = stdout;
+        }
+        fprintf(fp, "axis,systems,stars,depth,bodies,frame_ms,frame_p95_ms,cpu_ms,sim_ms,cull_ms,submit_ms,gpu_ms,"
+                "draw_calls,meshes,impostors,culled\n");
+    }
+    double submit = b.cpuTimes.mean() - b.simTimes.mean() - b.cullTimes.mean();
+    fprintf(fp, "%s,%d,%d,%d,%d,%.4f,%.4f,%.4f,%.4f,%.4f,%.4f,%.4f,%.1f,%.1f,%.1f,%.1f\n",
+            sweepAxis, numSolarSystems, numStars, moonDepth, bodies.size(),
+            b.frameTimes.mean(), b.frameTimes.percentile(95), b.cpuTimes.mean(),
+            b.simTimes.mean(), b.cullTimes.mean(), submit, b.gpuTimes.mean(),
+            b.drawCalls.mean(), b.meshes.mean(), b.impostors.mean(), b.culled.mean());
+    //flush every row, the big end of a sweep is the part most likely to fall over
+    fflush(fp);
+}
+
+//place one system in a worker process, its own copy of the scene does the work
+void placeSun(int sun, const float* angles, float (*positions)[4]) {
+    const std::vector<Body>& system = sunBodies[sun];
+    for(size_t i = 0; i < system.size(); i++) {
+        bodies.rot[system[i]] = angles[system[i]];
+    }
+    suns[sun]->place(mat4(1.0f));
+    for(size_t i = 0; i < system.size(); i++) {
+        memcpy(positions[system[i]], &bodies.loc[system[i]], sizeof(positions[0]));
+    }
+}
+
+//start the workers for the scene as it is now
+//each runs the program again with the settings and seed that built it and builds its own copy,
+//so this is safe with threads and a context about, and again for every scene the benchmark reloads
+void startShards() {
+    collectSystems();
+    std::vector<float> weight(suns.size());
+    for(size_t i = 0; i < suns.size(); i++) {
+        weight[i] = sunBodies[i].size();
+    }
+    std::vector<std::string> command;
+    command.push_back(programName);
+    command.push_back("--seed");
+    command.push_back(std::to_string(randomSeed));
+    command.push_back("--systems");
+    command.push_back(std::to_string(numSolarSystems));
+    command.push_back("--stars");
+    command.push_back(std::to_string(numStars));
+    //the workers have to draw as many random numbers for the stars as we did
+    if(starVbo) {
+        command.push_back("--star-vbo");
+    }
+    command.push_back("--depth");
+    command.push_back(std::to_string(moonDepth));
+    command.push_back("--space");
+    command.push_back(std::to_string(spaceX));
+    command.push_back(std::to_string(spaceY));
+    command.push_back(std::to_string(spaceZ));
+    if(sceneFile != NULL) {
+        command.push_back("--scene");
+        command.push_back(sceneFile);
+    }
+    if(!shards.start(shardWorkers, suns.size(), bodies.size(), weight, command)) {
+        std::cerr << "Failed to start shard workers, placing everything here" << std::endl;
+    }
+}
+
+void stopShards() {
+    shards.stop();
+}
+
+//what a worker process does instead of opening a window: build the scene the same way and place systems
+//stars first, they take their random numbers before the scene's
+int runShardWorker() {
+    makeStars();
+    if(!buildSolarSystem()) {
+        return 1;
+    }
+    collectSystems();
+    return shards.serve(atoi(shardWorkerArgs[0]), atoi(shardWorkerArgs[1]), atoi(shardWorkerArgs[2]),
+            suns.size(), bodies.size(), placeSun);
+}
+
+//after the simulation thread, it runs jobs too
+void stopJobs() {
+    jobs.stop();
+}
+
+//throw the whole scene away and build it again from the current settings
+//with the same seed, so each sweep point looks like a fresh start
+//only the benchmark does this, and it runs the simulation itself
+void reloadScene() {
+    PROFILE_ZONE("reloadScene");
+    //the last frame's refit is still reading the old scene
+    jobs.wait(bvhGraph);
+    frameGraph.clear();
+    placeGraph.clear();
+    //the workers have the old scene
+    shards.stop();
+    suns.clear();
+    sats.clear();
+    bodies.clear();
+    bvh.clear();
+    collisions.clear();
+    lastContact.clear();
+    timeline.clear();
+    playhead = -1;
+    simTicks = 0;
+    reachStale = true;
+    //the next export makes a new region with the new names
+    sharedBodies.close();
+    //anything queued up was for the old bodies
+    SimCommand stale;
+    while(simCommands.pop(stale)) {}
+    sceneArena.release();
+    srand(randomSeed);
+    initStars();
+    initSolarSystem();
+    if(shardWorkers > 0) {
+        startShards();
+    }
+}
+
+//record one benchmark frame, write the report and quit after the last one
+//sweeps move on to their next point instead until they run out
+void benchmarkRecord(double start, double cpu) {
+    static double lastStart = 0;
+    static int lastGpuSample = 0;
+    BenchmarkSeries& b = benchmarkSeries;
+    if(benchmarkFrame >= BENCHMARK_WARMUP) {
+        //frame time is start to start, so it covers swaps and anything between frames
+        b.frameTimes.add(start - lastStart);
+        b.cpuTimes.add(cpu);
+        b.simTimes.add(frameStats.simMs);
+        b.cullTimes.add(frameStats.cullMs);
+        b.drawCalls.add(frameStats.drawCalls);
+        b.meshes.add(frameStats.meshes);
+        b.impostors.add(frameStats.impostors);
+        b.culled.add(frameStats.culled);
+        b.aggregated.add(frameStats.aggregated);
+        b.deferred.add(frameStats.deferred);
+        //gpu timings come back a few frames late, take them as they arrive
+        double gpu = 0;
+        int sample = gpuProfiler.latest("frame", gpu);
+        if(sample != lastGpuSample) {
+            b.gpuTimes.add(gpu);
+        }
+        lastGpuSample = sample;
+    } else {
+        double gpu = 0;
+        lastGpuSample = gpuProfiler.latest("frame", gpu);
+    }
+    lastStart = start;
+    benchmarkFrame++;
+    if(benchmarkFrame == benchmarkFrames) {
+        if(sweepAxis == NULL) {
+            benchmarkReport(b);
+            exit(0);
+        }
+        sweepRow(b);
+        if(!sweepApply(++sweepPoint)) {
+            exit(0);
+        }
+        b = BenchmarkSeries();
+        benchmarkFrame = 0;
+        reloadScene();
+    }
+}
+
+//bring the bvh up to date with the frame on screen, it's what clicks pick from
+//a new scene gets a new tree, otherwise the old one is refit
+void updateBvh() {
+    PROFILE_ZONE("updateBvh");
+    if(bvh.size() != (int) shown->loc.size()) {
+        bvh.build(&shown->loc[0], &shown->extent[0], shown->loc.size());
+    } else {
+        bvh.refit(&shown->loc[0], &shown->extent[0]);
+    }
+}
+
+void bvhJob(void*, int) {
+    updateBvh();
+}
+
+//find the bodies that touch now, and swallow the smaller one of any pair
+//that just started touching if we are merging
+void updateContacts() {
+    PROFILE_ZONE("updateContacts");
+    contactEvents.clear();
+    collisions.update(&bodies.loc[0], &bodies.extent[0], bodies.size(), contactEvents);
+    for(size_t i = 0; i < contactEvents.size(); i++) {
+        const ContactEvent& e = contactEvents[i];
+        if(!e.begin) continue;
+        std::ostringstream text;
+        text << bodies.satellite[e.a]->getName() << " hit " << bodies.satellite[e.b]->getName();
+        lastContact = text.str();
+        if(mergeOnContact) {
+            Body big = bodies.extent[e.a] >= bodies.extent[e.b] ? e.a : e.b;
+            Body small = big == e.a ? e.b : e.a;
+            //keep the volume of both
+            float ra = bodies.extent[big], rb = bodies.extent[small];
+            bodies.extent[big] = cbrt(ra * ra * ra + rb * rb * rb);
+            bodies.extent[small] = 0.0;
+            reachStale = true;
+            extentVersion++;
+        }
+    }
+}
+
+//publish where every body is now for other processes, placeBodies has just worked it out
+void exportBodies() {
+    if(exportName == NULL || bodies.size() == 0) return;
+    if(!sharedBodies.isOpen() || sharedBodies.bodyCount() != (uint32_t) bodies.size()) {
+        std::vector<const char*> names(bodies.size());
+        for(int i = 0; i < bodies.size(); i++) {
+            names[i] = bodies.satellite[i]->getName();
+        }
+        if(!sharedBodies.create(exportName, names.size(), &names[0])) {
+            std::cerr << "Failed to create shared memory " << exportName << ", not exporting" << std::endl;
+            exportName = NULL;
+            return;
+        }
+    }
+    sharedBodies.publish(playhead >= 0 ? playhead : simTicks, (const float (*)[4]) &bodies.loc[0],
+            &bodies.extent[0], bodies.size());
+}
+
+//ticks a second the simulation thread runs at
+const int SIM_HZ = 60;
+//when the simulation falls this many ticks behind it gives up on catching up
+const int SIM_MAX_BEHIND = 5;
+//the simulation thread, NULL while the benchmark runs it a tick per frame instead
+std::thread* simThread;
+std::atomic<bool> simRunning;
+
+//do what input asked for since the last tick, false if it didn't ask for anything
+bool applySimCommands() {
+    SimCommand c;
+    bool any = false;
+    while(simCommands.pop(c)) {
+        any = true;
+        if(c.kind == SIM_SPEED && c.body >= 0 && c.body < bodies.size()) {
+            bodies.rotSpeed[c.body] += c.amount;
+        } else if(c.kind == SIM_SCRUB) {
+            scrub(c.amount);
+        }
+    }
+    return any;
+}
+
+void placeJob(void*, int sun) {
+    if(!systemPlacing[sun]) return;
+    suns[sun]->place(mat4(1.0f));
+}
+
+void updateSystemReach() {
+    systemReach.resize(suns.size());
+    for(size_t i = 0; i < suns.size(); i++) {
+        //a sun's own orbit moves it around its center, then its system reaches out from there
+        systemReach[i] = bodies.radius[suns[i]->getBody()] + suns[i]->getBound(&bodies.extent[0]);
+    }
+    reachStale = false;
+}
+
+//whether a system is far enough past the far plane, or past where it shrinks to one impostor,
+//that it won't be drawn body by body for a while yet
+//the margin is there so it's placed again a few frames before it's needed
+bool systemFar(int sun, const SimView& view) {
+    if(view.pixels <= 0) return false;
+    vec4 d = suns[sun]->getCenter() - view.eye;
+    float distance = length(vec3(d.x, d.y, d.z));
+    float reach = systemReach[sun];
+    if(distance - reach > Z_FAR * SYSTEM_SIM_MARGIN) return true;
+    return reach * view.pixels * SYSTEM_SIM_MARGIN < view.lodPixels * distance;
+}
+
+//work out the world location of every body from the orbits, moved is whether any angle changed
+//systems far from the camera are left where they were until it comes back, unless
+//everything is being exported, where somebody else may be looking at them
+//false if nothing had to be placed
+bool placeBodies(bool moved) {
+    PROFILE_ZONE("placeBodies");
+    //a new scene hasn't been placed anywhere yet, so the first tick of one places everything
+    bool fresh = reachStale || systemReach.size() != suns.size();
+    if(fresh) {
+        updateSystemReach();
+        systemUnplaced.assign(suns.size(), 1);
+        moved = true;
+    }
+    //a far system only needs placing once the camera has come back to it
+    bool looked = simViews.update();
+    if(!moved && !looked) return false;
+    if(shards.running()) {
+        if(!moved) return false;
+        memcpy(shards.anglesIn(), &bodies.rot[0], bodies.size() * sizeof(float));
+        if(shards.step()) {
+            memcpy((void*) &bodies.loc[0], shards.positionsOut(), bodies.size() * sizeof(vec4));
+            deferredSystems = 0;
+            return true;
+        }
+        std::cerr << "Every shard worker is gone, placing everything here" << std::endl;
+    }
+    const SimView& view = simViews.reading();
+    systemPlacing.resize(suns.size());
+    int placing = 0;
+    deferredSystems = 0;
+    for(size_t i = 0; i < suns.size(); i++) {
+        if(moved) systemUnplaced[i] = 1;
+        bool far = !fresh && exportName == NULL && systemFar(i, view);
+        systemPlacing[i] = systemUnplaced[i] && !far;
+        systemUnplaced[i] = systemUnplaced[i] && far;
+        placing += systemPlacing[i];
+        deferredSystems += systemUnplaced[i];
+    }
+    if(placing == 0) return false;
+    //each system only writes the locations of its own bodies
+    if(placeGraph.size() != (int) suns.size()) {
+        placeGraph.clear();
+        for(size_t i = 0; i < suns.size(); i++) {
+            placeGraph.add("place", placeJob, NULL, i);
+        }
+    }
+    jobs.run(placeGraph);
+    return true;
+}
+
+//fill in the next frame and hand it over to rendering
+void publishFrame() {
+    SimFrame& f = simFrames.writing();
+    f.tick = playhead >= 0 ? playhead : simTicks;
+    f.rot = bodies.rot;
+    f.loc = bodies.loc;
+    f.extent = bodies.extent;
+    f.extentVersion = extentVersion;
+    f.reach = systemReach;
+    f.contacts = collisions.touching().size();
+    f.lastContact = lastContact;
+    f.recordedTicks = timeline.empty() ? 0 : timeline.last() - timeline.first() + 1;
+    f.recordedBytes = timeline.bytes();
+    f.rawBytes = timeline.rawBytes();
+    f.scrubbing = playhead >= 0;
+    f.scrubbedBack = f.scrubbing ? timeline.last() - playhead : 0;
+    f.workers = shards.size();
+    f.deferred = deferredSystems;
+    simFrames.publish();
+}
+
+//one tick of the simulation, everything that changes the bodies happens here
+//tick is false to publish where everything is without moving it
+//a tick that changes nothing publishes nothing, so rendering knows there's nothing new to draw
+void simStep(bool tick) {
+    PROFILE_ZONE("simStep");
+    bool changed = applySimCommands();
+    if(tick) {
+        changed = tickBodies() || changed;
+    } else {
+        changed = true;
+    }
+    //contacts and the export only change with where things are
+    if(placeBodies(changed)) {
+        updateContacts();
+        exportBodies();
+        changed = true;
+    }
+    if(changed) {
+        publishFrame();
+    }
+}
+
+//tick SIM_HZ times a second until stopSimulation()
+void simLoop() {
+    typedef std::chrono::steady_clock Clock;
+    const Clock::duration period = std::chrono::microseconds(1000000 / SIM_HZ);
+    Clock::time_point next = Clock::now();
+    while(simRunning) {
+        simStep(true);
+        next += period;
+        Clock::time_point now = Clock::now();
+        //a huge scene or a busy machine, carry on from now rather than rushing
+        if(now - next > SIM_MAX_BEHIND * period) {
+            next = now;
+        }
+        std::this_thread::sleep_until(next);
+    }
+}
+
+//publish the scene as built and start ticking it on its own thread
+void startSimulation() {
+    simStep(false);
+    simRunning = true;
+    simThread = new std::thread(simLoop);
+}
+
+//finish the tick in progress and stop, before exit() tears down what it uses
+void stopSimulation() {
+    if(simThread == NULL) return;
+    simRunning = false;
+    simThread->join();
+    delete simThread;
+    simThread = NULL;
+}
+
+//batch runs (--batch), the simulation with no window writing positions out
+//ticks to run, 0 = open the window as usual
+int batchTicks = 0;
+//write positions every this many ticks, tick 0 always goes out
+int batchStride = 1;
+//where they go, "-" = stdout
+const char* batchOut = "-";
+//csv or binary, NULL = binary for .bin files and csv otherwise
+const char* batchFormat = NULL;
+//worker threads, 0 = one per core
+int batchThreads = 0;
+//how much the output frames computed at once may take, two sets of these are around
+const size_t BATCH_BUFFER_BYTES = 32 << 20;
+
+// The binary trajectory layout, in the byte order of the machine:
+//   BatchHeader
+//   frameCount x { uint64_t tick, bodyCount x float[3] world position }
+// Body ids are the order the scene lists them in (--save-scene shows it).
+struct BatchHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t bodyCount;
+    uint32_t stride;
+    uint32_t frameCount;
+    uint64_t ticks;
+};
+const char BATCH_MAGIC[8] = { 'S', 'O', 'L', 'T', 'R', 'A', 'J', 0 };
+const uint32_t BATCH_VERSION = 1;
+
+//one batch worker, it owns whole solar systems so it never touches another's bodies
+struct BatchShard {
+    std::vector<Satellite*> suns;
+    std::vector<Body> bodies;
+};
+
+//run a shard through frames output frames starting at tick, writing positions into out
+//the same tick and placement as simStep, so the numbers match a window run to the bit
+void batchWork(const BatchShard& shard, int tick, int frames, float* out) {
+    int n = bodies.size();
+    float* rot = bodies.rot.data();
+    const float* rotSpeed = bodies.rotSpeed.data();
+    for(int f = 0; f < frames; f++, tick += batchStride) {
+        //tick 0 is the scene as built
+        for(int t = 0; t < (tick == 0 ? 0 : batchStride); t++) {
+            for(size_t i = 0; i < shard.bodies.size(); i++) {
+                Body b = shard.bodies[i];
+                rot[b] += rotSpeed[b];
+            }
+        }
+        for(size_t i = 0; i < shard.suns.size(); i++) {
+            shard.suns[i]->place(mat4(1.0f));
+        }
+        float* frame = out + (size_t) f * n * 3;
+        for(size_t i = 0; i < shard.bodies.size(); i++) {
+            Body b = shard.bodies[i];
+            frame[b * 3 + 0] = bodies.loc[b].x;
+            frame[b * 3 + 1] = bodies.loc[b].y;
+            frame[b * 3 + 2] = bodies.loc[b].z;
+        }
+    }
+}
+
+//write frames output frames starting at tick
+void batchWrite(FILE* fp, bool csv, int tick, int frames, const float* positions) {
+    int n = bodies.size();
+    for(int f = 0; f < frames; f++, tick += batchStride) {
+        const float* frame = positions + (size_t) f * n * 3;
+        if(csv) {
+            for(int b = 0; b < n; b++) {
+                fprintf(fp, "%d,%d,%.9g,%.9g,%.9g\n", tick, b, frame[b * 3], frame[b * 3 + 1], frame[b * 3 + 2]);
+            }
+        } else {
+            uint64_t t = tick;
+            fwrite(&t, sizeof(t), 1, fp);
+            fwrite(frame, sizeof(float) * 3, n, fp);
+        }
+    }
+}
+
+//build the scene, run batchTicks ticks on every core and write the positions out
+//returns the exit code
+int runBatch() {
+    //stars first like a window run, they take their random numbers before the scene's
+    makeStars();
+    if(!describeScene()) {
+        return 1;
+    }
+    buildScene(scene);
+    bool csv = batchFormat != NULL ? strcmp(batchFormat, "csv") == 0
+        : strlen(batchOut) < 4 || strcmp(batchOut + strlen(batchOut) - 4, ".bin") != 0;
+    FILE* fp = strcmp(batchOut, "-") == 0 ? stdout : fopen(batchOut, csv ? "w" : "wb");
+    if(fp == NULL) {
+        std::cerr << "Failed to open " << batchOut << std::endl;
+        return 1;
+    }
+    int n = bodies.size();
+    //the last frame is on a whole stride, at or past batchTicks
+    int totalFrames = (batchTicks + batchStride - 1) / batchStride + 1;
+    int lastTick = (totalFrames - 1) * batchStride;
+    if(lastTick != batchTicks) {
+        fprintf(stderr, "%d ticks isn't a whole number of strides of %d, running %d\n", batchTicks, batchStride, lastTick);
+    }
+    //hand out the biggest systems first, each to whoever has the fewest bodies so far
+    int threads = batchThreads > 0 ? batchThreads : std::max((int) std::thread::hardware_concurrency(), 1);
+    threads = std::max(std::min(threads, (int) suns.size()), 1);
+    std::vector<BatchShard> shards(threads);
+    std::vector< std::pair<int, Satellite*> > systems;
+    for(size_t i = 0; i < suns.size(); i++) {
+        std::vector<Body> system;
+        suns[i]->collectBodies(system);
+        systems.push_back(std::make_pair(-(int) system.size(), suns[i]));
+    }
+    std::sort(systems.begin(), systems.end());
+    for(size_t i = 0; i < systems.size(); i++) {
+        BatchShard* smallest = &shards[0];
+        for(int s = 1; s < threads; s++) {
+            if(shards[s].bodies.size() < smallest->bodies.size()) smallest = &shards[s];
+        }
+        smallest->suns.push_back(systems[i].second);
+        systems[i].second->collectBodies(smallest->bodies);
+    }
+    if(csv) {
+        fprintf(fp, "tick,body,x,y,z\n");
+    } else {
+        BatchHeader h;
+        memcpy(h.magic, BATCH_MAGIC, sizeof(h.magic));
+        h.version = BATCH_VERSION;
+        h.bodyCount = n;
+        h.stride = batchStride;
+        h.frameCount = totalFrames;
+        h.ticks = lastTick;
+        fwrite(&h, sizeof(h), 1, fp);
+    }
+    //frames are worked out a chunk at a time, the last chunk is written while the workers do the next
+    int chunk = std::max((int) (BATCH_BUFFER_BYTES / ((size_t) std::max(n, 1) * 3 * sizeof(float))), 1);
+    std::vector<float> buffers[2];
+    double start = milliseconds();
+    int written = 0;
+    int computed = 0;
+    int pending = 0;
+    std::vector<float>* ready = NULL;
+    //a failed write stops it, the workers of the chunk in flight are joined first
+    for(int k = 0; written < totalFrames && !ferror(fp); k++) {
+        int frames = std::min(chunk, totalFrames - computed);
+        std::vector<float>& out = buffers[k % 2];
+        std::vector<std::thread> workers;
+        if(frames > 0) {
+            out.resize((size_t) frames * n * 3);
+            for(int s = 0; s < threads; s++) {
+                workers.push_back(std::thread(batchWork, std::cref(shards[s]), computed * batchStride, frames, out.data()));
+            }
+        }
+        if(ready != NULL) {
+            batchWrite(fp, csv, written * batchStride, pending, ready->data());
+            written += pending;
+        }
+        for(size_t w = 0; w < workers.size(); w++) {
+            workers[w].join();
+        }
+        ready = frames > 0 ? &out : NULL;
+        pending = frames;
+        computed += frames;
+    }
+    double seconds = (milliseconds() - start) / 1000.0;
+    bool failed = ferror(fp) != 0;
+    //buffered writes can fail only once they're flushed
+    if(fp != stdout) failed = fclose(fp) != 0 || failed;
+    else failed = fflush(fp) != 0 || failed;
+    if(failed) {
+        std::cerr << "Failed to write " << batchOut << std::endl;
+        return 1;
+    }
+    fprintf(stderr, "Simulated %d ticks of %d bodies on %d threads in %.3f s: %.0f ticks/s, %d frames written\n",
+            lastTick, n, threads, seconds, lastTick / std::max(seconds, 1e-9), totalFrames);
+    return 0;
+}
+
+//the body under a window position, -1 if there's nothing there
+Body pickBody(int x, int y) {
+    PROFILE_ZONE("pickBody");
+    if(shown->loc.empty()) return -1;
+    //the ray through the pixel in view space, the camera looks down -z
+    float ndcX = 2.0 * x / windowWidth - 1.0;
+    float ndcY = 1.0 - 2.0 * y / windowHeight;
+    vec4 dir = vec4(ndcX / projection_view[0][0], ndcY / projection_view[1][1], -1.0, 0.0);
+    //camera_view is a rotation then a translation, undo them to get to world space
+    mat4 rotation = camera_view;
+    rotation[0][3] = rotation[1][3] = rotation[2][3] = 0.0;
+    mat4 inverse = transpose(rotation);
+    vec4 eye = -(inverse * vec4(camera_view[0][3], camera_view[1][3], camera_view[2][3], 0.0));
+    dir = inverse * dir;
+    float t;
+    return bvh.raycast(vec3(eye.x, eye.y, eye.z), vec3(dir.x, dir.y, dir.z), &shown->loc[0], t);
+}
+
+//the input handlers, handleInput() calls these for each queued up event
+//each returns whether it changed anything a frame shows
+
+//a key was pressed
+bool inputKeyboard(unsigned char key)
 {
+    bool changed = true;
     if (key == 27) // esc
         exit(0);
     else if (key == 'q' or key == 'Q') // q
@@ -927,21 +2877,47 @@ void callbackKeyboard(unsigned char key, int x, int y)
     else if (key == 'a') {
         drawAxes = !drawAxes;
     }
+    else if (key == 'b') {
+        useImpostors = !useImpostors;
+    }
+    else if (key == 'x') {
+        mergeOnContact = !mergeOnContact;
+    }
+    else if (key == '[' || key == ']') {
+        simCommand(SIM_SCRUB, -1, key == '[' ? -1 : 1);
+    }
+    else if (key == '{' || key == '}') {
+        simCommand(SIM_SCRUB, -1, key == '{' ? -SCRUB_JUMP : SCRUB_JUMP);
+    }
     else if (key == 'd') {
         staring = !staring;
     }
     else if (key == 'r') {
         setDefaults();
     }
+    else if (key == 'c') {
+        //record the next CPU_TRACE_FRAMES frames
+        Profiler::start(CPU_TRACE_FRAMES, CPU_TRACE_FILE);
+    }
+    else if (key == 'p') {
+        if(gpuProfiler.dump(GPU_PROFILE_FILE)) {
+            printf("gpu timings written to %s\n", GPU_PROFILE_FILE);
+        }
+        changed = false;
+    }
     else if (key == '0') {
         camera = -1;
     }
     else if (isdigit(key)) {
         int cam = key - '0';
-        if(cam < sats.size()) {
-            camera = cam;
+        changed = cam < (int) sats.size();
+        if(changed) {
+            camera = sats[cam];
         }
     }
+    else {
+        changed = false;
+    }
     if(camera == -1 && !staring) {
         //move our x/z locations based on what key
         //and what our current angle is at the time
@@ -968,17 +2944,24 @@ void callbackKeyboard(unsigned char key, int x, int y)
         else if (key == 'o') {
             yLoc -= 10.0;
         }
+        else {
+            return changed;
+        }
     } else {
         //if we have a camera, we can use - and + to change speed of planet
         if (key == '-') {
-            sats[camera]->increaseSpeed(-0.1);
+            bodyIncreaseSpeed(camera, -0.1);
         } else if (key == '=') {
-            sats[camera]->increaseSpeed(0.1);
+            bodyIncreaseSpeed(camera, 0.1);
+        } else {
+            return changed;
         }
     }
+    return true;
 }
 
-void callbackKeyboardSpecial(int key, int x, int y) {
+//a special (arrow) key was pressed
+bool inputKeyboardSpecial(int key) {
     if(!staring) {
         //if we aren't staring update the angle
         if (key == GLUT_KEY_LEFT)
@@ -989,49 +2972,265 @@ void callbackKeyboardSpecial(int key, int x, int y) {
             zRot -= 0.017;
         else if (key == GLUT_KEY_UP)
             zRot += 0.017;
+        else
+            return false;
+        return true;
     }
+    return false;
 }
 
-// Called when a mouse button is pressed or released
-void callbackMouse(int button, int state, int x, int y)
+//a mouse button was pressed or released
+bool inputMouse(int button, int state, int x, int y)
 {
+    //where the left button went down, to tell a click from a drag
+    static int pressX, pressY;
+    bool changed = x != prevX || y != prevY;
+    if(button == GLUT_LEFT_BUTTON && state == GLUT_DOWN) {
+        pressX = x;
+        pressY = y;
+    } else if(button == GLUT_LEFT_BUTTON && state == GLUT_UP
+            && abs(x - pressX) <= CLICK_SLOP && abs(y - pressY) <= CLICK_SLOP) {
+        //clicking a body rides on it like the number keys do
+        Body picked = pickBody(x, y);
+        if(picked != -1) {
+            changed = true;
+            camera = picked;
+            staring = false;
+        }
+    }
     //each pixel is worth 1/4000th of a degree
     zRot += (y - prevY) * M_PI / 2000.0;
     yRot += (x - prevX) * M_PI / 2000.0;
     prevX = x;
     prevY = y;
+    return changed;
 }
 
-// Called when the mouse is moved with a button pressed
-void callbackMotion(int x, int y)
+//the mouse moved with a button pressed
+bool inputMotion(int x, int y)
 {
+    bool changed = x != prevX || y != prevY;
     zRot += (y - prevY) * M_PI / 2000.0;
     yRot += (x - prevX) * M_PI / 2000.0;
     prevX = x;
     prevY = y;
+    return changed;
 }
 
-// Called when the mouse is moved with no buttons pressed
-void callbackPassiveMotion(int x, int y)
+//the mouse moved with no buttons pressed, only where the next press or drag starts from changes
+bool inputPassiveMotion(int x, int y)
 {
     prevX = x;
     prevY = y;
+    return false;
 }
 
-// Called when the system is idle. Can be called many times per frame.
-void callbackIdle()
+//what each kind of input event is called in the --record-input log
+const char* const INPUT_NAMES[] = { "key", "special", "mouse", "motion", "passive" };
+
+//apply everything input since the last frame, in the order it happened, true if any of it changed something
+//runs once a frame after the newest simulation frame is taken, so clicks pick from what's drawn
+//or straight away from the callbacks while nothing's being drawn, then what's drawn is what's on screen
+bool handleInput() {
+    PROFILE_ZONE("handleInput");
+    static std::vector<InputEvent> events;
+    InputEvent next;
+    while(inputQueue.pop(next)) {
+        events.push_back(next);
+    }
+    bool changed = false;
+    //the first event of the run of moves the current one ends
+    size_t run = 0;
+    for(size_t i = 0; i < events.size(); i++) {
+        const InputEvent& e = events[i];
+        //a run of moves only needs the last one, the deltas in between add up to the same thing
+        if((e.kind == INPUT_MOTION || e.kind == INPUT_PASSIVE) && i + 1 < events.size()
+                && events[i + 1].kind == e.kind) {
+            continue;
+        }
+        if(inputLog != NULL) {
+            fprintf(inputLog, "%.3f %s %d %d %d %d\n", e.time, INPUT_NAMES[e.kind], e.key, e.state, e.x, e.y);
+        }
+        bool did = false;
+        switch(e.kind) {
+            case INPUT_KEY:
+                did = inputKeyboard(e.key);
+                break;
+            case INPUT_SPECIAL:
+                did = inputKeyboardSpecial(e.key);
+                break;
+            case INPUT_MOUSE:
+                did = inputMouse(e.key, e.state, e.x, e.y);
+                break;
+            case INPUT_MOTION:
+                did = inputMotion(e.x, e.y);
+                break;
+            case INPUT_PASSIVE:
+                did = inputPassiveMotion(e.x, e.y);
+                break;
+        }
+        //coalesced or not, every event of the run waited until this frame to show
+        if(did) {
+            for(size_t k = run; k <= i; k++) {
+                latchedInput.push_back(events[k].time);
+            }
+            changed = true;
+        }
+        run = i + 1;
+    }
+    events.clear();
+    return changed;
+}
+
+//draw another frame once glut gets to it
+void redraw() {
+    redrawPosted = true;
+    glutPostRedisplay();
+}
+
+//whether a frame drawn now could look any different from the one on screen
+//input and reshapes ask for a redraw themselves, this covers everything else
+bool damaged() {
+    //the benchmark and cpu captures count frames, and anything spinning moves every tick
+    if(benchmarking || Profiler::enabled() || spinning) return true;
+    //a paused simulation only publishes when something changed, like a scrub or a merge
+    if(simFrames.fresh()) return true;
+    //textures still streaming in get sharper as they arrive
+    if(virtualTextures.busy()) return true;
+    //programs still compiling get drawn with once they're done
+    return shadersMs < 0;
+}
+
+// Called when the window needs to be redrawn.
+void callbackDisplay()
 {
-    //tell all suns to tick
-    for(std::vector<Satellite*>::iterator i = suns.begin(); i != suns.end(); ++i) {
-        (*i)->tick();
+    //count down an active cpu capture, it writes itself out once the last frame is done
+    if(Profiler::frame()) {
+        printf("cpu trace written to %s\n", CPU_TRACE_FILE);
+    }
+    PROFILE_ZONE("callbackDisplay");
+    redrawPosted = false;
+    double start = milliseconds();
+    frameStats = FrameStats();
+    //the benchmark ticks exactly once a frame instead of on the simulation thread
+    if(benchmarking) {
+        benchmarkScript(benchmarkFrame);
+        simStep(true);
+        frameStats.simMs = milliseconds() - start;
     }
+    //last frame's bvh refit reads the frame it drew, which is about to be let go of
+    jobs.wait(bvhGraph);
+    //whatever the driver has finished compiling since the last frame gets drawn from now on
+    pollPrograms(false);
+    //draw the newest tick the simulation has finished, or the last one again
+    bool fresh = simFrames.update();
+    shown = &simFrames.reading();
+    //everything input since the last frame, clicks still see the last frame's camera
+    bool moved = handleInput();
+    //bodies that moved, or a camera or settings that did, can want other texture tiles
+    if(fresh || moved) {
+        virtualTextures.touch();
+    }
+    //then the camera from that input and the frame about to be drawn, right before anything uses it
+    doCamera();
+    doProjection();
+    latchCamera();
+    publishView();
+    //read back the timings from a few frames ago and start a new set
+    gpuProfiler.beginFrame();
+    int frameZone = gpuProfiler.begin("frame");
+    //clear the screen
+    glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+
+    //draw our things
+    doOverlay();
+    doModel();
+    //clicks pick from what's on screen, refit while this frame is swapped and the next one starts
+    if(bvhGraph.size() == 0) {
+        bvhGraph.add("updateBvh", bvhJob, NULL);
+    }
+    jobs.submit(bvhGraph);
+    gpuProfiler.end(frameZone);
+    double cpu = milliseconds() - start;
+    //carry straight on with the next frame only if it could look any different
+    if(damaged()) {
+        redraw();
+    }
+    //not sure...
+    glutSwapBuffers();
+    if(firstFrameMs < 0) {
+        reportFirstFrame();
+    }
+    measureLatency();
+    if(benchmarking) {
+        benchmarkRecord(start, cpu);
+    }
+}
+
+//input just queued up: the frame on its way handles it, or if there isn't one
+//handle it now and only draw again if it changed anything
+void inputArrived() {
+    if(redrawPosted) {
+        return;
+    }
+    //a click raycasts the bvh, which last frame's refit can still be writing
+    jobs.wait(bvhGraph);
+    if(handleInput()) {
+        redraw();
+    }
+}
+
+// Called when the window is resized.
+void callbackReshape (int w, int h){
+    windowWidth = w;
+    windowHeight = h;
+    glViewport(0, 0, w, h);
+    virtualTextures.touch();
+    redraw();
+}
+
+// Called when a key is pressed. x, y is the current mouse position.
+// every input callback wakes up a window that's stopped redrawing, if the input changes anything
+void callbackKeyboard(unsigned char key, int x, int y)
+{
+    queueInput(INPUT_KEY, key, 0, x, y);
+    inputArrived();
+}
+
+void callbackKeyboardSpecial(int key, int x, int y) {
+    queueInput(INPUT_SPECIAL, key, 0, x, y);
+    inputArrived();
+}
+
+// Called when a mouse button is pressed or released
+void callbackMouse(int button, int state, int x, int y)
+{
+    queueInput(INPUT_MOUSE, button, state, x, y);
+    inputArrived();
+}
+
+// Called when the mouse is moved with a button pressed
+void callbackMotion(int x, int y)
+{
+    queueInput(INPUT_MOTION, 0, 0, x, y);
+    inputArrived();
+}
+
+// Called when the mouse is moved with no buttons pressed
+void callbackPassiveMotion(int x, int y)
+{
+    queueInput(INPUT_PASSIVE, 0, 0, x, y);
+    inputArrived();
 }
 
 // Called when the timer expires
+// while nothing is being redrawn this is what notices the simulation publishing something
 void callbackTimer(int)
 {
-    glutTimerFunc(1000/30, callbackTimer, 0);
-    glutPostRedisplay();
+    glutTimerFunc(1000/SIM_HZ, callbackTimer, 0);
+    if(damaged()) {
+        redraw();
+    }
 }
 
 void initCallbacks()
@@ -1043,15 +3242,200 @@ void initCallbacks()
     glutMouseFunc(callbackMouse);
     glutMotionFunc(callbackMotion);
     glutPassiveMotionFunc(callbackPassiveMotion);
-    glutIdleFunc(callbackIdle);
-    glutTimerFunc(1000/30, callbackTimer, 0);
+    glutTimerFunc(1000/SIM_HZ, callbackTimer, 0);
 }
 
 int main(int argc, char** argv)
 {
+    startupStart = milliseconds();
+    programName = argv[0];
+    bool framesGiven = false;
+    bool seedGiven = false;
+    for(int i = 1; i < argc; i++) {
+        //--trace captures startup plus the first CPU_TRACE_FRAMES frames
+        if(strcmp(argv[i], "--trace") == 0) {
+            Profiler::start(CPU_TRACE_FRAMES, CPU_TRACE_FILE);
+        }
+        //--benchmark runs the scripted flythrough and prints json results
+        else if(strcmp(argv[i], "--benchmark") == 0) {
+            benchmarking = true;
+        }
+        //--sweep systems|stars|depth reruns the benchmark over a range of sizes as csv
+        else if(strcmp(argv[i], "--sweep") == 0 && i + 1 < argc) {
+            sweepAxis = argv[++i];
+            if(strcmp(sweepAxis, "systems") != 0 && strcmp(sweepAxis, "stars") != 0
+                    && strcmp(sweepAxis, "depth") != 0) {
+                std::cerr << "Unknown sweep " << sweepAxis << ", expected systems, stars or depth" << std::endl;
+                return 1;
+            }
+            benchmarking = true;
+        }
+        else if(strcmp(argv[i], "--frames") == 0 && i + 1 < argc) {
+            benchmarkFrames = atoi(argv[++i]);
+            framesGiven = true;
+        }
+        //scene settings
+        else if(strcmp(argv[i], "--systems") == 0 && i + 1 < argc) {
+            numSolarSystems = std::max(atoi(argv[++i]), 0);
+        }
+        else if(strcmp(argv[i], "--stars") == 0 && i + 1 < argc) {
+            numStars = std::max(atoi(argv[++i]), 0);
+        }
+        else if(strcmp(argv[i], "--star-vbo") == 0) {
+            starVbo = true;
+            programFiles[PROGRAM_STARS].vertexFile = "vshaderstars.glsl";
+        }
+        else if(strcmp(argv[i], "--depth") == 0 && i + 1 < argc) {
+            moonDepth = std::max(atoi(argv[++i]), 1);
+        }
+        //--export [name] publishes every body's position in shared memory (see tools/bodywatch)
+        else if(strcmp(argv[i], "--export") == 0) {
+            exportName = i + 1 < argc && argv[i + 1][0] == '/' ? argv[++i] : DEFAULT_EXPORT_NAME;
+        }
+        else if(strcmp(argv[i], "--record-mb") == 0 && i + 1 < argc) {
+            timelineMB = std::max(atoi(argv[++i]), 0);
+        }
+        else if(strcmp(argv[i], "--trajectory") == 0 && i + 1 < argc) {
+            trajectorySize = std::max(atoi(argv[++i]), 3);
+        }
+        else if(strcmp(argv[i], "--space") == 0 && i + 3 < argc) {
+            //rand() % (space / 4) further down needs these to be at least 4
+            spaceX = std::max(atoi(argv[++i]), 4);
+            spaceY = std::max(atoi(argv[++i]), 4);
+            spaceZ = std::max(atoi(argv[++i]), 4);
+        }
+        else if(strcmp(argv[i], "--seed") == 0 && i + 1 < argc) {
+            randomSeed = strtoul(argv[++i], NULL, 10);
+            seedGiven = true;
+        }
+        else if(strcmp(argv[i], "--out") == 0 && i + 1 < argc) {
+            benchmarkOut = argv[++i];
+        }
+        //--record-input file logs every input event with when it came in
+        else if(strcmp(argv[i], "--record-input") == 0 && i + 1 < argc) {
+            inputLogFile = argv[++i];
+        }
+        //--batch ticks runs that many ticks with no window and writes the positions out
+        else if(strcmp(argv[i], "--batch") == 0 && i + 1 < argc) {
+            batchTicks = std::max(atoi(argv[++i]), 0);
+        }
+        else if(strcmp(argv[i], "--stride") == 0 && i + 1 < argc) {
+            batchStride = std::max(atoi(argv[++i]), 1);
+        }
+        //--dump file (- for stdout), csv unless it ends in .bin or --format says otherwise
+        else if(strcmp(argv[i], "--dump") == 0 && i + 1 < argc) {
+            batchOut = argv[++i];
+        }
+        else if(strcmp(argv[i], "--format") == 0 && i + 1 < argc) {
+            batchFormat = argv[++i];
+            if(strcmp(batchFormat, "csv") != 0 && strcmp(batchFormat, "binary") != 0) {
+                std::cerr << "Unknown format " << batchFormat << ", expected csv or binary" << std::endl;
+                return 1;
+            }
+        }
+        else if(strcmp(argv[i], "--threads") == 0 && i + 1 < argc) {
+            batchThreads = std::max(atoi(argv[++i]), 0);
+        }
+        //--jobs n runs the per-frame jobs on n worker threads besides the main one
+        else if(strcmp(argv[i], "--jobs") == 0 && i + 1 < argc) {
+            jobThreads = std::max(atoi(argv[++i]), 0);
+        }
+        //--workers n places the solar systems in n separate processes
+        else if(strcmp(argv[i], "--workers") == 0 && i + 1 < argc) {
+            shardWorkers = std::min(std::max(atoi(argv[++i]), 0), SHARD_MAX_WORKERS);
+        }
+        //--shard-worker index input output is how ShardPool starts the workers, not for people
+        else if(strcmp(argv[i], "--shard-worker") == 0 && i + 3 < argc) {
+            shardWorkerArgs = argv + i + 1;
+            i += 3;
+        }
+        //--system-lod pixels draws whole systems smaller than that as one impostor, 0 = never
+        else if(strcmp(argv[i], "--system-lod") == 0 && i + 1 < argc) {
+            systemLodPixels = std::max((float) atof(argv[++i]), 0.0f);
+        }
+        //--texture-mb n caps what the planet textures hold on to, 0 draws them flat
+        else if(strcmp(argv[i], "--texture-mb") == 0 && i + 1 < argc) {
+            textureMB = std::max(atoi(argv[++i]), 0);
+        }
+        //--scene file loads a text or binary scene instead of generating one
+        else if(strcmp(argv[i], "--scene") == 0 && i + 1 < argc) {
+            sceneFile = argv[++i];
+        }
+        //--save-scene file writes the scene out and quits, .scb files are binary
+        else if(strcmp(argv[i], "--save-scene") == 0 && i + 1 < argc) {
+            saveSceneFile = argv[++i];
+        }
+    }
+    //benchmarks and batch runs always get a seed so every run builds the same galaxy
+    if((benchmarking || batchTicks > 0) && randomSeed == 0) {
+        if(seedGiven) {
+            std::cerr << "--seed 0 means unseeded, benchmarks and batch runs always have a seed, using 1" << std::endl;
+        }
+        randomSeed = 1;
+    }
+    //sweeps start at their first point and default to shorter runs per point
+    if(sweepAxis != NULL) {
+        sweepApply(0);
+        if(!framesGiven) {
+            benchmarkFrames = SWEEP_FRAMES;
+        }
+    }
+    if(benchmarkFrames <= BENCHMARK_WARMUP) {
+        benchmarkFrames = BENCHMARK_WARMUP + 1;
+    }
+    if(randomSeed != 0) {
+        srand(randomSeed);
+    }
+    timeline.setBudget((size_t) timelineMB << 20);
+    //a worker only places bodies, it doesn't need textures or a window
+    if(shardWorkerArgs != NULL) {
+        return runShardWorker();
+    }
+    virtualTextures.setBudget((size_t) textureMB << 20);
+    //converting or exporting a scene doesn't need a window
+    if(saveSceneFile != NULL) {
+        if(!describeScene()) {
+            return 1;
+        }
+        if(!scene.save(saveSceneFile)) {
+            std::cerr << "Failed to write " << saveSceneFile << std::endl;
+            return 1;
+        }
+        printf("Saved %d bodies to %s\n", scene.bodyCount(), saveSceneFile);
+        return 0;
+    }
+    if(batchTicks > 0) {
+        return runBatch();
+    }
+    if(inputLogFile != NULL) {
+        inputLog = fopen(inputLogFile, "w");
+        if(inputLog == NULL) {
+            std::cerr << "Failed to open " << inputLogFile << std::endl;
+            return 1;
+        }
+        fprintf(inputLog, "# time_ms event key state x y\n");
+    }
+    //the cpu side of startup gets going while glut brings the window up
+    if(jobThreads < 0) {
+        jobThreads = std::max((int) std::thread::hardware_concurrency() - 1, 0);
+    }
+    jobs.start(jobThreads);
+    atexit(stopJobs);
+    startStartup();
     initGlut(argc, argv);
     initCallbacks();
     setDefaults();
+    if(shardWorkers > 0) {
+        startShards();
+        //registered first so it runs after the simulation thread has stopped
+        atexit(stopShards);
+    }
+    //the benchmark steps the simulation itself so every run is the same
+    if(!benchmarking) {
+        startSimulation();
+        atexit(stopSimulation);
+    }
+    atexit(reportLatency);
     glutMainLoop();
     return 0;
 }
@@ -35,13 +35,6 @@ class mat2 {
     mat2( GLfloat m00, GLfloat m10, GLfloat m01, GLfloat m11 )
 	{ _m[0] = vec2( m00, m01 ); _m[1] = vec2( m10, m11 ); }
 
-    mat2( const mat2& m ) {
-	if ( *this != m ) {
-	    _m[0] = m._m[0];
-	    _m[1] = m._m[1];
-	} 
-    }
-
     //
     //  --- Indexing Operator ---
     //
@@ -213,15 +206,6 @@ class mat3 {
 	    _m[2] = vec3( m20, m21, m22 );
 	}
 
-    mat3( const mat3& m )
-	{
-	    if ( *this != m ) {
-		_m[0] = m._m[0];
-		_m[1] = m._m[1];
-		_m[2] = m._m[2];
-	    } 
-	}
-
     //
     //  --- Indexing Operator ---
     //
@@ -402,16 +386,6 @@ class mat4 {
 	    _m[3] = vec4( m30, m31, m32, m33 );
 	}
 
-    mat4( const mat4& m )
-	{
-	    if ( *this != m ) {
-		_m[0] = m._m[0];
-		_m[1] = m._m[1];
-		_m[2] = m._m[2];
-		_m[3] = m._m[3];
-	    } 
-	}
-
     //
     //  --- Indexing Operator ---
     //
@@ -0,0 +1,193 @@
+// ------------------------
+// Dependency order test for Jobs.h
+// ------------------------
+//
+// usage: test_jobs
+//
+// Builds a random graph of jobs with after() edges, some of them pinned, and
+// runs it over and over on a few worker threads: with run(), with two graphs
+// submit()ed at once and then wait()ed for, and from two threads that aren't
+// workers at once. Every job has to run exactly once a run, after all of its
+// dependencies are done, the pinned ones on the thread that's waiting, and
+// never on another thread that's waiting for a graph of its own. And a thread
+// waiting on a job that takes a while has to sleep rather than spin. Built with
+// -fsanitize=thread by make test so a race shows up as well. Exits non-zero
+// if anything's wrong.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <atomic>
+#include <chrono>
+#include <vector>
+#include <thread>
+
+#include "Jobs.h"
+
+const int JOBS = 300;
+const int MAX_DEPENDENCIES = 3;
+const int RUNS = 200;
+const int THREADS = 4;
+//every this many jobs is pinned
+const int PINNED_EVERY = 17;
+//how long the slow job takes, and how much of that waiting for it may spend on the cpu
+const int SLOW_MS = 300;
+const double SLOW_CPU_MS = 50;
+
+std::vector<std::vector<int> > dependencies;
+std::atomic<int> failures(0);
+
+//what one graph's jobs did this run
+struct Check {
+    std::atomic<int> runs[JOBS];
+    std::atomic<bool> done[JOBS];
+    //the thread waiting for the graph, and one waiting for another graph that mustn't run this one's jobs
+    std::thread::id waiter;
+    std::thread::id stranger;
+
+    void reset() {
+        for(int i = 0; i < JOBS; i++) {
+            runs[i] = 0;
+            done[i] = false;
+        }
+    }
+};
+
+void job( void* data, int index ) {
+    Check* c = (Check*) data;
+    for(size_t i = 0; i < dependencies[index].size(); i++) {
+        int d = dependencies[index][i];
+        if(!c->done[d].load(std::memory_order_acquire)) {
+            if(failures++ < 5) fprintf(stderr, "job %d started before job %d it waits for\n", index, d);
+        }
+    }
+    if(index % PINNED_EVERY == 0 && std::this_thread::get_id() != c->waiter) {
+        if(failures++ < 5) fprintf(stderr, "pinned job %d ran on a worker\n", index);
+    }
+    if(std::this_thread::get_id() == c->stranger) {
+        if(failures++ < 5) fprintf(stderr, "job %d ran on a thread waiting for another graph\n", index);
+    }
+    c->runs[index]++;
+    c->done[index].store(true, std::memory_order_release);
+}
+
+//holds up a worker for a while
+void slow( void*, int ) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(SLOW_MS));
+}
+
+//cpu time this thread has used, in ms
+double threadMs() {
+    struct timespec t;
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &t);
+    return t.tv_sec * 1000.0 + t.tv_nsec / 1e6;
+}
+
+void build( JobGraph& g, Check& c ) {
+    for(int i = 0; i < JOBS; i++) {
+        g.add("job", job, &c, i, i % PINNED_EVERY == 0);
+    }
+    for(int i = 0; i < JOBS; i++) {
+        for(size_t k = 0; k < dependencies[i].size(); k++) {
+            g.after(i, dependencies[i][k]);
+        }
+    }
+}
+
+//after a run every job is done, once
+void verify( const JobGraph& g, Check& c, const char* what ) {
+    if(g.busy()) {
+        if(failures++ < 5) fprintf(stderr, "%s: still busy after waiting\n", what);
+    }
+    for(int i = 0; i < JOBS; i++) {
+        if(c.runs[i] != 1) {
+            if(failures++ < 5) fprintf(stderr, "%s: job %d ran %d times\n", what, i, c.runs[i].load());
+        }
+    }
+    c.reset();
+}
+
+int main()
+{
+    srand(1);
+    //edges only go to earlier jobs, so there are no cycles, and a chain of them goes all the way back
+    dependencies.resize(JOBS);
+    for(int i = 1; i < JOBS; i++) {
+        int count = rand() % (MAX_DEPENDENCIES + 1);
+        for(int k = 0; k < count; k++) {
+            int d = rand() % i;
+            bool seen = false;
+            for(size_t m = 0; m < dependencies[i].size(); m++) {
+                if(dependencies[i][m] == d) seen = true;
+            }
+            if(!seen) dependencies[i].push_back(d);
+        }
+    }
+    Check a, b;
+    a.reset();
+    b.reset();
+    a.waiter = b.waiter = std::this_thread::get_id();
+    JobGraph ga, gb;
+    build(ga, a);
+    build(gb, b);
+
+    //no workers, everything runs on the caller
+    JobSystem jobs;
+    jobs.run(ga);
+    verify(ga, a, "no workers");
+
+    jobs.start(THREADS);
+    for(int r = 0; r < RUNS; r++) {
+        jobs.run(ga);
+        verify(ga, a, "run");
+    }
+    //two graphs in flight at once, waited for in the other order
+    for(int r = 0; r < RUNS; r++) {
+        jobs.submit(ga);
+        jobs.submit(gb);
+        jobs.wait(gb);
+        jobs.wait(ga);
+        verify(ga, a, "submit first");
+        verify(gb, b, "submit second");
+    }
+    //two threads that aren't workers each running their own graph, like rendering and the simulation
+    //it holds off until both know who the other is
+    std::atomic<bool> go(false);
+    std::thread other([&]() {
+        while(!go) {
+            std::this_thread::yield();
+        }
+        for(int r = 0; r < RUNS; r++) {
+            jobs.run(gb);
+            verify(gb, b, "other thread");
+        }
+    });
+    b.waiter = a.stranger = other.get_id();
+    b.stranger = std::this_thread::get_id();
+    go = true;
+    for(int r = 0; r < RUNS; r++) {
+        jobs.run(ga);
+        verify(ga, a, "this thread");
+    }
+    other.join();
+
+    //the slow job goes to a worker, there's nothing else for this thread to do until it's done
+    JobGraph gs;
+    gs.add("slow", slow, NULL);
+    double cpu = threadMs();
+    jobs.run(gs);
+    cpu = threadMs() - cpu;
+    if(cpu > SLOW_CPU_MS) {
+        fprintf(stderr, "waiting %d ms for a job took %.1f ms of cpu\n", SLOW_MS, cpu);
+        failures++;
+    }
+    jobs.stop();
+
+    printf("%d jobs, %d runs on %d threads\n", JOBS, RUNS * 5 + 1, THREADS);
+    if(failures > 0) {
+        printf("%d failures\n", failures.load());
+        return 1;
+    }
+    printf("ok\n");
+    return 0;
+}
@@ -0,0 +1,81 @@
+// ------------------------
+// Stress test for MpscQueue.h
+// ------------------------
+//
+// usage: test_mpscqueue
+//
+// Several producer threads push numbered values onto a small queue (so it's
+// full a lot of the time and goes round many laps) while one consumer pops
+// them. Every value has to come out exactly once, and each producer's in the
+// order it pushed them. Built with -fsanitize=thread by make test so a race
+// on the cells shows up as well. Exits non-zero if anything's wrong.
+
+#include <stdio.h>
+#include <vector>
+#include <thread>
+
+#include "MpscQueue.h"
+
+const int PRODUCERS = 4;
+const int PUSHES = 50000;
+
+struct Value {
+    int producer;
+    int number;
+};
+
+MpscQueue<Value, 64> queue;
+
+void producer( int p ) {
+    for(int n = 0; n < PUSHES; n++) {
+        Value v = { p, n };
+        //full, wait for the consumer to make room
+        while(!queue.push(v)) {
+            std::this_thread::yield();
+        }
+    }
+}
+
+int main()
+{
+    std::vector<std::thread> producers;
+    for(int p = 0; p < PRODUCERS; p++) {
+        producers.push_back(std::thread(producer, p));
+    }
+    //the next number expected from each producer
+    std::vector<int> next(PRODUCERS, 0);
+    int popped = 0, failures = 0;
+    while(popped < PRODUCERS * PUSHES && failures <= 10) {
+        Value v;
+        if(!queue.pop(v)) {
+            std::this_thread::yield();
+            continue;
+        }
+        popped++;
+        if(v.producer < 0 || v.producer >= PRODUCERS) {
+            fprintf(stderr, "popped a value from producer %d\n", v.producer);
+            failures++;
+        } else if(v.number != next[v.producer]) {
+            fprintf(stderr, "producer %d: popped %d, expected %d\n", v.producer, v.number, next[v.producer]);
+            next[v.producer] = v.number + 1;
+            failures++;
+        } else {
+            next[v.producer]++;
+        }
+    }
+    for(size_t p = 0; p < producers.size(); p++) {
+        producers[p].join();
+    }
+    Value extra;
+    if(queue.pop(extra)) {
+        fprintf(stderr, "popped more than was pushed\n");
+        failures++;
+    }
+    printf("%d of %d values popped\n", popped, PRODUCERS * PUSHES);
+    if(failures > 0) {
+        printf("%d failures\n", failures);
+        return 1;
+    }
+    printf("ok\n");
+    return 0;
+}
@@ -0,0 +1,154 @@
+// ------------------------
+// Round trip test for Timeline.h
+// ------------------------
+//
+// usage: test_timeline
+//
+// Records a few thousand ticks of bodies moving like the simulation moves
+// them (with the rounding drift that makes nudges, and speed changes now and
+// then), then seeks every tick still in the recording and checks it comes
+// back within TIMELINE_TOLERANCE. Also checks that a small budget drops the
+// oldest segments (and a budget smaller than one segment keeps the tick
+// numbers going), and that recording carries on correctly after truncate().
+// Exits non-zero if anything doesn't match.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include <vector>
+
+#include "Timeline.h"
+
+const int BODIES = 300;
+const int TICKS = 2000;
+//a seeked angle is within the tolerance of the recorded one, plus what a float loses near 360
+const double ANGLE_SLACK = TIMELINE_TOLERANCE + 1e-4;
+const double SPEED_SLACK = 1e-6;
+
+int failures = 0;
+
+//the recorded angles and speeds of one tick
+struct Tick {
+    std::vector<float> rot;
+    std::vector<float> speed;
+};
+
+//difference between two angles in degrees, the short way round
+double angleDifference( double a, double b ) {
+    double d = fmod(a - b, 360.0);
+    if(d > 180.0) d -= 360.0;
+    if(d < -180.0) d += 360.0;
+    return fabs(d);
+}
+
+//advance every body a tick like simStep does, changing some speeds and adding float drift
+void step( Tick& t, int tick ) {
+    for(int i = 0; i < BODIES; i++) {
+        if(rand() % 500 == 0) {
+            t.speed[i] = (rand() % 2000 - 1000) / 500.0f;
+        }
+        t.rot[i] += t.speed[i];
+        //the simulation's angles aren't kept in range, they drift apart from the prediction as they grow
+        if(tick % 97 == i % 97) t.rot[i] += 0.01f;
+    }
+}
+
+//seek every tick the timeline still has and compare it with what was recorded
+void checkAll( const Timeline& timeline, const std::vector<Tick>& recorded, const char* what ) {
+    std::vector<float> rot(BODIES), speed(BODIES);
+    int bad = 0;
+    for(int tick = timeline.first(); tick <= timeline.last(); tick++) {
+        timeline.seek(tick, &rot[0], &speed[0]);
+        const Tick& t = recorded[tick];
+        for(int i = 0; i < BODIES; i++) {
+            if(angleDifference(rot[i], t.rot[i]) > ANGLE_SLACK || fabs(speed[i] - t.speed[i]) > SPEED_SLACK) {
+                if(bad++ < 5) {
+                    fprintf(stderr, "%s: tick %d body %d came back as %f at %f, recorded %f at %f\n", what,
+                            tick, i, rot[i], speed[i], t.rot[i], t.speed[i]);
+                }
+            }
+        }
+    }
+    if(bad > 0) failures++;
+    printf("%-32s ticks %d to %d, %d mismatches\n", what, timeline.first(), timeline.last(), bad);
+}
+
+int main()
+{
+    srand(1);
+    Tick t;
+    t.rot.resize(BODIES);
+    t.speed.resize(BODIES);
+    for(int i = 0; i < BODIES; i++) {
+        t.rot[i] = rand() % 360;
+        t.speed[i] = (rand() % 2000 - 1000) / 500.0f;
+    }
+    std::vector<Tick> recorded;
+    Timeline timeline;
+    timeline.setBudget((size_t) 64 << 20);
+    for(int tick = 0; tick < TICKS; tick++) {
+        recorded.push_back(t);
+        timeline.record(&t.rot[0], &t.speed[0], BODIES);
+        step(t, tick);
+    }
+    if(timeline.first() != 0 || timeline.last() != TICKS - 1) {
+        fprintf(stderr, "recorded %d ticks, the timeline has %d to %d\n", TICKS, timeline.first(), timeline.last());
+        failures++;
+    }
+    checkAll(timeline, recorded, "everything");
+    if(timeline.bytes() >= timeline.rawBytes()) {
+        fprintf(stderr, "%zu bytes for what's %zu as floats\n", timeline.bytes(), timeline.rawBytes());
+        failures++;
+    }
+
+    //go back, then record a different future from there
+    int back = TICKS / 2 + 7;
+    timeline.truncate(back);
+    recorded.resize(back + 1);
+    t = recorded[back];
+    step(t, back);
+    for(int tick = back + 1; tick < TICKS; tick++) {
+        //something the first recording didn't do, so stale data would show
+        t.speed[tick % BODIES] = -t.speed[tick % BODIES];
+        recorded.push_back(t);
+        timeline.record(&t.rot[0], &t.speed[0], BODIES);
+        step(t, tick);
+    }
+    checkAll(timeline, recorded, "after truncate");
+
+    //a budget of a few segments keeps only the newest ticks
+    Timeline small;
+    small.setBudget(timeline.bytes() / 8);
+    for(int tick = 0; tick < TICKS; tick++) {
+        small.record(&recorded[tick].rot[0], &recorded[tick].speed[0], BODIES);
+    }
+    if(small.first() == 0 || small.last() != TICKS - 1 || small.first() % TIMELINE_KEYFRAME_TICKS != 0) {
+        fprintf(stderr, "a small budget kept ticks %d to %d\n", small.first(), small.last());
+        failures++;
+    }
+    checkAll(small, recorded, "small budget");
+
+    //a budget smaller than one segment keeps just the newest, still numbered from the start
+    Timeline tiny;
+    tiny.setBudget(1);
+    for(int tick = 0; tick < TICKS; tick++) {
+        tiny.record(&recorded[tick].rot[0], &recorded[tick].speed[0], BODIES);
+        if(tiny.last() != tick) {
+            fprintf(stderr, "a tiny budget numbered tick %d as %d\n", tick, tiny.last());
+            failures++;
+            break;
+        }
+    }
+    if(tiny.first() != (TICKS - 1) / TIMELINE_KEYFRAME_TICKS * TIMELINE_KEYFRAME_TICKS) {
+        fprintf(stderr, "a tiny budget kept ticks %d to %d\n", tiny.first(), tiny.last());
+        failures++;
+    }
+    checkAll(tiny, recorded, "tiny budget");
+
+    if(failures > 0) {
+        printf("%d failures\n", failures);
+        return 1;
+    }
+    printf("ok\n");
+    return 0;
+}
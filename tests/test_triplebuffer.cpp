@@ -0,0 +1,86 @@
+// ------------------------
+// Stress test for TripleBuffer.h
+// ------------------------
+//
+// usage: test_triplebuffer
+//
+// A writer thread publishes numbered values as fast as it can while the
+// reader takes them. Every value the reader sees has to be whole (all of it
+// from the same publish), and newer than the one before, and the last one
+// published has to get through. Built with -fsanitize=thread by make test so
+// a race on the slots shows up as well. Exits non-zero if anything's wrong.
+
+#include <stdio.h>
+#include <atomic>
+#include <vector>
+#include <thread>
+
+#include "TripleBuffer.h"
+
+const int PUBLISHES = 200000;
+//big enough that a torn value would be caught halfway through
+const int PAYLOAD = 64;
+
+struct Value {
+    int number;
+    std::vector<int> payload;
+};
+
+TripleBuffer<Value> buffer;
+std::atomic<bool> finished(false);
+
+void writer() {
+    for(int n = 1; n <= PUBLISHES; n++) {
+        Value& v = buffer.writing();
+        v.number = n;
+        v.payload.assign(PAYLOAD, n);
+        buffer.publish();
+    }
+    finished = true;
+}
+
+int main()
+{
+    std::thread w(writer);
+    int last = 0, seen = 0, failures = 0;
+    while(last < PUBLISHES && failures <= 10) {
+        //finished is looked at first, anything published before it was set is fresh by now
+        bool writerDone = finished;
+        if(!buffer.update()) {
+            if(writerDone) {
+                fprintf(stderr, "the writer is done and %d never got through\n", PUBLISHES);
+                failures++;
+                break;
+            }
+            std::this_thread::yield();
+            continue;
+        }
+        const Value& v = buffer.reading();
+        seen++;
+        if(v.number <= last) {
+            fprintf(stderr, "read %d after %d\n", v.number, last);
+            failures++;
+        }
+        for(int i = 0; i < PAYLOAD; i++) {
+            if(v.payload[i] != v.number) {
+                fprintf(stderr, "value %d has %d at %d\n", v.number, v.payload[i], i);
+                failures++;
+                break;
+            }
+        }
+        last = v.number;
+    }
+    w.join();
+    //nothing was published after the last one, there's nothing left to take
+    if(buffer.update() || buffer.fresh()) {
+        fprintf(stderr, "still fresh after the last publish was read\n");
+        failures++;
+    }
+    printf("%d of %d publishes read, the last one %d\n", seen, PUBLISHES, last);
+    if(failures > 0) {
+        printf("%d failures\n", failures);
+        return 1;
+    }
+    printf("ok\n");
+    return 0;
+}
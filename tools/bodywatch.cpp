@@ -0,0 +1,67 @@
+// ------------------------
+// Follows a running simulation through its shared memory export
+// ------------------------
+//
+// usage: bodywatch [region] [body...]
+//
+// Start the simulation with --export [region] (default /solarsystem), then
+// this prints the tick and the position of the given bodies (default the
+// first few) every half second. It only ever reads the shared memory, the
+// simulation never waits for it.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <vector>
+#include <algorithm>
+
+#include "SharedBodies.h"
+
+//bodies shown when none are asked for
+const int DEFAULT_BODIES = 5;
+//microseconds between prints
+const int INTERVAL = 500000;
+
+int main(int argc, char** argv)
+{
+    const char* region = argc > 1 ? argv[1] : "/solarsystem";
+    std::vector<int> wanted;
+    for(int i = 2; i < argc; i++) {
+        wanted.push_back(atoi(argv[i]));
+    }
+    SharedBodiesReader reader;
+    while(true) {
+        if(!reader.isOpen() || reader.retired()) {
+            if(!reader.open(region)) {
+                printf("waiting for %s\n", region);
+                fflush(stdout);
+                usleep(INTERVAL);
+                continue;
+            }
+            printf("%s: %u bodies\n", region, reader.bodyCount());
+        }
+        SharedBodiesView view;
+        if(!reader.latest(view)) {
+            usleep(INTERVAL / 10);
+            continue;
+        }
+        //format straight out of shared memory, then make sure it didn't change underneath us
+        char line[4096];
+        int at = snprintf(line, sizeof(line), "tick %llu", (unsigned long long) view.tick);
+        int shown = wanted.empty() ? std::min<int>(DEFAULT_BODIES, view.bodyCount) : wanted.size();
+        for(int i = 0; i < shown && at < (int) sizeof(line); i++) {
+            int b = wanted.empty() ? i : wanted[i];
+            if(b < 0 || b >= (int) view.bodyCount) continue;
+            at += snprintf(line + at, sizeof(line) - at, "  %s (%.1f, %.1f, %.1f)", reader.name(b),
+                    view.bodies[b][0], view.bodies[b][1], view.bodies[b][2]);
+        }
+        if(!reader.stillValid(view)) {
+            continue;
+        }
+        printf("%s\n", line);
+        //piped into something else it should still show up as it happens
+        fflush(stdout);
+        usleep(INTERVAL);
+    }
+    return 0;
+}
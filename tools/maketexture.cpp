@@ -0,0 +1,241 @@
+// ------------------------
+// Makes planet textures for the virtual texture streaming
+// ------------------------
+//
+// usage: maketexture out.vtex [--levels n] [--seed n] [--style rock|bands]
+//
+// Paints a procedural texture around a sphere (noise looked up in 3D, so
+// there's no seam and nothing bunches up at the poles), builds every mip
+// level, cuts them into bordered tiles, BC1 compresses each and writes the
+// .vtex file TextureFile.h reads. The texture multiplies the material's
+// color, so it's mostly light and grey.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <stdint.h>
+#include <vector>
+#include <algorithm>
+
+#include "TextureFile.h"
+
+//texels along a tile's side without and with its borders
+const int TILE_SIZE = 120;
+const int BORDER = 4;
+const int SLOT = TILE_SIZE + 2 * BORDER;
+//where the tiles start in the file, on a page so every tile's pages are its own
+const uint32_t TILE_OFFSET = 4096;
+const int DEFAULT_LEVELS = 6;
+//noise octaves added up
+const int OCTAVES = 5;
+
+uint32_t seed = 1;
+
+//a random value in [0, 1) for a lattice point
+float lattice( int x, int y, int z ) {
+    uint32_t h = seed * 0x9E3779B9u ^ (uint32_t) x * 0x85EBCA6Bu ^ (uint32_t) y * 0xC2B2AE35u ^ (uint32_t) z * 0x27D4EB2Fu;
+    h ^= h >> 15;
+    h *= 0x2C1B3C6Du;
+    h ^= h >> 12;
+    h *= 0x297A2D39u;
+    h ^= h >> 15;
+    return (h & 0xFFFFFF) / 16777216.0f;
+}
+
+//smoothly interpolated lattice values
+float noise( float x, float y, float z ) {
+    int ix = (int) floorf(x), iy = (int) floorf(y), iz = (int) floorf(z);
+    float fx = x - ix, fy = y - iy, fz = z - iz;
+    fx = fx * fx * (3 - 2 * fx);
+    fy = fy * fy * (3 - 2 * fy);
+    fz = fz * fz * (3 - 2 * fz);
+    float c[2][2];
+    for(int j = 0; j < 2; j++) {
+        for(int k = 0; k < 2; k++) {
+            float a = lattice(ix, iy + j, iz + k);
+            float b = lattice(ix + 1, iy + j, iz + k);
+            c[j][k] = a + (b - a) * fx;
+        }
+    }
+    float near = c[0][0] + (c[1][0] - c[0][0]) * fy;
+    float far = c[0][1] + (c[1][1] - c[0][1]) * fy;
+    return near + (far - near) * fz;
+}
+
+//octaves of noise, each twice as fine and half as strong, in [0, 1)
+float fbm( float x, float y, float z ) {
+    float sum = 0, weight = 0.5, total = 0;
+    for(int o = 0; o < OCTAVES; o++) {
+        sum += noise(x, y, z) * weight;
+        total += weight;
+        x *= 2.03;
+        y *= 2.03;
+        z *= 2.03;
+        weight *= 0.5;
+    }
+    return sum / total;
+}
+
+//the brightness of the surface at a direction
+float paint( bool bands, float x, float y, float z ) {
+    if(bands) {
+        //stripes along the latitude, pushed about by the noise
+        float warp = fbm(x * 2 + 7, y * 2, z * 2);
+        return 0.7 + 0.3 * sinf(y * 14 + warp * 6);
+    }
+    float n = fbm(x * 3, y * 3, z * 3);
+    float detail = fbm(x * 24 + 3, y * 24, z * 24);
+    return std::min(0.45f + 0.55f * n + 0.2f * (detail - 0.5f), 1.0f);
+}
+
+uint16_t pack565( const float* c ) {
+    int r = (int) (c[0] * 31 + 0.5), g = (int) (c[1] * 63 + 0.5), b = (int) (c[2] * 31 + 0.5);
+    return (uint16_t) (r << 11 | g << 5 | b);
+}
+
+void unpack565( uint16_t v, float* c ) {
+    c[0] = (v >> 11 & 31) / 31.0;
+    c[1] = (v >> 5 & 63) / 63.0;
+    c[2] = (v & 31) / 31.0;
+}
+
+//one 4x4 block of rgb into BC1: the darkest and brightest texels as the ends, each texel the nearest of four
+void encodeBlock( const float (*block)[3], unsigned char* out ) {
+    int lo = 0, hi = 0;
+    for(int i = 1; i < 16; i++) {
+        float l = block[i][0] + block[i][1] + block[i][2];
+        if(l < block[lo][0] + block[lo][1] + block[lo][2]) lo = i;
+        if(l > block[hi][0] + block[hi][1] + block[hi][2]) hi = i;
+    }
+    uint16_t c0 = pack565(block[hi]), c1 = pack565(block[lo]);
+    //c0 > c1 picks the four color mode
+    if(c0 < c1) std::swap(c0, c1);
+    uint32_t indices = 0;
+    if(c0 != c1) {
+        float palette[4][3];
+        unpack565(c0, palette[0]);
+        unpack565(c1, palette[1]);
+        for(int k = 0; k < 3; k++) {
+            palette[2][k] = (2 * palette[0][k] + palette[1][k]) / 3;
+            palette[3][k] = (palette[0][k] + 2 * palette[1][k]) / 3;
+        }
+        for(int i = 0; i < 16; i++) {
+            int best = 0;
+            float bestDistance = 1e9;
+            for(int p = 0; p < 4; p++) {
+                float d = 0;
+                for(int k = 0; k < 3; k++) {
+                    d += (block[i][k] - palette[p][k]) * (block[i][k] - palette[p][k]);
+                }
+                if(d < bestDistance) {
+                    bestDistance = d;
+                    best = p;
+                }
+            }
+            indices |= (uint32_t) best << (2 * i);
+        }
+    }
+    out[0] = c0 & 0xFF;
+    out[1] = c0 >> 8;
+    out[2] = c1 & 0xFF;
+    out[3] = c1 >> 8;
+    for(int i = 0; i < 4; i++) {
+        out[4 + i] = indices >> (8 * i) & 0xFF;
+    }
+}
+
+int main(int argc, char** argv)
+{
+    if(argc < 2) {
+        fprintf(stderr, "usage: maketexture out.vtex [--levels n] [--seed n] [--style rock|bands]\n");
+        return 1;
+    }
+    const char* out = argv[1];
+    int levels = DEFAULT_LEVELS;
+    bool bands = false;
+    for(int i = 2; i < argc; i++) {
+        if(strcmp(argv[i], "--levels") == 0 && i + 1 < argc) {
+            levels = std::min(std::max(atoi(argv[++i]), 1), (int) TEXTURE_MAX_LEVELS);
+        } else if(strcmp(argv[i], "--seed") == 0 && i + 1 < argc) {
+            seed = strtoul(argv[++i], NULL, 10);
+        } else if(strcmp(argv[i], "--style") == 0 && i + 1 < argc) {
+            bands = strcmp(argv[++i], "bands") == 0;
+        }
+    }
+    //level 0, longitude across and latitude down like the shaders look it up
+    int size = TILE_SIZE << (levels - 1);
+    std::vector<float> image((size_t) size * size * 3);
+    for(int y = 0; y < size; y++) {
+        float theta = (y + 0.5) / size * M_PI;
+        for(int x = 0; x < size; x++) {
+            float lon = ((x + 0.5) / size - 0.5) * 2 * M_PI;
+            float dx = sinf(theta) * cosf(lon), dy = cosf(theta), dz = sinf(theta) * sinf(lon);
+            float l = paint(bands, dx, dy, dz);
+            //a little color of its own so it isn't flat grey
+            float tint = fbm(dx * 2 + 11, dy * 2, dz * 2) - 0.5;
+            float* t = &image[((size_t) y * size + x) * 3];
+            t[0] = std::min(std::max(l * (1 + 0.15f * tint), 0.0f), 1.0f);
+            t[1] = l;
+            t[2] = std::min(std::max(l * (1 - 0.15f * tint), 0.0f), 1.0f);
+        }
+    }
+    FILE* fp = fopen(out, "wb");
+    if(fp == NULL) {
+        fprintf(stderr, "can't write %s\n", out);
+        return 1;
+    }
+    TextureHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, TEXTURE_MAGIC, 4);
+    header.version = TEXTURE_VERSION;
+    header.tileSize = TILE_SIZE;
+    header.border = BORDER;
+    header.levels = levels;
+    header.tileBytes = textureTileBytes(SLOT);
+    header.tileOffset = TILE_OFFSET;
+    std::vector<unsigned char> pad(TILE_OFFSET, 0);
+    memcpy(&pad[0], &header, sizeof(header));
+    fwrite(&pad[0], 1, pad.size(), fp);
+    std::vector<unsigned char> tile(header.tileBytes);
+    float block[16][3];
+    for(int level = 0; level < levels; level++) {
+        int tiles = 1 << (levels - 1 - level);
+        for(int ty = 0; ty < tiles; ty++) {
+            for(int tx = 0; tx < tiles; tx++) {
+                for(int by = 0; by < SLOT / 4; by++) {
+                    for(int bx = 0; bx < SLOT / 4; bx++) {
+                        for(int i = 0; i < 16; i++) {
+                            //wrap around the sphere across, stop at the poles
+                            int x = ((tx * TILE_SIZE + bx * 4 + i % 4 - BORDER) % size + size) % size;
+                            int y = std::min(std::max(ty * TILE_SIZE + by * 4 + i / 4 - BORDER, 0), size - 1);
+                            memcpy(block[i], &image[((size_t) y * size + x) * 3], sizeof(block[i]));
+                        }
+                        encodeBlock(block, &tile[(by * (SLOT / 4) + bx) * 8]);
+                    }
+                }
+                fwrite(&tile[0], 1, tile.size(), fp);
+            }
+        }
+        //box filter down to the next level
+        int half = size / 2;
+        for(int y = 0; y < half; y++) {
+            for(int x = 0; x < half; x++) {
+                for(int k = 0; k < 3; k++) {
+                    image[((size_t) y * half + x) * 3 + k] = (image[((size_t) (2 * y) * size + 2 * x) * 3 + k]
+                        + image[((size_t) (2 * y) * size + 2 * x + 1) * 3 + k]
+                        + image[((size_t) (2 * y + 1) * size + 2 * x) * 3 + k]
+                        + image[((size_t) (2 * y + 1) * size + 2 * x + 1) * 3 + k]) / 4;
+                }
+            }
+        }
+        size = half;
+    }
+    if(fclose(fp) != 0) {
+        fprintf(stderr, "can't write %s\n", out);
+        return 1;
+    }
+    printf("%s: %d levels of %d texel tiles, %d MB\n", out, levels, TILE_SIZE,
+            (int) ((TILE_OFFSET + (uint64_t) header.tileBytes * ((1 << 2 * levels) - 1) / 3) >> 20));
+    return 0;
+}
@@ -31,15 +31,12 @@ struct vec2 {
     vec2( GLfloat x, GLfloat y ) :
 	x(x), y(y) {}
 
-    vec2( const vec2& v )
-	{ x = v.x;  y = v.y;  }
-
     //
     //  --- Indexing Operator ---
     //
 
     GLfloat& operator [] ( int i ) { return *(&x + i); }
-    const GLfloat operator [] ( int i ) const { return *(&x + i); }
+    GLfloat operator [] ( int i ) const { return *(&x + i); }
 
     //
     //  --- (non-modifying) Arithematic Operators ---
@@ -170,8 +167,6 @@ struct vec3 {
     vec3( GLfloat x, GLfloat y, GLfloat z ) :
 	x(x), y(y), z(z) {}
 
-    vec3( const vec3& v ) { x = v.x;  y = v.y;  z = v.z; }
-
     vec3( const vec2& v, const float f ) { x = v.x;  y = v.y;  z = f; }
 
     //
@@ -179,7 +174,7 @@ struct vec3 {
     //
 
     GLfloat& operator [] ( int i ) { return *(&x + i); }
-    const GLfloat operator [] ( int i ) const { return *(&x + i); }
+    GLfloat operator [] ( int i ) const { return *(&x + i); }
 
     //
     //  --- (non-modifying) Arithematic Operators ---
@@ -320,8 +315,6 @@ struct vec4 {
     vec4( GLfloat x, GLfloat y, GLfloat z, GLfloat w ) :
 	x(x), y(y), z(z), w(w) {}
 
-    vec4( const vec4& v ) { x = v.x;  y = v.y;  z = v.z;  w = v.w; }
-
     vec4( const vec3& v, const float w = 1.0 ) : w(w)
 	{ x = v.x;  y = v.y;  z = v.z; }
 
@@ -333,7 +326,7 @@ struct vec4 {
     //
 
     GLfloat& operator [] ( int i ) { return *(&x + i); }
-    const GLfloat operator [] ( int i ) const { return *(&x + i); }
+    GLfloat operator [] ( int i ) const { return *(&x + i); }
 
     //
     //  --- (non-modifying) Arithematic Operators ---
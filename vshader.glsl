@@ -1,4 +1,5 @@
-#version 120
+#version 130
+#extension GL_ARB_uniform_buffer_object : require
 uniform int renderType;
 
 attribute vec4 vPosition;
@@ -7,18 +8,40 @@ attribute vec3 vFlatNormal;
 attribute float alpha;
 uniform vec4 vColor;
 uniform mat4 model_view;
-uniform mat4 camera_view;
-uniform mat4 projection_view;
+//the camera for this frame, every program shares the same buffer (see latchCamera)
+layout(std140, row_major) uniform Camera {
+    mat4 camera_view;
+    mat4 projection_view;
+    vec4 cameraEye;
+};
 varying vec4 fColor;
 
 //lighting
 varying  vec3 fN;
 varying  vec3 fV;
-varying  vec3 fL;
-uniform vec4 lightPosition;
-uniform vec4 cameraPosition;
+varying  vec3 fP;
+varying  vec4 fClip;
+//where on the unit sphere, what planet textures are looked up by
+varying vec3 fObject;
 uniform float shininess, ambientAmt, diffuseAmt, specularAmt;
 
+//clustered lights (see LightClusters.h)
+uniform sampler2D lightTex;
+uniform sampler2D clusterTex;
+uniform sampler2D indexTex;
+uniform ivec3 clusterSize;
+uniform vec2 clusterDepth;
+
+//find the offset/count of the cluster containing a clip space position
+vec2 cluster(vec4 clip)
+{
+    ivec2 tile = ivec2(clamp((clip.xy / clip.w * 0.5 + 0.5) * vec2(clusterSize.xy),
+                vec2(0.0), vec2(clusterSize.xy - 1)));
+    int slice = int(clamp(log(clip.w / clusterDepth.x) / clusterDepth.y * float(clusterSize.z),
+                0.0, float(clusterSize.z - 1)));
+    return texelFetch(clusterTex, ivec2(tile.y * clusterSize.x + tile.x, slice), 0).rg;
+}
+
 void
 main()
 {
@@ -27,10 +50,12 @@ main()
     } else if (renderType == 0) { //smooth shading
         fN = (model_view*vec4(vFlatNormal,0.0)).xyz;
     }
-    fV = (cameraPosition - model_view*vPosition).xyz;
-    fL = (lightPosition - model_view*vPosition).xyz;
+    fP = (model_view*vPosition).xyz;
+    fV = cameraEye.xyz - fP;
 
     gl_Position = projection_view * camera_view * model_view * vPosition;
+    fClip = gl_Position;
+    fObject = vPosition.xyz;
     //Gouraud Shading
     if(renderType == 1)// grid
     {
@@ -38,16 +63,28 @@ main()
 
         N = normalize(fN);
         V = normalize(fV);
-        L = normalize(fL);
-
-        H = normalize(L + V);
 
         vec4 ambient = ambientAmt*vColor;
-        vec4 diffuse = max(dot(L,N),0.0)*diffuseAmt*vColor;
-        vec4 specular = pow(max(dot(N,H),0.0),shininess)*specularAmt*vec4(1.0,1.0,1.0,1.0);
+        vec4 diffuse = vec4(0.0);
+        vec4 specular = vec4(0.0);
 
-        if(dot(L,N) < 0.0){
-            specular = vec4(0.0,0.0,0.0,1.0);
+        //only the lights binned into this vertex's cluster
+        vec2 c = cluster(gl_Position);
+        for(int i = 0; i < int(c.y); i++) {
+            int index = int(c.x) + i;
+            int l = int(texelFetch(indexTex, ivec2(index % LIGHT_INDEX_WIDTH, index / LIGHT_INDEX_WIDTH), 0).r);
+            vec4 light = texelFetch(lightTex, ivec2(l, 0), 0);
+            vec4 color = texelFetch(lightTex, ivec2(l, 1), 0);
+            L = light.xyz - fP;
+            //smooth falloff to zero at the light's range
+            float atten = clamp(1.0 - pow(length(L) / light.w, 4.0), 0.0, 1.0);
+            atten *= atten * color.w;
+            L = normalize(L);
+            H = normalize(L + V);
+            diffuse += atten*max(dot(L,N),0.0)*diffuseAmt*vColor*color;
+            if(dot(L,N) >= 0.0){
+                specular += atten*pow(max(dot(N,H),0.0),shininess)*specularAmt*color;
+            }
         }
 
         fColor = ambient + diffuse + specular;
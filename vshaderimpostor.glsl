@@ -0,0 +1,43 @@
+#version 130
+#extension GL_ARB_uniform_buffer_object : require
+//one screen aligned quad per instance, big enough to cover the sphere
+attribute vec2 vCorner;
+//per instance: xyz = world center, w = radius
+attribute vec4 vSphere;
+attribute vec4 vColor;
+//per instance: ambient, diffuse, specular, shininess
+attribute vec4 vMaterial;
+//same block as vshader.glsl
+layout(std140, row_major) uniform Camera {
+    mat4 camera_view;
+    mat4 projection_view;
+    vec4 cameraEye;
+};
+
+//everything is handed over in view space
+varying vec3 fRay;
+varying vec3 fCenter;
+varying float fRadius;
+varying vec4 fColor;
+varying vec4 fMaterial;
+
+void
+main()
+{
+    vec3 c = (camera_view * vec4(vSphere.xyz,1.0)).xyz;
+    float r = vSphere.w;
+    //face the quad at the eye, the silhouette cone of the sphere is
+    //a circle slightly wider than r on the plane through the center
+    float d2 = dot(c,c);
+    float spread = r * sqrt(d2 / max(d2 - r*r, 1e-6)) * 1.01;
+    vec3 w = normalize(c);
+    vec3 u = normalize(abs(w.y) < 0.99 ? cross(w, vec3(0.0,1.0,0.0)) : cross(w, vec3(1.0,0.0,0.0)));
+    vec3 v = cross(u, w);
+    vec3 p = c + (vCorner.x * u + vCorner.y * v) * spread;
+    fRay = p;
+    fCenter = c;
+    fRadius = r;
+    fColor = vColor;
+    fMaterial = vMaterial;
+    gl_Position = projection_view * vec4(p,1.0);
+}
@@ -1,9 +1,14 @@
-#version 120
+#version 130
+#extension GL_ARB_uniform_buffer_object : require
 attribute vec4 vPosition;
 attribute vec4 vColor;
 attribute float size;
-uniform mat4 camera_view;
-uniform mat4 projection_view;
+//same block as vshader.glsl
+layout(std140, row_major) uniform Camera {
+    mat4 camera_view;
+    mat4 projection_view;
+    vec4 cameraEye;
+};
 varying vec4 fColor;
 
 void
@@ -0,0 +1,57 @@
+#version 130
+#extension GL_ARB_uniform_buffer_object : require
+//procedural starfield: there is no vertex buffer, everything about a star
+//is derived from gl_VertexID so memory doesn't grow with the star count
+uniform int seed;
+//dimensions of space
+uniform vec3 space;
+//stars closer than this (manhattan distance) to the origin get rerolled
+uniform float exclusion;
+//same block as vshader.glsl
+layout(std140, row_major) uniform Camera {
+    mat4 camera_view;
+    mat4 projection_view;
+    vec4 cameraEye;
+};
+varying vec4 fColor;
+
+//integer hash (lowbias32), good enough avalanche for star placement
+uint hash(uint x)
+{
+    x ^= x >> 16;
+    x *= 0x7feb352du;
+    x ^= x >> 15;
+    x *= 0x846ca68bu;
+    x ^= x >> 16;
+    return x;
+}
+
+//step the state and return a float in [0,1)
+float random(inout uint state)
+{
+    state = hash(state);
+    return float(state >> 8) / 16777216.0;
+}
+
+void
+main()
+{
+    uint state = hash(uint(gl_VertexID) ^ hash(uint(seed)));
+    //and x,y,z location
+    vec3 p = (vec3(random(state),random(state),random(state)) - 0.5) * space;
+    //if it is near origin, try again
+    //dont want it overlapping our beautiful default solar system
+    for(int i = 0; i < 8 && abs(p.x)+abs(p.y)+abs(p.z) < exclusion; i++) {
+        p = (vec3(random(state),random(state),random(state)) - 0.5) * space;
+    }
+    //still unlucky after 8 tries, push it out to the edge of the zone
+    float d = abs(p.x)+abs(p.y)+abs(p.z);
+    if(d < exclusion) {
+        p = d > 0.0 ? p * (exclusion / d) : vec3(exclusion,0.0,0.0);
+    }
+    //choose a random color and alpha
+    fColor = vec4(random(state),random(state),random(state),random(state));
+    //size is between 0.5-1.7
+    gl_PointSize = random(state) * 1.2 + 0.5;
+    gl_Position = projection_view * camera_view * vec4(p,1.0);
+}